@@ -0,0 +1,179 @@
+/*
+ * Interrupt driven analog input sampling.
+ *
+ * analogRead() busy-waits about 112 us for each conversion.  Instead
+ * the ADC runs continuously: the conversion complete interrupt stores the
+ * result and starts a conversion on the next channel, round robin.
+ *
+ * Each channel has a divisor: it is sampled on every divisor'th pass
+ * through the channel list.  A conversion takes 104 us, so with three
+ * channels at divisor 1 each one is sampled about every 300 us.
+ *
+ * Channels not needed by the current state can be turned off with
+ * adc_enable(), which gives the others more samples.
+ *
+ * Results:
+ * 	The last ADC_RING samples of each channel are kept with the time
+ * 	they were taken.  Samples are numbered by an 8-bit count that the
+ * 	interrupt bumps after storing each one, so readers never need to
+ * 	disable interrupts: they copy a sample, then check that the count
+ * 	did not move far enough for it to be overwritten.
+ *
+ * NOTE:
+ * 	Nothing else may use the ADC once adc_setup() has been called.
+ * 	In particular, no analogRead().
+ */
+
+#include "Arduino.h"
+#include "pins.h"
+#include "adc.h"
+
+#define	ADC_REF		_BV(REFS0)	// AVcc reference, same as analogRead()
+#define	ADC_PRESCALE	(_BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0))	// 16 MHz / 128
+
+#define	ADC_MAX_DIVISOR	8
+
+struct adc_channel_s {
+	unsigned char mux;
+	unsigned char divisor;	// sample every divisor'th pass
+};
+
+static const struct adc_channel_s adc_channels[ADC_N_CHANNELS] = {
+	{ PIN_SCROLL - A0,	8 },	// a person on a switch is slow
+	{ PIN_MAIN_PRESS - A0,	1 },
+	{ PIN_IG_PRESS - A0,	1 },
+	{ PIN_SPARK - A0,	1 },
+};
+
+static volatile struct adc_sample_s adc_ring[ADC_N_CHANNELS][ADC_RING];
+static volatile unsigned char adc_counts[ADC_N_CHANNELS];
+static volatile unsigned char adc_mask;		// channels being sampled
+static volatile bool adc_running;		// a conversion is in progress
+static unsigned char adc_current;		// channel being converted
+static unsigned char adc_pass;			// passes through the channel list
+
+/*
+ * Pick the next channel due for a sample and start converting it.
+ * Called from the ISR, or with the ADC idle.
+ */
+static void i_start_next() {
+	unsigned char i, c;
+
+	c = adc_current;
+	for (i = 0; i < ADC_N_CHANNELS * ADC_MAX_DIVISOR; i++) {
+		if (++c >= ADC_N_CHANNELS) {
+			c = 0;
+			adc_pass++;
+		}
+		if ((adc_mask & ADC_BIT(c)) &&
+		    (adc_pass % adc_channels[c].divisor) == 0) {
+			adc_current = c;
+			ADMUX = ADC_REF | adc_channels[c].mux;
+			ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADIE) | ADC_PRESCALE;
+			adc_running = true;
+			return;
+		}
+	}
+	adc_running = false;
+}
+
+ISR(ADC_vect) {
+	volatile struct adc_sample_s *s;
+	unsigned char c, n;
+
+	c = adc_current;
+	n = adc_counts[c] + 1;
+	s = &adc_ring[c][n & (ADC_RING - 1)];
+	s->value = ADC;
+	s->time = micros();
+	adc_counts[c] = n;
+
+	i_start_next();
+}
+
+void adc_setup() {
+	unsigned char c, i;
+
+	ADCSRA = 0;
+	for (c = 0; c < ADC_N_CHANNELS; c++) {
+		adc_counts[c] = 0;
+		for (i = 0; i < ADC_RING; i++) {
+			adc_ring[c][i].value = 0;
+			adc_ring[c][i].time = 0;
+		}
+	}
+	adc_current = ADC_N_CHANNELS - 1;
+	adc_pass = 0;
+	adc_running = false;
+	adc_enable(ADC_ALL);
+}
+
+/*
+ * Choose which channels are sampled.
+ * The samples of turned off channels stay as they were.
+ */
+void adc_enable(unsigned char mask) {
+	adc_mask = mask & ADC_ALL;
+
+	// The ISR stops when it runs out of channels, so restart it here.
+	noInterrupts();
+	if (!adc_running)
+		i_start_next();
+	interrupts();
+}
+
+bool adc_enabled(unsigned char ch) {
+	return (adc_mask & ADC_BIT(ch)) != 0;
+}
+
+/*
+ * Number of the newest sample on a channel.  Wraps at 256.
+ */
+unsigned char adc_count(unsigned char ch) {
+	return adc_counts[ch];
+}
+
+/*
+ * Get sample number n of a channel.
+ * Returns false if that sample has been overwritten (or not taken yet).
+ */
+bool adc_sample(unsigned char ch, unsigned char n, struct adc_sample_s *s) {
+	if ((unsigned char)(adc_counts[ch] - n) >= ADC_RING)
+		return false;
+	s->value = adc_ring[ch][n & (ADC_RING - 1)].value;
+	s->time = adc_ring[ch][n & (ADC_RING - 1)].time;
+	return (unsigned char)(adc_counts[ch] - n) < ADC_RING;
+}
+
+/*
+ * Latest value on a channel
+ */
+unsigned int adc_read(unsigned char ch) {
+	struct adc_sample_s s;
+
+	while (!adc_sample(ch, adc_counts[ch], &s))
+		;
+	return s.value;
+}
+
+/*
+ * Wait for a sample that was started after the call, and return it.
+ * This blocks for a few conversion times, so use it only when
+ * something has just changed, like turning off a DAC.
+ */
+unsigned int adc_read_fresh(unsigned char ch) {
+	unsigned char old_mask, n;
+
+	old_mask = adc_mask;
+	if (!(old_mask & ADC_BIT(ch)))
+		adc_enable(old_mask | ADC_BIT(ch));
+
+	// The conversion in progress may have started before we were called.
+	n = adc_counts[ch];
+	while ((unsigned char)(adc_counts[ch] - n) < 2)
+		delayMicroseconds(10);
+
+	if (!(old_mask & ADC_BIT(ch)))
+		adc_enable(old_mask);
+	return adc_read(ch);
+}
@@ -0,0 +1,27 @@
+/*
+ * Interrupt driven analog input sampling.  See adc.cpp.
+ */
+
+#define	ADC_SCROLL	0	// scroll switch
+#define	ADC_MAIN_PRESS	1	// main chamber pressure sensor (DAC output)
+#define	ADC_IG_PRESS	2	// igniter pressure sensor
+#define	ADC_SPARK	3	// spark sense
+#define	ADC_N_CHANNELS	4
+
+#define	ADC_BIT(ch)	(1 << (ch))
+#define	ADC_ALL		(ADC_BIT(ADC_N_CHANNELS) - 1)
+
+#define	ADC_RING	4	// samples kept per channel.  Must be a power of 2
+
+struct adc_sample_s {
+	unsigned int value;	// 10 bits
+	unsigned long time;	// micros() at end of conversion
+};
+
+extern void adc_setup();
+extern void adc_enable(unsigned char mask);
+extern bool adc_enabled(unsigned char ch);
+extern unsigned char adc_count(unsigned char ch);
+extern bool adc_sample(unsigned char ch, unsigned char n, struct adc_sample_s *s);
+extern unsigned int adc_read(unsigned char ch);
+extern unsigned int adc_read_fresh(unsigned char ch);
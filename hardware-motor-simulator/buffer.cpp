@@ -47,3 +47,26 @@ void buffer_print_n_c(char col, unsigned char val) {
 			break;
 	}
 }
+
+/*
+ * Print an unsigned long into the buffer.
+ * width digits, fixed width, leading zeros suppressed.
+ * Values too big for the field are shown as all 9s.
+ */
+void buffer_print_n_l(char col, unsigned char width, unsigned long val) {
+	unsigned long limit;
+	char i;
+
+	limit = 1;
+	for (i = 0; i < (char)width; i++)
+		limit *= 10;
+	if (val >= limit)
+		val = limit - 1;
+
+	for (i = width - 1; i >= 0; i--) {
+		buffer[col + i] = '0' + (val % 10);
+		val /= 10;
+		if (val <= 0)
+			break;
+	}
+}
@@ -2,16 +2,18 @@
  * Support functions for the digital to analog converters.
  *
  * NOTE: DAC support is outside the outputs.cpp framework.
- * The DAC is programmed inline when
+ * The DAC is programmed inline when the simulation changes it,
+ * but the I2C traffic happens in the background; see the transmit
+ * queue below.
  *
  * The DAC we use is a Sparkfun breakout board:
  *	https://www.sparkfun.com/products/12918
  */
 
 #include "Arduino.h"
-#include <Wire.h>
 #include "pins.h"
 #include "dac.h"
+#include "adc.h"
 
 
 /*
@@ -30,15 +32,219 @@
 #define	DAC_ADDR	MCP4725_ADDR
 
 //For devices with A0 pulled HIGH, use 0x61
+#define	DAC_WRITE_FAST	0x00	// fast mode: 2 bytes, PD bits and 12 data bits
 #define	DAC_WRITE_DAC	0x40	// write the DAC register
 #define	DAC_WRITE_EE	0x60	// write the DAC and the DAC's EEPROM register
+#define	DAC_CMD_MASK	0xe0
 #define	DAC_PD_NORMAL	0x00	// PD bits are set for normal operation
 #define	DAC_PD_OFF_LOW	0x02	// PD bits are set for power off, 1K resistor to GND
 #define	DAC_PD_OFF_MED	0x04	// PD bits are set for power off, 100K resistor to GND
 #define	DAC_PD_OFF_HIGH	0x06	// PD bits are set for power off, 500K resistor to GND
+#define	DAC_FAST_PD(pd)	((pd) << 3)	// PD bits are in a different place in fast mode
 
 #define	IDLE_MAIN	410	// 4096 / 10 => 0.5 volts, idle state of sensor
 
+/*
+ * Transmit queue
+ *
+ * Writing a DAC over I2C takes about 400 us at 100 kHz, far too long to
+ * wait for in the loop.  Instead each DAC has one slot holding the next
+ * frame to send to it, and the TWI interrupt sends the frames.
+ *
+ * Only the latest value sent to a DAC matters, so a new frame simply
+ * replaces one that hasn't gone out yet (coalescing).  The exception is
+ * a frame that writes the DAC's EEPROM: that one has to go out, so a
+ * new frame behind it waits (a queue full event).
+ *
+ * Bus time is kept down three ways:
+ * 	The bus runs at 400 kHz, which the MCP4725 supports.
+ * 	DACs in fast mode get the 2 byte fast write command instead
+ * 	of the 3 byte write DAC register command.
+ * 	dac_set() remembers the last value sent to each DAC and
+ * 	drops writes that would not change it (suppressed).  A frame
+ * 	lost to a bus error clears the memory, so the next write goes out.
+ *
+ * A 2 byte fast write at 400 kHz is 3 bytes on the wire including the
+ * address, about 70 us, versus about 370 us for a 3 byte write at 100 kHz.
+ */
+#define	N_DAC		2
+#define	DAC_FRAME_LEN	3
+#define	TWI_FREQ	400000UL	// default bus clock
+#define	DAC_CACHE_NONE	-1		// DAC state unknown, or powered down
+
+// TWI status codes, master transmitter
+#define	TW_START		0x08
+#define	TW_REP_START		0x10
+#define	TW_MT_SLA_ACK		0x18
+#define	TW_MT_SLA_NACK		0x20
+#define	TW_MT_DATA_ACK		0x28
+#define	TW_MT_DATA_NACK		0x30
+#define	TW_MT_ARB_LOST		0x38
+#define	TW_STATUS_MASK		0xf8
+
+// TWCR values
+#define	TWCR_IDLE	(_BV(TWEN))
+#define	TWCR_START	(_BV(TWINT) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+#define	TWCR_NEXT	(_BV(TWINT) | _BV(TWEN) | _BV(TWIE))
+#define	TWCR_STOP	(_BV(TWINT) | _BV(TWSTO) | _BV(TWEN))
+#define	TWCR_STOP_START	(_BV(TWINT) | _BV(TWSTO) | _BV(TWSTA) | _BV(TWEN) | _BV(TWIE))
+
+struct dac_frame_s {
+	unsigned char data[DAC_FRAME_LEN];
+	unsigned char len;
+	volatile bool pending;
+};
+
+static struct dac_frame_s dac_queue[N_DAC];
+static unsigned char tx_data[DAC_FRAME_LEN];	// frame on the wire
+static unsigned char tx_len;
+static unsigned char tx_addr;
+static unsigned char tx_next;			// next byte to send; 0 is the address
+static volatile bool twi_busy;
+static unsigned char twi_last_dac;		// for round robin
+static bool dac_fast[N_DAC];			// use fast write commands
+static volatile int dac_cache[N_DAC];		// last value queued, or DAC_CACHE_NONE
+
+volatile unsigned long dac_frames_sent;
+volatile unsigned long dac_frames_coalesced;
+volatile unsigned long dac_queue_full;
+volatile unsigned long dac_bus_errors;
+volatile unsigned long dac_frames_suppressed;
+volatile unsigned long dac_bus_bytes;
+
+/*
+ * Move the next pending frame to the transmit buffer.
+ * Returns false if there is none.  Interrupts must be off.
+ */
+static bool i_next_frame() {
+	unsigned char i, d;
+
+	for (i = 0; i < N_DAC; i++) {
+		d = (twi_last_dac + 1 + i) % N_DAC;
+		if (dac_queue[d].pending) {
+			memcpy(tx_data, dac_queue[d].data, DAC_FRAME_LEN);
+			tx_len = dac_queue[d].len;
+			dac_queue[d].pending = false;
+			tx_addr = (DAC_ADDR | d) << 1;	// write
+			tx_next = 0;
+			twi_last_dac = d;
+			return true;
+		}
+	}
+	return false;
+}
+
+ISR(TWI_vect) {
+	switch (TWSR & TW_STATUS_MASK) {
+	case TW_START:
+	case TW_REP_START:
+		TWDR = tx_addr;
+		TWCR = TWCR_NEXT;
+		dac_bus_bytes++;
+		return;
+
+	case TW_MT_SLA_ACK:
+	case TW_MT_DATA_ACK:
+		if (tx_next < tx_len) {
+			TWDR = tx_data[tx_next++];
+			TWCR = TWCR_NEXT;
+			dac_bus_bytes++;
+			return;
+		}
+		dac_frames_sent++;
+		break;
+
+	default:
+		// nobody home, or somebody else on the bus.  Drop the frame,
+		// and forget the value so the next dac_set() sends it again.
+		dac_bus_errors++;
+		dac_cache[twi_last_dac] = DAC_CACHE_NONE;
+		break;
+	}
+
+	// Frame done.  Stop, and start the next one if there is one.
+	if (i_next_frame()) {
+		TWCR = TWCR_STOP_START;
+	} else {
+		TWCR = TWCR_STOP;
+		twi_busy = false;
+	}
+}
+
+/*
+ * Put a frame in a DAC's slot and get the bus going if it is idle.
+ */
+static void i_queue(int dac, unsigned char len, unsigned char b0, unsigned char b1, unsigned char b2) {
+	struct dac_frame_s *f;
+	bool counted;
+
+	f = &dac_queue[dac & 1];
+	counted = false;
+	for (;;) {
+		noInterrupts();
+		if (!f->pending || (f->data[0] & DAC_CMD_MASK) != DAC_WRITE_EE)
+			break;
+		interrupts();
+		if (!counted)
+			dac_queue_full++;
+		counted = true;
+		delayMicroseconds(10);
+	}
+
+	if (f->pending)
+		dac_frames_coalesced++;
+	f->data[0] = b0;
+	f->data[1] = b1;
+	f->data[2] = b2;
+	f->len = len;
+	f->pending = true;
+
+	if (!twi_busy) {
+		// the last STOP may still be on the wire
+		while (TWCR & _BV(TWSTO))
+			;
+		i_next_frame();
+		twi_busy = true;
+		TWCR = TWCR_START;
+	}
+	interrupts();
+}
+
+/*
+ * Wait until everything queued has been sent.
+ */
+void dac_flush() {
+	while (twi_busy)
+		delayMicroseconds(10);
+}
+
+void dac_counters_reset() {
+	noInterrupts();
+	dac_frames_sent = 0;
+	dac_frames_coalesced = 0;
+	dac_queue_full = 0;
+	dac_bus_errors = 0;
+	dac_frames_suppressed = 0;
+	dac_bus_bytes = 0;
+	interrupts();
+}
+
+void dac_counters_to_serial() {
+	Serial.print(F("DAC frames: "));
+	Serial.print(dac_frames_sent);
+	Serial.print(F(" sent, "));
+	Serial.print(dac_frames_coalesced);
+	Serial.print(F(" coalesced, "));
+	Serial.print(dac_queue_full);
+	Serial.print(F(" queue full, "));
+	Serial.print(dac_frames_suppressed);
+	Serial.print(F(" suppressed, "));
+	Serial.print(dac_bus_errors);
+	Serial.print(F(" errors, "));
+	Serial.print(dac_bus_bytes);
+	Serial.print(F(" bytes on the bus\n"));
+}
+
 /*
  * This routine sets the DAC using a 10-bit number.  Handy because input pressures
  * are 10-bits
@@ -57,19 +263,55 @@ void dac_set10(int dac, int val) {
  */
 
 void dac_set(int dac, int val) {
-	Wire.beginTransmission(DAC_ADDR | (dac & 1));
-	Wire.write(DAC_WRITE_DAC | DAC_PD_NORMAL);	// cmd to update the DAC
-	Wire.write(val >> 4);				// the 8 most significant bits...
-	Wire.write((val & 0x0f) << 4);			// the 4 least significant bits...
-	Wire.endTransmission();
+	dac &= 1;
+	val &= 0xfff;
+	// the ISR forgets the value if the frame is lost
+	noInterrupts();
+	if (dac_cache[dac] == val) {
+		interrupts();
+		dac_frames_suppressed++;
+		return;
+	}
+	dac_cache[dac] = val;
+	interrupts();
+
+	if (dac_fast[dac])
+		i_queue(dac, 2,
+			DAC_WRITE_FAST | DAC_FAST_PD(DAC_PD_NORMAL) | (val >> 8),
+			val & 0xff,
+			0);
+	else
+		i_queue(dac, 3,
+			DAC_WRITE_DAC | DAC_PD_NORMAL,	// cmd to update the DAC
+			val >> 4,			// the 8 most significant bits...
+			(val & 0x0f) << 4);		// the 4 least significant bits...
 }
 
 void dac_off(int dac) {
-	Wire.beginTransmission(DAC_ADDR | (dac & 1));
-	Wire.write(DAC_WRITE_DAC | DAC_PD_OFF_MED);	// cmd to update the DAC
-	Wire.write(0);					// the 8 most significant bits...
-	Wire.write(0);					// the 4 least significant bits...
-	Wire.endTransmission();
+	dac &= 1;
+	dac_cache[dac] = DAC_CACHE_NONE;
+	if (dac_fast[dac])
+		i_queue(dac, 2, DAC_WRITE_FAST | DAC_FAST_PD(DAC_PD_OFF_MED), 0, 0);
+	else
+		i_queue(dac, 3, DAC_WRITE_DAC | DAC_PD_OFF_MED, 0, 0);
+}
+
+/*
+ * Choose between fast writes (2 bytes) and write DAC register commands
+ * (3 bytes) for one DAC.
+ */
+void dac_set_fast(int dac, bool fast) {
+	dac_fast[dac & 1] = fast;
+}
+
+/*
+ * Set the I2C bus clock.  Waits for the bus to go idle first.
+ * The MCP4725 handles 100 kHz and 400 kHz (and 3.4 MHz high speed mode,
+ * which the ATmega can't do).
+ */
+void dac_set_clock(unsigned long hz) {
+	dac_flush();
+	TWBR = ((F_CPU / hz) - 16) / 2;
 }
 
 /*
@@ -79,26 +321,38 @@ void dac_off(int dac) {
 bool dac_ig_press_present()
 {
 	dac_off(DAC_IG);
-	return (analogRead(PIN_IG_PRESS) < 100? false: true);
+	dac_flush();
+	return (adc_read_fresh(ADC_IG_PRESS) < 100? false: true);
 }
 
 /*
  * Set the DACs to power up in proper state.
  */
 void dac_setup() {
-	Wire.begin();
+	unsigned char i;
+
+	for (i = 0; i < N_DAC; i++) {
+		dac_queue[i].pending = false;
+		dac_fast[i] = true;
+		dac_cache[i] = DAC_CACHE_NONE;
+	}
+	twi_busy = false;
+	dac_counters_reset();
+
+	// Internal pullups on, SCL at TWI_FREQ
+	pinMode(PIN_I2C_SDA, INPUT_PULLUP);
+	pinMode(PIN_I2C_SCL, INPUT_PULLUP);
+	TWSR = 0;				// prescaler 1
+	TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
+	TWCR = TWCR_IDLE;
 
 	// Set the power-up state of the DACs to main at idle,
-	Wire.beginTransmission(DAC_ADDR | DAC_MAIN);
-	Wire.write(DAC_WRITE_EE | DAC_PD_NORMAL);	// cmd to update the DAC and EEPROM
-	Wire.write(IDLE_MAIN >> 4);			// the 8 most significant bits...
-	Wire.write((IDLE_MAIN & 0x0f) << 4);		// the 4 least significant bits...
-	Wire.endTransmission();
+	i_queue(DAC_MAIN, 3,
+		DAC_WRITE_EE | DAC_PD_NORMAL,		// cmd to update the DAC and EEPROM
+		IDLE_MAIN >> 4,				// the 8 most significant bits...
+		(IDLE_MAIN & 0x0f) << 4);		// the 4 least significant bits...
+	dac_cache[DAC_MAIN] = IDLE_MAIN;
 	//
 	// and igniter powered down at medium impedence.
-	Wire.beginTransmission(DAC_ADDR | DAC_IG);
-	Wire.write(DAC_WRITE_EE | DAC_PD_OFF_MED);	// cmd to update the DAC and EEPROM
-	Wire.write(0);					// the 8 most significant bits...
-	Wire.write(0);					// the 4 least significant bits...
-	Wire.endTransmission();
+	i_queue(DAC_IG, 3, DAC_WRITE_EE | DAC_PD_OFF_MED, 0, 0);
 }
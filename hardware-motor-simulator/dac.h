@@ -5,3 +5,16 @@ extern void dac_setup();
 extern void dac_set(int dac, int val);
 extern void dac_set10(int dac, int val);
 extern bool dac_ig_press_present();
+extern void dac_flush();
+extern void dac_set_fast(int dac, bool fast);
+extern void dac_set_clock(unsigned long hz);
+
+// I2C traffic counters
+extern volatile unsigned long dac_frames_sent;
+extern volatile unsigned long dac_frames_coalesced;	// replaced before they went out
+extern volatile unsigned long dac_queue_full;		// had to wait for a slot
+extern volatile unsigned long dac_bus_errors;
+extern volatile unsigned long dac_frames_suppressed;	// same value as last time, not sent
+extern volatile unsigned long dac_bus_bytes;		// including address bytes
+extern void dac_counters_reset();
+extern void dac_counters_to_serial();
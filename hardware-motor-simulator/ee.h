@@ -2,8 +2,13 @@
  * Define who/what/where is in eeprom
  */
 
-#define	LOG_CHECK_BYTE_1	0	// how many entries in the log
-#define	LOG_CHECK_BYTE_2	1	// how many entries in the log
+#define	LOG_CHECK_BYTE_1	0	// log length in bytes, low 8 bits
+#define	LOG_CHECK_BYTE_2	1	// LOG_CHECK(length), or anything else if invalid
 #define	LOG_SEQ0		2	// log sequence # is a 16-bit number
 #define	LOG_SEQ1		3
+#define	LOG_LENGTH_HI		4	// log length in bytes, high 8 bits
+#define	LOG_FORMAT		5	// LOG_FORMAT_VARINT
 #define	LOG_BASE		10	// where to put the log
+
+#define	LOG_FORMAT_VARINT	2	// the old fixed 4 byte entries were format 1 (unmarked)
+#define	LOG_CHECK(len)		(0xff & (LOG_BYTES - (len) - ((len) >> 8)))
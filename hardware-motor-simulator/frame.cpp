@@ -0,0 +1,59 @@
+/*
+ * Send binary frames on the serial port.  See frame.h.
+ */
+
+#include <Arduino.h>
+#include "frame.h"
+
+/*
+ * A lone frame delimiter, so a reader that has seen other output on
+ * the port starts clean with the next frame.
+ */
+void frame_sync() {
+	Serial.write((uint8_t)0);
+}
+
+/*
+ * Is there room to send a frame with n payload bytes without waiting?
+ * The serial transmit buffer is a ring emptied by the UART interrupt,
+ * so a frame that fits goes out in the background.
+ */
+bool frame_room(unsigned char n) {
+	return Serial.availableForWrite() >= FRAME_WIRE(n);
+}
+
+/*
+ * COBS: each run of nonzero bytes goes out after a code byte of its
+ * length + 1, and the zero that ends the run is dropped.  A frame is
+ * never longer than 254 bytes, so a run always ends at a zero or at
+ * the end of the frame.
+ */
+void frame_send(unsigned char type, const unsigned char *p, unsigned char n) {
+	unsigned char f[FRAME_MAX + 3];
+	unsigned char i, len, run;
+	unsigned int crc;
+
+	if (n > FRAME_MAX)
+		n = FRAME_MAX;
+	f[0] = type;
+	crc = frame_crc(0xffff, type);
+	for (i = 0; i < n; i++) {
+		f[i + 1] = p[i];
+		crc = frame_crc(crc, p[i]);
+	}
+	f[n + 1] = crc >> 8;
+	f[n + 2] = crc;
+	len = n + 3;
+
+	i = 0;
+	for (;;) {
+		for (run = 0; i + run < len && f[i + run]; run++)
+			;
+		Serial.write((uint8_t)(run + 1));
+		Serial.write(f + i, run);
+		i += run + 1;		// past the zero
+		if (i > len)
+			break;
+	}
+	Serial.write((uint8_t)0);
+}
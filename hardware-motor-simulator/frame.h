@@ -0,0 +1,42 @@
+/*
+ * Binary frames on the serial port
+ *
+ * A frame is a type byte, up to FRAME_MAX payload bytes and a CRC16
+ * over both, COBS encoded and ended with a zero byte.  Since a zero
+ * never shows up inside a frame, a reader can start anywhere: it drops
+ * bytes up to the first zero and takes frames from there on.  Anything
+ * that fails the CRC is thrown away.
+ *
+ * The CRC is CRC-16/CCITT-FALSE: polynomial 0x1021, start 0xffff, sent
+ * high byte first.  Multi-byte numbers in payloads are little endian.
+ *
+ * host/logdump.cpp decodes these.
+ */
+
+#define	FRAME_MAX		66	// payload bytes
+#define	FRAME_WIRE(n)		((n) + 5)	// bytes sent for n payload bytes
+
+/*
+ * Frame types
+ */
+#define	FRAME_LOG_HEAD		1	// seq lo, seq hi, length lo, length hi, format, n entries
+#define	FRAME_LOG_DATA		2	// offset lo, offset hi, log bytes
+#define	FRAME_EEPROM		3	// offset lo, offset hi, eeprom bytes
+#define	FRAME_END		4	// frames sent before this one, lo, hi
+#define	FRAME_TELEMETRY		5	// see telemetry.h
+#define	FRAME_TRACE		6	// see trace.cpp
+
+#define	FRAME_DATA		64	// bytes per data frame
+
+static inline unsigned int frame_crc(unsigned int crc, unsigned char c) {
+	unsigned char i;
+
+	crc ^= (unsigned int)c << 8;
+	for (i = 0; i < 8; i++)
+		crc = (crc & 0x8000)? (crc << 1) ^ 0x1021: crc << 1;
+	return crc & 0xffff;
+}
+
+void frame_sync();
+bool frame_room(unsigned char n);
+void frame_send(unsigned char type, const unsigned char *p, unsigned char n);
@@ -3,38 +3,37 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
-#include "menu.h"
 #include "log.h"
 #include "dac.h"
 #include "pressure.h"
-
-// amount of noise we put on simulated pressure traces.
-// Should be smaller than hysteresis value (3) in inputs.cpp
-#define	NOISE	2
-
-extern LiquidCrystal lcd;
+#include "physics.h"
+#include "loop_stats.h"
+#include "adc.h"
+#include "tick.h"
+#include "telemetry.h"
+#include "timing.h"
+#include "trace.h"
+#include "stack.h"
+#include "servo.h"
+
+extern Screen lcd;
 extern unsigned long loop_time;
 static unsigned long next_check_time;
 static unsigned long test_start_time;
 static const unsigned long check_interval = 100; // milliseconds
 extern void running_state(bool);
 
+// These can be set from the compiler command line, to try other values
+#ifndef IG_DELAY
 #define	IG_DELAY		25		// igniter fires 25 ms after spark + propellants
+#endif
 
+#ifndef PROPELLANT_LOAD
 #define	PROPELLANT_LOAD		4000		// in 4 seconds of full throttle.  Units are ms.
-
-#define	N2O_SERVO_MIN		(44+5)		// degress.  Off.
-#define	N2O_SERVO_MAX		(N2O_SERVO_MIN + 80)
-#define	IPA_SERVO_MIN		(44+5)		// degress.  Off.
-#define	IPA_SERVO_MAX		(IPA_SERVO_MIN + 80)
-
-//chamber behavior parameters: permit things like no/low pressure on main chamber startup,
-//or failure to reach full pressure when main valves open fully
-#define CHAMBER_EFF		100		// relative pressure
-#define CHAMBER_MAX_PCT		100		// max pressure percentage
+#endif
 
 //igniter failure modes
 #define IG_LIGHT		true
@@ -43,9 +42,17 @@ extern void running_state(bool);
 bool fr_sim_ig;		// true if we are simulating the igniter pressure sensor
 int chamber_p;		// simulated chamber pressure
 
+/*
+ * Simulated time, in milliseconds since the run started.
+ * The physics uses this rather than loop_time.  It advances exactly
+ * one tick per simulation step, however late the steps run.
+ */
+static unsigned long sim_time;
+
 /*
  * Common cleanup and state exit routine.
- * Called either by input_action_button or by running out of fuel
+ * Called either by input_action_button or by running out of fuel.
+ * Either way it goes on to the timing results, and from there to the log.
  */
 static void do_exit() {
 	input_action_button = false;
@@ -53,9 +60,26 @@ static void do_exit() {
 	if (fr_sim_ig)
 		dac_set10(DAC_IG, NO_PRESSURE);
 	log_enabled = false;
+	loop_stats_enabled = false;
+	adc_enable(ADC_ALL);
 	log_commit();
+	loop_stats_to_serial();
+	dac_counters_to_serial();
+	tick_to_serial();
+	physics_to_serial();
+	stack_to_serial();
+	timing_enabled = false;
+	timing_to_serial();
+	if (trace_enabled) {
+		trace_end();
+		trace_to_serial();
+	}
+	if (telem_channels) {
+		telem_to_serial();
+		telem_channels = 0;
+	}
 	output_led = LED_OFF;
-	state_new(menu_state);
+	state_new(timing_state);
 }
 
 void full_run_state(bool first_time) {
@@ -63,8 +87,15 @@ void full_run_state(bool first_time) {
 	if (first_time) {
 		log_reset();
 		log_enabled = true;
+		loop_stats_reset();
+		loop_stats_enabled = true;
+		dac_counters_reset();
+		timing_reset();
+		timing_enabled = true;
+		// Only the igniter pressure and spark matter during a run.
+		adc_enable(ADC_BIT(ADC_IG_PRESS) | ADC_BIT(ADC_SPARK));
 		lcd.clear();
-		lcd.print("Full Run");
+		lcd.print(F("Full Run"));
 		next_check_time = 0;
 		output_led = LED_ON;
 		dac_set10(DAC_MAIN, NO_PRESSURE);
@@ -85,16 +116,37 @@ void full_run_state(bool first_time) {
 		fr_sim_ig = !dac_ig_press_present();
 		lcd.setCursor(0, 1);
 		if (fr_sim_ig) {
-			lcd.print("Simulated Ignitor");
+			lcd.print(F("Simulated Ignitor"));
 			dac_set10(DAC_IG, NO_PRESSURE);
 		} else
-			lcd.print("Real Igniter     ");
+			lcd.print(F("Real Igniter     "));
+		if (trace_enabled)
+			trace_start(!fr_sim_ig);
 	}
 
+	trace_flush();
+
 	if (input_ig_valve_ipa_level || input_ig_valve_n2o_level || input_spark_sense)
 		state_new(running_state);
 }
 
+/*
+ * A full run with live telemetry; see telemetry.cpp.
+ */
+void telem_run_state(bool first_time) {
+	telem_channels = TELEM_ALL;
+	telem_period = TELEM_PERIOD;
+	state_new(full_run_state);
+}
+
+/*
+ * A telemetry run that traces the inputs as well; see trace.cpp.
+ */
+void trace_run_state(bool first_time) {
+	trace_enabled = true;
+	telem_run_state(first_time);
+}
+
 /*
  * Monitor the igniter.
  * Log when pressure becomes good.
@@ -114,6 +166,7 @@ static void monitor_ig() {
 	b = (input_ig_press >= IG_PRESS_GOOD);
 	if (b && !ig_pressure_has_been_good) {
 		log(LOG_IG_PRESSURE_GOOD_1, 0);
+		timing_mark(TM_IG_GOOD, micros());
 		ig_pressure_has_been_good = true;
 	} else if (b && !ig_pressure_good)
 		log(LOG_IG_PRESSURE_GOOD, 0);
@@ -124,45 +177,21 @@ static void monitor_ig() {
 }
 
 /*
- * Simulate the ingiter.  We do this every millisecond.
+ * Simulate the ingiter.  We do this every tick (millisecond).
  */
-static unsigned long sim_ig_next_update;
-static const unsigned long sim_ig_interval = 1;
 static int sim_ig_output;
-static int sim_ig_increment;
 static int sim_ig_output_target;
-static int sim_noise;
 
 //General behavior:
 //Igniter normally lights after a delay if alcohol, nitrous, and spark are present (IG_LIGHT).
 //Igniter normally stays lit if alcohol and nitrous are present (IG_STAY_LIT).
 //Igniter pressure is always >= chamber pressure. Igniter is lit if there is pressure.
 //(AKA igniter will relight from the chamber.)
-//Igniter pressure is slew limited and very slightly noisy.
+//Igniter pressure follows its target with a short lag and is very slightly noisy
+//(see physics.cpp).
 static void sim_ig() {
-	sim_noise++;
-	if (sim_noise > NOISE)
-		sim_noise = -NOISE;
-
-	// avoid running too often
-	if (loop_time < sim_ig_next_update)
-		return;
-	sim_ig_next_update = loop_time + sim_ig_interval;
-
-	// If we are changing the output signal, do so gradually.
-	if (sim_ig_output < sim_ig_output_target) {
-		sim_ig_output += sim_ig_increment;
-		if (sim_ig_output >= sim_ig_output_target) {
-			sim_ig_output = sim_ig_output_target;
-		}
-	}
-	if (sim_ig_output > sim_ig_output_target) {
-		sim_ig_output -= sim_ig_increment;
-		if (sim_ig_output <= sim_ig_output_target) {
-			sim_ig_output = sim_ig_output_target;
-		}
-	}
-	dac_set10(DAC_IG, sim_ig_output + sim_noise);
+	sim_ig_output = physics_ig(sim_ig_output_target);
+	dac_set10(DAC_IG, sim_ig_output);
 
 	// If any of the valves are off, kill the ig pressure
 	if (!input_ig_valve_ipa_level || !input_ig_valve_n2o_level) {
@@ -171,11 +200,11 @@ static void sim_ig() {
 
 	// If conditions are right, and have been for awhile, ig pressure up.
 	if (input_ig_valve_ipa_level && input_ig_valve_n2o_level
-			&& (input_spark_sense || (chamber_p > NO_PRESSURE + 10))
+			&& (input_spark_sense || physics_lit())
 			&& IG_LIGHT) {
 		if (ig_good_time == 0)
-			ig_good_time = loop_time + IG_DELAY;
-		else if (loop_time >= ig_good_time) {
+			ig_good_time = sim_time + IG_DELAY;
+		else if (sim_time >= ig_good_time) {
 			ig_good_time = 0;
 			sim_ig_output_target = IG_PRESSURE_TARGET;
 		}
@@ -189,33 +218,27 @@ static void sim_ig() {
 		}
 	}
 
-
-	if (sim_ig_output_target < chamber_p)
-		sim_ig_output_target = chamber_p;
 }
 
 /*
- * Main chamber fires when propellants are present and igniter has been at pressure
- * for some minimum time.
+ * Main chamber fires when propellants are present and the igniter is at pressure.
+ * Its pressure lags behind the flow (see physics.cpp).
  *
- * Each servo is converted into a percentage.  The smaller percentage is used to scale
- * the chamber pressure.
+ * Each servo position is converted into a percentage by its valve's flow curve.
+ * The chamber pressure comes from the total flow and the mixture ratio of the
+ * two, so a valve out of step with the other costs pressure.
  *
  * Chamber running time is the integral of chamber pressure percentage.  System is loaded
  * with a specified amount (in seconds) of propellants.
  *
- * When propellants run out, we exit to log review state.
+ * When propellants run out, we exit to the timing results (timing_state).
  *
  * Chamber pressure has efficiency (CHAMBER_EFF) and max (CHAMBER_MAX_PCT) parameters.
  * These can be used to simulate things like no ignition (CHAMBER_EFF low, maybe 5%?),
  * or other odd behavior.
  */
-static unsigned long sim_main_next_update;
-static const unsigned long sim_main_interval = 1;
-static const unsigned int servo_slew_inv_rate = 2;	// 2 milliseconds to slew 1 degree
-static unsigned long last_servo_update_time;
-static int ipa_servo_pos;
-static int n2o_servo_pos;
+static struct physics_servo_s ipa_servo;	// where the servos are; see physics.cpp
+static struct physics_servo_s n2o_servo;
 static int ipa_pct;		// percent of full flow rate that the valve is open
 static int n2o_pct;		// percent of full flow rate that the valve is open
 static int ipa_level;		// amount of ipa we have left
@@ -223,112 +246,71 @@ static int n2o_level;
 static int ipa_fractional_consumed;	// sum of pct each ms.
 static int n2o_fractional_consumed;
 
-static void servo_slew_init() {
-	last_servo_update_time = loop_time;
-}
-
-// compute the simulated servo positions.
-// simulate the propellant flow rates
-static void servo_slew() {
-	int servo_target;
-	int d;
-
-	d = (loop_time - last_servo_update_time) / servo_slew_inv_rate;
-	last_servo_update_time += d * servo_slew_inv_rate;
-
-	servo_target = servo_read_ipa();
-	if (servo_target > 0 && servo_target != ipa_servo_pos) {
-		if (servo_target > ipa_servo_pos) {
-			ipa_servo_pos += d;
-			if (ipa_servo_pos > servo_target)
-				ipa_servo_pos = servo_target;
-		} else {
-			ipa_servo_pos -= d;
-			if (ipa_servo_pos < servo_target)
-				ipa_servo_pos = servo_target;
-		}
-	}
-
-	servo_target = servo_read_n2o();
-	if (servo_target > 0 && servo_target != n2o_servo_pos) {
-		if (servo_target > n2o_servo_pos) {
-			n2o_servo_pos += d;
-			if (n2o_servo_pos > servo_target)
-				n2o_servo_pos = servo_target;
-		} else {
-			n2o_servo_pos -= d;
-			if (n2o_servo_pos < servo_target)
-				n2o_servo_pos = servo_target;
-		}
-	}
-}
-
 static int old_chamber_pct;
 static unsigned long last_main_log_time;
 
-static void sim_main() {
+static bool sim_main() {
 	int chamber_pct;
-	//int p;
-	extern void log_review_state(bool);
+	int ipa_deg, n2o_deg;
 
-	// avoid running too often
-	if (loop_time < sim_main_next_update)
-		return;
-	sim_main_next_update = loop_time + sim_main_interval;
-
-	servo_slew();
+	ipa_deg = servo_read_ipa();
+	n2o_deg = servo_read_n2o();
+	if (timing_servo(TM_MAIN_IPA, ipa_deg))
+		log(LOG_MAIN_IPA_CHANGE, ipa_deg);
+	if (timing_servo(TM_MAIN_N2O, n2o_deg))
+		log(LOG_MAIN_N2O_CHANGE, n2o_deg);
 
-	if (ipa_servo_pos <= IPA_SERVO_MIN)
-		ipa_pct = 0;
-	else if (ipa_servo_pos >= IPA_SERVO_MAX)
-		ipa_pct = 100;
-	else {
-		ipa_pct = 100 * (ipa_servo_pos - IPA_SERVO_MIN) /
-			(IPA_SERVO_MAX - IPA_SERVO_MIN);
-	}
+	// simulate the servo positions and the propellant flow rates
+	physics_servo(&ipa_servo, ipa_deg);
+	physics_servo(&n2o_servo, n2o_deg);
 
-	ipa_fractional_consumed += ipa_pct;
-	ipa_level -= ipa_fractional_consumed / 100;
-	ipa_fractional_consumed %= 100;
-
-	if (n2o_servo_pos <= N2O_SERVO_MIN)
-		n2o_pct = 0;
-	else if (n2o_servo_pos >= N2O_SERVO_MAX)
-		n2o_pct = 100;
-	else {
-		n2o_pct = 100 * (n2o_servo_pos - N2O_SERVO_MIN) /
-			(IPA_SERVO_MAX - IPA_SERVO_MIN);
-	}
+	// flow curve lookups; see physics.h
+	ipa_pct = physics_ipa_pct(ipa_servo.pos);
+	physics_consume(&ipa_level, &ipa_fractional_consumed, ipa_pct);
 
-	n2o_fractional_consumed += n2o_pct;
-	n2o_level -= n2o_fractional_consumed / 100;
-	n2o_fractional_consumed %= 100;
+	n2o_pct = physics_n2o_pct(n2o_servo.pos);
+	physics_consume(&n2o_level, &n2o_fractional_consumed, n2o_pct);
 
 	if (n2o_level < 0 || ipa_level < 0) {
+		log(LOG_MAIN_DONE, 0);
 		do_exit();
-		state_new(log_review_state);
-		return;
+		return true;
 	}
 
-	chamber_pct = (CHAMBER_EFF * min(n2o_pct, ipa_pct)) / 100;
-	chamber_pct = max(chamber_pct, CHAMBER_MAX_PCT);
-	if (chamber_pct == old_chamber_pct)
-		return;
-	old_chamber_pct = chamber_pct;
-
-	if (loop_time - last_main_log_time > 12) {
-		log(LOG_MAIN_PCT, (unsigned char)chamber_pct);
-		last_main_log_time = loop_time;
+	chamber_pct = physics_chamber_pct_of(physics_pc_pct(ipa_pct, n2o_pct));
+	chamber_pct = min(chamber_pct, CHAMBER_MAX_PCT);
+	if (chamber_pct != old_chamber_pct) {
+		old_chamber_pct = chamber_pct;
+		if (loop_time - last_main_log_time > 12) {
+			log(LOG_MAIN_PCT, (unsigned char)chamber_pct);
+			last_main_log_time = loop_time;
+		}
 	}
 
-	chamber_p = chamber_pct * (MAX_MAIN_PRESSURE - SENSOR_ZERO) / 100 + SENSOR_ZERO;
+	chamber_p = physics_chamber(chamber_pct, fr_sim_ig? sim_ig_output: input_ig_press);
 	dac_set10(DAC_MAIN, chamber_p);
+	return false;
+}
+
+static void i_telem() {
+	int v[TELEM_N];
+
+	v[TELEM_IG_OUTPUT] = sim_ig_output;
+	v[TELEM_CHAMBER_P] = chamber_p;
+	v[TELEM_IPA_SERVO] = ipa_servo.pos >> SERVO_POS_SHIFT;
+	v[TELEM_N2O_SERVO] = n2o_servo.pos >> SERVO_POS_SHIFT;
+	v[TELEM_IPA_LEVEL] = ipa_level;
+	v[TELEM_N2O_LEVEL] = n2o_level;
+	telem_send(sim_time, v);
 }
 
 /*
  * This state handles running the test.
  */
 void running_state(bool first_time) {
+	unsigned char n;
+	unsigned int t;
+
 	if (input_action_button) {
 		do_exit();
 		return;
@@ -340,7 +322,9 @@ void running_state(bool first_time) {
 		ig_pressure_good = false;
 		ig_pressure_has_been_good = false;
 		sim_ig_output = NO_PRESSURE;	// no pressure, but sensor present.
-		sim_ig_next_update = 0;
+		sim_ig_output_target = NO_PRESSURE;
+		ig_good_time = 0;
+		sim_time = 0;
 
 		n2o_level = PROPELLANT_LOAD;
 		ipa_level = PROPELLANT_LOAD;
@@ -348,18 +332,32 @@ void running_state(bool first_time) {
 		ipa_fractional_consumed = 0;
 		n2o_pct = 0;
 		n2o_fractional_consumed = 0;
-		sim_main_next_update = 0;
 		last_main_log_time = 0;
-		servo_slew_init();
+		ipa_servo.vel = 0;	// the servos stay where they were
+		n2o_servo.vel = 0;
 		old_chamber_pct = 0;
 		chamber_p = NO_PRESSURE;
-		sim_ig_increment = 150;	//igniter pressure normally changes rapidly
+		physics_reset();
+		telem_start();
+		tick_start();
 	}
 
-	if (fr_sim_ig)
-		sim_ig();
+	// the trace goes ahead of the telemetry
+	trace_flush();
+
+	// run the physics once for each tick since the last loop
+	n = tick_take();
+	while (n--) {
+		t = servo_tcnt1();
+		sim_time++;
+		if (fr_sim_ig)
+			sim_ig();
+		if (sim_main())
+			return;
+		physics_time((servo_tcnt1() - t) & 0xffff);	// 16-bit wrap
+		if (telem_channels && telem_due())
+			i_telem();
+	}
 
 	monitor_ig();
-
-	sim_main();
 }
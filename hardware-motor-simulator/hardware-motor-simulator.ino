@@ -11,15 +11,23 @@
 #include "state.h"
 #include "menu.h"
 #include "pins.h"
+#include "loop_stats.h"
+#include "stack.h"
 
 /*
  * LCD Stuff
+ * 	Drawing goes to a copy of the screen in RAM; see screen.cpp.
  */
-#include <LiquidCrystal.h>
+#include "screen.h"
 
-// initialize the library by associating any needed LCD interface pin
-// with the arduino pin number it is connected to
-LiquidCrystal lcd(PIN_LCD_RS, PIN_LCD_EN, PIN_LCD_D4, PIN_LCD_D5, PIN_LCD_D6, PIN_LCD_D7);
+extern Screen lcd;
+
+/*
+ * Serial port speed.  The binary log dump (Log Dump on the menu) wants
+ * a fast port.  At 16 MHz, 500000 and 1000000 are exact; 115200 and
+ * below also work, just slower.
+ */
+#define	SERIAL_BAUD	500000
 
 unsigned long loop_time;
 unsigned long loop_counter;
@@ -30,10 +38,12 @@ extern void full_run_init();
 extern void spark_test_init();
 extern void servo_setup();
 extern void dac_setup();
+extern void tick_setup();
 
 void setup() {
-  Serial.begin(9600);
-  /*xxx*/delay(2000);Serial.print("Hello World.\n");
+  stack_paint();
+  Serial.begin(SERIAL_BAUD);
+  /*xxx*/delay(2000);Serial.print(F("Hello World.\n"));
 
   state_init();
   
@@ -44,6 +54,7 @@ void setup() {
   // set up the LCD's number of columns and rows:
   lcd.begin(20, 4);
   loop_counter = 0;
+  loop_stats_reset();
 
   log_init();
   menu_init();
@@ -51,16 +62,25 @@ void setup() {
   output_setup();
   servo_setup();
   dac_setup();
+  tick_setup();
 }
 
 extern void inputs();
 extern void outputs();
 
 void loop() {
+  unsigned long t0, t1, t2, t3;
+
+  t0 = micros();
   loop_time = millis();
   loop_counter++;
  
   inputs();
+  t1 = micros();
   state_machine();
+  t2 = micros();
   outputs();
-}
+  t3 = micros();
+
+  loop_stats(t0, t1, t2, t3);
+}
@@ -5,7 +5,7 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
 #include "menu.h"
@@ -13,7 +13,7 @@
 #include "dac.h"
 #include "pressure.h"
 
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 static unsigned long next_update_time;
 extern unsigned long loop_time;
@@ -25,11 +25,11 @@ void ig_press_test_state(bool first_time) {
 	if (first_time) {
 		lcd.clear();
 		lcd.setCursor(3, 0);
-		lcd.print("Ig Pressure Test");
+		lcd.print(F("Ig Pressure Test"));
 		lcd.setCursor(0, 2);
-		lcd.print("   Raw Value:");
+		lcd.print(F("   Raw Value:"));
 		lcd.setCursor(0, 3);
-		lcd.print("Scaled Value:");
+		lcd.print(F("Scaled Value:"));
 		next_update_time = 0;
 	}
 	
@@ -65,6 +65,6 @@ void ig_press_test_state(bool first_time) {
 		lcd.setCursor(14, 3);
 		lcd.print(c);
 	} else {
-		lcd.print("N/C");
+		lcd.print(F("N/C"));
 	}
 }
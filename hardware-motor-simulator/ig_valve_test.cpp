@@ -6,12 +6,12 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
 #include "menu.h"
 
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 static unsigned long next_update_time;
 extern unsigned long loop_time;
@@ -21,11 +21,11 @@ void ig_valve_test_state(bool first_time) {
 	if (first_time) {
 		lcd.clear();
 		lcd.setCursor(3, 0);
-		lcd.print("Ig Valve Test");
+		lcd.print(F("Ig Valve Test"));
 		lcd.setCursor(0, 2);
-		lcd.print("IPA Valve:");
+		lcd.print(F("IPA Valve:"));
 		lcd.setCursor(0, 3);
-		lcd.print("N2O Valve:");
+		lcd.print(F("N2O Valve:"));
 		next_update_time = 0;
 	}
 	
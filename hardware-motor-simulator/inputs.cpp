@@ -14,6 +14,12 @@
  *
  *	For now the solenoids are not debounced.  Event logging code
  *	Will have to deal with this fact.  Or maybe the relays don't bounce.
+ *	Their edges are captured by the pin change interrupt rather than
+ *	polled, so they are timed to the microsecond.
+ *
+ * The analog inputs are sampled in the background by adc.cpp, so
+ * 	reading them here does not wait for the ADC.  Channels that
+ * 	the current state has turned off keep their old values.
  *
  * The two analog inputs are raw 10-bit values.
  *	These values are not filtered, we do add some simple hysteresis.
@@ -28,6 +34,7 @@
  * NOTE:
  * 	Input status changes are logged here.  Whether they really go in the
  * 	log is a function of the global boolean log_enabled
+ * 	They go in the input trace too, if trace_enabled (see trace.cpp).
  *
  * NOTE:
  * 	Various thresholds are hard coded into the input routines.
@@ -41,6 +48,10 @@
 #include "io_ref.h"
 #include "pins.h"
 #include "log.h"
+#include "adc.h"
+#include "valve_edge.h"
+#include "timing.h"
+#include "trace.h"
 
 extern unsigned long loop_time;
 
@@ -79,6 +90,10 @@ static bool ig_valve_n2o_old_state;
 // Pressor sensor variables
 // (none needed)
 
+// Spark sense variables
+static unsigned char spark_count;	// last ADC sample looked at
+static bool spark_in;			// that sample was in the spark band
+
 const static unsigned long debounce_time = 10;	// milliseconds
 const static int hysteresis = 10;		// counts
 
@@ -87,6 +102,8 @@ static void i_action_button() {
 
 	// v is true if the button is pressed
 	v = (digitalRead(PIN_ACTION) == 0);
+	if (v != action_button_old_state)
+		trace_input(TRACE_ACTION, micros(), v);
 	
 	// Rising edge?
 	if (v && !action_button_old_state) {
@@ -110,8 +127,11 @@ static void i_scroll_switch() {
 	int t;
 	unsigned char v;
 
+	if (!adc_enabled(ADC_SCROLL))
+		return;
+
 	// v is true if switch pressed either way
-	t = analogRead(PIN_SCROLL);
+	t = adc_read(ADC_SCROLL);
 	if (t < 10)
 		v = 1;
 	else if (t > 1000)
@@ -139,35 +159,50 @@ static void i_scroll_switch() {
 	scroll_old_state = v;
 }
 
-static void i_ig_valve_ipa() {
+/*
+ * Igniter valve edges come from the pin change interrupt, timed to the
+ * microsecond (see valve_edge.cpp), and are logged with that time.
+ */
+static void i_ig_valve_edge(unsigned char v, unsigned long t) {
+	bool ipa, n2o;
 
-	// true if the solenoid is actuated
-	input_ig_valve_ipa_level = (digitalRead(PIN_IG_IPA) == 1);
+	ipa = (v & VALVE_IPA) != 0;
+	n2o = (v & VALVE_N2O) != 0;
 
-	if (input_ig_valve_ipa_level  && !ig_valve_ipa_old_state) {
+	if (ipa && !ig_valve_ipa_old_state) {
 		input_ig_valve_ipa = true;
-		log(LOG_IG_IPA_OPEN, 0);
+		log_edge(LOG_IG_IPA_OPEN, t);
+		timing_mark(TM_IG_IPA, t);
 	}
+	if (!ipa && ig_valve_ipa_old_state)
+		log_edge(LOG_IG_IPA_CLOSE, t);
 
-	if (!input_ig_valve_ipa_level  && ig_valve_ipa_old_state)
-		log(LOG_IG_IPA_CLOSE, 0);
+	if (n2o && !ig_valve_n2o_old_state) {
+		input_ig_valve_n2o = true;
+		log_edge(LOG_IG_N2O_OPEN, t);
+		timing_mark(TM_IG_N2O, t);
+	}
+	if (!n2o && ig_valve_n2o_old_state)
+		log_edge(LOG_IG_N2O_CLOSE, t);
 
-	ig_valve_ipa_old_state = input_ig_valve_ipa_level;
+	if (ipa != ig_valve_ipa_old_state || n2o != ig_valve_n2o_old_state)
+		trace_input(TRACE_IG_VALVES, t, v);
+	ig_valve_ipa_old_state = ipa;
+	ig_valve_n2o_old_state = n2o;
 }
 
-static void i_ig_valve_n2o() {
-	// true if the solenoid is actuated
-	input_ig_valve_n2o_level = (digitalRead(PIN_IG_N2O) == 1);
+static void i_ig_valves() {
+	struct valve_edge_s e;
 
-	if (input_ig_valve_n2o_level && !ig_valve_n2o_old_state) {
-		input_ig_valve_n2o = true;
-		log(LOG_IG_N2O_OPEN, 0);
-	}
+	while (valve_edge_take(&e))
+		i_ig_valve_edge(e.levels, e.time);
 
-	if (!input_ig_valve_n2o_level  && ig_valve_n2o_old_state)
-		log(LOG_IG_N2O_CLOSE, 0);
+	// if the FIFO overflowed, the pins have the last word
+	if (valve_edge_lost())
+		i_ig_valve_edge(valve_edge_levels(), micros());
 
-	ig_valve_n2o_old_state = input_ig_valve_n2o_level;
+	input_ig_valve_ipa_level = ig_valve_ipa_old_state;
+	input_ig_valve_n2o_level = ig_valve_n2o_old_state;
 }
 
 // the main pressure sensor isn't really in input.
@@ -175,7 +210,10 @@ static void i_ig_valve_n2o() {
 static void i_main_press() {
 	int v, t;
 
-	v = analogRead(PIN_MAIN_PRESS);
+	if (!adc_enabled(ADC_MAIN_PRESS))
+		return;
+
+	v = adc_read(ADC_MAIN_PRESS);
 	t = v - input_main_press;
 	if (t >= hysteresis || t <= -hysteresis) {
 		input_main_press = v;
@@ -185,24 +223,66 @@ static void i_main_press() {
 }
 
 static void i_ig_press() {
+	struct adc_sample_s s;
 	int v, t;
 
-	v = analogRead(PIN_IG_PRESS);
+	if (!adc_enabled(ADC_IG_PRESS))
+		return;
+
+	// adc_read(), but keep the sample's time for the trace
+	while (!adc_sample(ADC_IG_PRESS, adc_count(ADC_IG_PRESS), &s))
+		;
+	v = s.value;
 	t = v - input_ig_press;
 	if (t >= hysteresis || t <= -hysteresis) {
 		input_ig_press = v;
 		log(LOG_IG_PRESSURE_CHANGE, 0xff & (v >> 2));
+		trace_input(TRACE_IG_PRESS, s.time, v);
 	}
 }
 
+/*
+ * The spark is sampled several times per loop.  It counts as present
+ * if any of the samples since the last loop saw it.
+ */
 static void i_spark_sense() {
-	bool b;
-
-	input_spark_sense_A = analogRead(PIN_SPARK);
-	b = (input_spark_sense_A > 100 && input_spark_sense_A < 900);
+	struct adc_sample_s s;
+	unsigned long t;
+	unsigned char n;
+	bool b, in;
+
+	if (!adc_enabled(ADC_SPARK))
+		return;
+
+	n = adc_count(ADC_SPARK);
+	if (n == spark_count)
+		return;		// nothing new
+	if ((unsigned char)(n - spark_count) > ADC_RING)
+		spark_count = n - ADC_RING;
+
+	b = false;
+	while (spark_count != n) {
+		spark_count++;
+		if (!adc_sample(ADC_SPARK, spark_count, &s))
+			continue;
+		input_spark_sense_A = s.value;
+		in = s.value > 100 && s.value < 900;
+		if (in) {
+			if (!b)
+				t = s.time;
+			b = true;
+		}
+		// the trace only needs the samples that cross the band
+		if (in != spark_in) {
+			spark_in = in;
+			trace_input(TRACE_SPARK, s.time, s.value);
+		}
+	}
 
-	if (b && !input_spark_sense)
+	if (b && !input_spark_sense) {
 		log(LOG_SPARK_FIRST, 0);
+		timing_mark(TM_SPARK, t);
+	}
 	else if (!b && input_spark_sense)
 		log(LOG_SPARK_LAST, 0);
 
@@ -236,13 +316,21 @@ void input_setup() {
 	pinMode(PIN_SPARK, INPUT);
 	input_spark_sense = 0;
 	input_spark_sense_A = 0;
+	spark_in = false;
+
+	// a valve already open counts as an edge, as if we had polled it
+	valve_edge_setup();
+	if (valve_edge_levels())
+		i_ig_valve_edge(valve_edge_levels(), micros());
+
+	adc_setup();
+	spark_count = adc_count(ADC_SPARK);
 }
 
 void inputs() {
 	i_action_button();
 	i_scroll_switch();
-	i_ig_valve_ipa();
-	i_ig_valve_n2o();
+	i_ig_valves();
 	i_main_press();
 	i_ig_press();
 	i_spark_sense();
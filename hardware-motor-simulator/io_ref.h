@@ -13,8 +13,8 @@ extern int  input_spark_sense_A;	// analog value.  Used only in test routines.
 // These are the analog input values
 extern int  input_main_press;
 extern int  input_ig_press;
-extern volatile int input_ipa_servo;		// pulse width in microseconds.  disable interrupt to read
-extern volatile int input_n2o_servo;		// pulse width in microseconds.  disable interrupt to read
+extern int input_ipa_servo;		// pulse width in microseconds, as of the last servo_read_ipa()
+extern int input_n2o_servo;		// pulse width in microseconds, as of the last servo_read_n2o()
 
 // The sole output
 extern unsigned char output_led;
@@ -26,5 +26,5 @@ extern unsigned char output_led;
 #define	LED_BLINKING	3
 #define	LED_CONTINUE	4	// internal state, never set to this.
 
-extern unsigned char servo_read_n2o();	// returns -1, -2 or servo angle in degrees.
-extern unsigned char servo_read_ipa();	// returns -1, -2 or servo angle in degrees.
+extern int servo_read_n2o();	// returns -1, -2 or servo angle in degrees.
+extern int servo_read_ipa();	// returns -1, -2 or servo angle in degrees.
@@ -2,15 +2,17 @@
  *  This module manages the log
  *
  *  The log resides in eeprom and in main memory.
- *  On initialization valid log entries in eeprom
- *  are read into main memory.
+ *  On initialization a valid log in eeprom
+ *  is read into main memory.
  *
  *  The log is written to eeprom using log_commit()
  *
- *  Each log entry is 4 bytes.  See log.h for details.
+ *  The log is a byte stream of variable length entries.  See log.h
+ *  for the format.  log_get() decodes entries.
  *  In addition to reading and writing the log,
  *  This code also converts log entries into strings
- *  for display on LCD and printing on serial port.
+ *  for display on LCD and printing on serial port,
+ *  and sends the log as binary frames (log_dump()).
  */
 
 #include "log.h"
@@ -18,98 +20,353 @@
 #include "ee.h"
 #include "EEPROM.h"
 #include "buffer.h"
+#include "frame.h"
 #include "Arduino.h"
 
 bool log_enabled;
 
 extern unsigned long loop_time;
 extern unsigned long loop_counter;
-static unsigned long log_base_time;
-static int n_log_entries;
-struct log_entry_s log_in_memory[LOG_SIZE];	// the in-memory copy of the log
-static unsigned int log_sequence_number;
+static unsigned long log_start_time;	// loop_time of LOG_START
+static unsigned long log_last_time;	// loop_time of the newest entry
+static unsigned long log_start_us;	// micros() of LOG_START, for edges
+static int log_length;			// bytes in use
+static unsigned char n_log_entries;
+unsigned char log_in_memory[LOG_BYTES];	// the in-memory copy of the log
+static uint16_t log_sequence_number;	// wraps at 16 bits, as stored
 static unsigned char log_sequence_increment;
 
+/*
+ * Background commit
+ *
+ * Writing an EEPROM byte takes 3.3 ms, so writing the whole log inline
+ * would freeze the unit for over a second.  Instead log_commit() sets up
+ * the list of bytes to write and the EE_READY interrupt writes them one
+ * at a time while the loop carries on.
+ *
+ * Each byte is read first and only written if it differs (update
+ * semantics), so a log that mostly matches the last one costs little
+ * time and little wear.  A few unchanged bytes are skipped per interrupt.
+ *
+ * The order is the same as always, so a commit cut short by a power
+ * loss leaves an invalid log rather than a wrong one:
+ * 	invalidate the check byte, if it would pass for the new length
+ * 	length and format
+ * 	the log bytes
+ * 	the check byte
+ * 	the sequence number
+ */
+#define	COMMIT_INVALIDATE	0
+#define	COMMIT_LENGTH_LO	1
+#define	COMMIT_LENGTH_HI	2
+#define	COMMIT_FORMAT		3
+#define	COMMIT_DATA		4
+#define	COMMIT_CHECK		5
+#define	COMMIT_SEQ0		6
+#define	COMMIT_SEQ1		7
+#define	COMMIT_DONE		8
+
+#define	COMMIT_SCAN		16	// unchanged bytes skipped per interrupt
+
+static volatile unsigned char commit_step;
+static int commit_pos;			// in the log bytes
+static int commit_length;
+
+/*
+ * Decoder position: the entry that starts at offset pos, and the time
+ * of the entry before it.  Reading the log in order, as everything
+ * does, costs one entry per call.
+ *
+ * For random access there is an index with the decoder position at
+ * every LOG_INDEX_STEP'th entry, kept up as entries are added.  Getting
+ * to any entry from its index point decodes fewer than LOG_INDEX_STEP
+ * entries, however long the log is.
+ */
+struct log_cursor_s {
+	int pos;
+	unsigned long time;	// time of the entry before
+};
+
+#define	LOG_INDEX_STEP	16
+#define	LOG_INDEX_LEN	((LOG_BYTES / 2 + LOG_INDEX_STEP - 1) / LOG_INDEX_STEP)
+
+static struct log_cursor_s log_index[LOG_INDEX_LEN];
+static unsigned char cursor_entry;
+static int cursor_pos;
+static unsigned long cursor_time;
+
+static void i_cursor_set(unsigned char entry) {
+	cursor_entry = entry - entry % LOG_INDEX_STEP;
+	cursor_pos = log_index[cursor_entry / LOG_INDEX_STEP].pos;
+	cursor_time = log_index[cursor_entry / LOG_INDEX_STEP].time;
+}
+
+static void i_cursor_reset() {
+	log_index[0].pos = 0;
+	log_index[0].time = 0;
+	i_cursor_set(0);
+}
+
+/*
+ * Entry number entry starts at pos.  Call for every entry, in order.
+ */
+static void i_index(unsigned char entry, int pos, unsigned long time) {
+	if (entry % LOG_INDEX_STEP)
+		return;
+	log_index[entry / LOG_INDEX_STEP].pos = pos;
+	log_index[entry / LOG_INDEX_STEP].time = time;
+}
+
+/*
+ * Decode the entry at cursor_pos into e, and move the cursor past it.
+ */
+static void i_decode(struct log_entry_s *e) {
+	unsigned char op, b, shift;
+	unsigned long dt;
+
+	op = log_in_memory[cursor_pos++];
+	dt = 0;
+	shift = 0;
+	do {
+		b = log_in_memory[cursor_pos++];
+		dt |= (unsigned long)(b & 0x7f) << shift;
+		shift += 7;
+	} while ((b & 0x80) && shift < 35);
+	cursor_time += dt;
+
+	e->log_op = op & ~LOG_HAS_PARAM;
+	e->log_param = (op & LOG_HAS_PARAM)? log_in_memory[cursor_pos++]: 0;
+	e->time = cursor_time;
+	cursor_entry++;
+}
+
+unsigned char log_n_entries() {
+	return n_log_entries;
+}
+
+/*
+ * Decode entry number entry.  Returns false if there is no such entry.
+ */
+bool log_get(unsigned char entry, struct log_entry_s *e) {
+	if (entry >= n_log_entries)
+		return false;
+	if (entry < cursor_entry || entry - cursor_entry >= LOG_INDEX_STEP)
+		i_cursor_set(entry);
+	while (cursor_entry <= entry)
+		i_decode(e);
+	return true;
+}
+
+/*
+ * Count the entries in the log, and check that they fit exactly.
+ * Returns false if the log doesn't make sense.
+ */
+static bool i_count_entries() {
+	struct log_entry_s e;
+
+	i_cursor_reset();
+	n_log_entries = 0;
+	while (cursor_pos < log_length) {
+		if (cursor_entry == 0xff)
+			return false;
+		i_index(cursor_entry, cursor_pos, cursor_time);
+		i_decode(&e);
+	}
+	if (cursor_pos != log_length)
+		return false;
+	n_log_entries = cursor_entry;
+	i_cursor_set(0);
+	return true;
+}
+
 /*
  * Read the log from EEPROM, if EEPROM is available
  */
 void log_init() {
-	int cb2;
 	int i;
 	int p;
 
 	log_enabled = false;
+	commit_step = COMMIT_DONE;
 
 	log_sequence_number = EEPROM.read(LOG_SEQ0);
 	log_sequence_number |= ((unsigned int)(EEPROM.read(LOG_SEQ1)) << 8);
 	log_sequence_increment = 1;
 
-	n_log_entries = EEPROM.read(LOG_CHECK_BYTE_1);
-	cb2 = EEPROM.read(LOG_CHECK_BYTE_2);
+	log_length = EEPROM.read(LOG_CHECK_BYTE_1);
+	log_length |= EEPROM.read(LOG_LENGTH_HI) << 8;
+	n_log_entries = 0;
+	i_cursor_reset();
 
 	// check if log in eeprom is valid.
-	if (n_log_entries + cb2 != LOG_SIZE ||
-	    n_log_entries <= 0 ||
-	    n_log_entries >= LOG_SIZE) {
-		n_log_entries = 0;
+	if (EEPROM.read(LOG_FORMAT) != LOG_FORMAT_VARINT ||
+	    EEPROM.read(LOG_CHECK_BYTE_2) != LOG_CHECK(log_length) ||
+	    log_length <= 0 ||
+	    log_length > LOG_BYTES) {
+		log_length = 0;
 		return;
 	}
 
 	p = LOG_BASE;
-	for (i = 0; i < n_log_entries; i++) {
-		log_in_memory[i].log_op = EEPROM.read(p++);
-		log_in_memory[i].log_param = EEPROM.read(p++);
-		log_in_memory[i].timestamp = EEPROM.read(p++);
-		log_in_memory[i].timestamp |= (EEPROM.read(p++) << 8);
+	for (i = 0; i < log_length; i++)
+		log_in_memory[i] = EEPROM.read(p++);
+
+	if (!i_count_entries()) {
+		log_length = 0;
+		n_log_entries = 0;
 	}
 }
 
-void log_commit() {
-	int cb2;
-	int i;
-	int p;
+/*
+ * Address and value of the next byte to commit.
+ * Returns false when there are no more.
+ */
+static bool i_commit_next(int *addr, unsigned char *val) {
+	for (;;) {
+		switch (commit_step) {
+		case COMMIT_INVALIDATE:
+			*addr = LOG_CHECK_BYTE_2;
+			*val = LOG_CHECK(commit_length) ^ 0xff;
+			commit_step++;
+			EEAR = LOG_CHECK_BYTE_2;
+			EECR |= _BV(EERE);
+			if (EEDR == LOG_CHECK(commit_length))
+				return true;
+			break;		// already invalid
+		case COMMIT_LENGTH_LO:
+			*addr = LOG_CHECK_BYTE_1;
+			*val = commit_length & 0xff;
+			commit_step++;
+			return true;
+		case COMMIT_LENGTH_HI:
+			*addr = LOG_LENGTH_HI;
+			*val = commit_length >> 8;
+			commit_step++;
+			return true;
+		case COMMIT_FORMAT:
+			*addr = LOG_FORMAT;
+			*val = LOG_FORMAT_VARINT;
+			commit_step++;
+			commit_pos = 0;
+			return true;
+		case COMMIT_DATA:
+			if (commit_pos < commit_length) {
+				*addr = LOG_BASE + commit_pos;
+				*val = log_in_memory[commit_pos++];
+				return true;
+			}
+			commit_step++;
+			break;
+		case COMMIT_CHECK:
+			*addr = LOG_CHECK_BYTE_2;
+			*val = LOG_CHECK(commit_length);
+			commit_step++;
+			return true;
+		case COMMIT_SEQ0:
+			*addr = LOG_SEQ0;
+			*val = 0xff & log_sequence_number;
+			commit_step++;
+			return true;
+		case COMMIT_SEQ1:
+			*addr = LOG_SEQ1;
+			*val = 0xff & (log_sequence_number >> 8);
+			commit_step++;
+			return true;
+		default:
+			return false;
+		}
+	}
+}
 
+/*
+ * Called when the EEPROM is ready for another write.
+ */
+ISR(EE_READY_vect) {
+	unsigned char i, val;
+	int addr;
+
+	for (i = 0; i < COMMIT_SCAN; i++) {
+		if (!i_commit_next(&addr, &val)) {
+			EECR &= ~_BV(EERIE);
+			return;
+		}
+		EEAR = addr;
+		EECR |= _BV(EERE);
+		if (EEDR == val)
+			continue;
+		EEDR = val;
+		EECR |= _BV(EEMPE);
+		EECR |= _BV(EEPE);
+		return;
+	}
+	// all unchanged so far.  The interrupt comes right back.
+}
+
+/*
+ * Start writing the log to EEPROM.  Returns at once; the writing
+ * happens in the background.
+ */
+void log_commit() {
 	// If the in-memory log is empty, don't disturb the EEPROM version.
-	if (n_log_entries == 0)
+	if (log_length == 0)
 		return;
 
-	// make the log invalid
-	cb2 = EEPROM.read(LOG_CHECK_BYTE_2);
-	if (cb2 + n_log_entries == LOG_SIZE)
-		EEPROM.write(LOG_CHECK_BYTE_2, LOG_SIZE + 1);
+	log_commit_wait();
+	commit_length = log_length;
+	commit_step = COMMIT_INVALIDATE;
+	log_sequence_increment = 1;
+	EECR |= _BV(EERIE);
+}
 
-	EEPROM.write(LOG_CHECK_BYTE_1, n_log_entries);
-	p = LOG_BASE;
-	for (i = 0; i < n_log_entries; i++) {
-		EEPROM.write(p++, log_in_memory[i].log_op);
-		EEPROM.write(p++, log_in_memory[i].log_param);
-		EEPROM.write(p++, (log_in_memory[i].timestamp) & 0xff);
-		EEPROM.write(p++, (log_in_memory[i].timestamp >> 8) & 0xff);
-	}
-	EEPROM.write(LOG_CHECK_BYTE_2, LOG_SIZE - n_log_entries);
+bool log_commit_busy() {
+	return commit_step != COMMIT_DONE;
+}
 
-	EEPROM.write(LOG_SEQ0, 0xff & log_sequence_number);
-	EEPROM.write(LOG_SEQ1, 0xff & (log_sequence_number >> 8));
-	log_sequence_increment = 1;
+/*
+ * Wait for a commit to finish.  Anything that changes the
+ * in-memory log must call this first.
+ */
+void log_commit_wait() {
+	while (log_commit_busy())
+		delayMicroseconds(10);
 }
 
 /*
  * Erase the in-memory log
  */
 void log_reset() {
+	log_commit_wait();
+	log_length = 0;
 	n_log_entries = 0;
+	i_cursor_reset();
 	log_sequence_number += log_sequence_increment;
 	log_sequence_increment = 0;
 }
 
-static void i_log(unsigned char op, unsigned char param)  {
-	log_in_memory[n_log_entries].log_op = op;
-	log_in_memory[n_log_entries].log_param = param;
-	log_in_memory[n_log_entries].timestamp = loop_time - log_base_time;
+/*
+ * Append an entry.  The caller has checked that LOG_MAX_ENTRY bytes fit.
+ */
+static void i_log(unsigned char op, unsigned char param, unsigned long dt)  {
+	i_index(n_log_entries, log_length, log_last_time - log_start_time);
+	if (param)
+		op |= LOG_HAS_PARAM;
+	log_in_memory[log_length++] = op;
+	while (dt >= 0x80) {
+		log_in_memory[log_length++] = 0x80 | (dt & 0x7f);
+		dt >>= 7;
+	}
+	log_in_memory[log_length++] = dt;
+	if (param)
+		log_in_memory[log_length++] = param;
 	n_log_entries++;
 }
 
-void log(unsigned char op, unsigned char param) {
+/*
+ * Log an event that happened at time t (milliseconds).  t may be a
+ * little before loop_time; it is logged as no earlier than the
+ * previous entry.
+ */
+static void i_log_at(unsigned char op, unsigned char param, unsigned long t) {
 	int max;
 
 	if (!log_enabled)
@@ -117,34 +374,64 @@ void log(unsigned char op, unsigned char param) {
 
 	switch(LOG_LEVEL(op)) {
 		case LOG_CRITICAL:
-			max = LOG_SIZE;
+			max = LOG_BYTES;
 			break;
 		case LOG_NORMAL:
 			max = LOG_MAX_NORMAL;
 			break;
 		default:
 			max = LOG_MAX_DETAIL;
-			if (n_log_entries == 0)
+			if (log_length == 0)
 				return;		// don't clutter before things start
 			break;
 	}
 
-	if (n_log_entries >= max)
+	if (log_length + LOG_MAX_ENTRY > max)
 		return;
-	
-	if (n_log_entries == 0) {
-		log_base_time = loop_time;
+
+	if (log_length == 0) {
+		log_start_time = t;
+		log_last_time = t;
+		log_start_us = micros();
 		loop_counter = 0;
-		i_log(LOG_START, 0);
+		i_log(LOG_START, 0, 0);
+		// LOG_START must not eat the last critical slot
+		if (log_length + LOG_MAX_ENTRY > max)
+			return;
 	}
 
-	// process time stamp rollover
-	while (loop_time - log_base_time > LOG_ROLLOVER_TIME) {
-		if (n_log_entries < LOG_SIZE - 1)
-			i_log(LOG_TIME_ROLLOVER, 0);
-		log_base_time += LOG_ROLLOVER_TIME;
+	if ((long)(t - log_last_time) < 0)
+		t = log_last_time;
+	i_log(op, param, t - log_last_time);
+	log_last_time = t;
+}
+
+void log(unsigned char op, unsigned char param) {
+	i_log_at(op, param, loop_time);
+}
+
+/*
+ * Log an edge timed in microseconds.  The edge is placed by its micros()
+ * time since LOG_START, e; the timestamp gets the whole milliseconds of
+ * e, and the parameter the rest in LOG_EDGE_US units.  The subtraction
+ * is unsigned, so the micros() wrap does no harm.  An edge that starts
+ * the log is LOG_START's time itself.
+ *
+ * The other entries are timed by loop_time, whose millisecond started
+ * at some unknown point before LOG_START's micros(), so edges can be up
+ * to a millisecond off from them; between edges the times are good to
+ * a few microseconds.
+ */
+void log_edge(unsigned char op, unsigned long us) {
+	unsigned long e;
+
+	if (log_length == 0) {
+		i_log_at(op, 0, loop_time);
+		log_start_us = us;
+		return;
 	}
-	i_log(op, param);
+	e = us - log_start_us;
+	i_log_at(op, (e % 1000) / LOG_EDGE_US, log_start_time + e / 1000);
 }
 
 /*
@@ -177,41 +464,37 @@ char *log_tos_seqn() {
 	return buffer;
 }
 
+unsigned int log_seqn() {
+	return log_sequence_number;
+}
+
 /*
- * Put the timestamp into the long string
+ * Copy the short name of op code op (without the level) to p.
  */
-static unsigned char i_log_tos(unsigned char entry) {
-	unsigned char bias;
-	unsigned char i;
+void log_op_short(unsigned char op, char *p) {
+	strcpy_P(p, (char*)pgm_read_word(&(op_codes_short[op])));
+}
 
+/*
+ * Decode an entry into e and clear the string.
+ */
+static unsigned char i_log_tos(unsigned char entry, struct log_entry_s *e) {
 	buffer_zip();
-	if (entry >= n_log_entries) {
+	if (!log_get(entry, e)) {
 		buffer[0] = '\0';
 		return 1;
 	}
-
-	bias = 0;
-	for (i = 0; i < entry; i++)
-		if (log_in_memory[i].log_op == LOG_TIME_ROLLOVER)
-			bias++;
-
-	if (bias > 9)
-		buffer[0] = '*';
-	else if (bias)
-		buffer[0] = '0' + bias;
-	buffer_print_n_i(1, log_in_memory[entry].timestamp + (bias? 10000: 0));
-
 	return 0;
 }
 
 /*
  * NOTE: DOES NOT NULL TERMINATE
  */
-static void i_opcode_print(const char * const table[], unsigned char op) {
+static void i_opcode_print(const char * const table[], unsigned char op, unsigned char col) {
 	char *p;
 
 	// Necessary casts and dereferencing, just copy.
-	p = buffer + 6;
+	p = buffer + col;
 	strcpy_P(p, (char*)pgm_read_word(&(table[op])));
 	while (*p)
 		p++;
@@ -222,47 +505,109 @@ static void i_opcode_print(const char * const table[], unsigned char op) {
  * Return a log entry as a printable string, exactly 20 characters long
  * Format:
  *  nnnnn_ssssssssss_ppp
- * Where nnnnn is the time stamp
+ * Where nnnnn is the time stamp: milliseconds up to 99999,
+ *             then seconds, as in "1234s"
  *       ssssssssss is the opcode as a sting
  *       ppp is the parameter
  */
 char *log_tos_short(unsigned char entry) {
-	unsigned char p;
+	struct log_entry_s e;
 
-	if (i_log_tos(entry))
+	if (i_log_tos(entry, &e))
 		return buffer;
 	buffer[20] = '\0';
 
-	i_opcode_print(op_codes_short, (log_in_memory[entry].log_op) & ~LOG_LEVEL_MASK);
+	if (e.time < 100000)
+		buffer_print_n_l(0, 5, e.time);
+	else {
+		buffer_print_n_l(0, 4, e.time / 1000);
+		buffer[4] = 's';
+	}
+
+	i_opcode_print(op_codes_short, e.log_op & ~LOG_LEVEL_MASK, 6);
 
-	p = log_in_memory[entry].log_param;
-/*xxx*/Serial.print("op = "); Serial.print((int)(log_in_memory[entry].log_op)); Serial.print(" p = ");Serial.print((int)(p)); Serial.print("\n");
-	if (p)
-		buffer_print_n_c(17, p);
+	if (e.log_param)
+		buffer_print_n_c(17, e.log_param);
 
 	return buffer;
 }
 
 /*
- * Return a log entry as a printable string, exactly 30 characters long
+ * Return a log entry as a printable string, exactly 33 characters long
  * Format:
- *  nnnnn_ssssssssss_ppp
- * Where nnnnn is the time stamp
+ *  nnnnnnnn_ssssssssssssssssssss_ppp
+ * Where nnnnnnnn is the time stamp in milliseconds
  *       ssssssssssssssssssss is the opcode as a sting
  *       ppp is the parameter
  */
 char *log_tos_long(unsigned char entry) {
-	unsigned char p;
+	struct log_entry_s e;
 
-	if (i_log_tos(entry))
+	if (i_log_tos(entry, &e))
 		return buffer;
-	buffer[30] = '\0';
+	buffer[33] = '\0';
+
+	buffer_print_n_l(0, 8, e.time);
 
-	i_opcode_print(op_codes_long, (log_in_memory[entry].log_op) & ~LOG_LEVEL_MASK);
+	i_opcode_print(op_codes_long, e.log_op & ~LOG_LEVEL_MASK, 9);
 
-	p = log_in_memory[entry].log_param;
-	if (p)
-		buffer_print_n_c(27, p);
+	if (e.log_param)
+		buffer_print_n_c(30, e.log_param);
 
 	return buffer;
 }
+
+/*
+ * Binary dump, one frame per call so the loop keeps running:
+ * 	frame 0			FRAME_LOG_HEAD
+ * 	then			FRAME_LOG_DATA, the in-memory log bytes
+ * 	then			FRAME_EEPROM, all of EEPROM
+ * 	last			FRAME_END
+ * Send frame number n.  Returns false once they have all gone.
+ * Any commit must be finished first; see log_commit_wait().
+ */
+bool log_dump(int n) {
+	unsigned char f[2 + FRAME_DATA];
+	int i, off, len;
+
+	if (n == 0) {
+		frame_sync();
+		f[0] = log_sequence_number;
+		f[1] = log_sequence_number >> 8;
+		f[2] = log_length;
+		f[3] = log_length >> 8;
+		f[4] = LOG_FORMAT_VARINT;
+		f[5] = n_log_entries;
+		frame_send(FRAME_LOG_HEAD, f, 6);
+		return true;
+	}
+
+	off = (n - 1) * FRAME_DATA;
+	if (off < log_length) {
+		len = min(log_length - off, FRAME_DATA);
+		f[0] = off;
+		f[1] = off >> 8;
+		for (i = 0; i < len; i++)
+			f[2 + i] = log_in_memory[off + i];
+		frame_send(FRAME_LOG_DATA, f, 2 + len);
+		return true;
+	}
+
+	off -= (log_length + FRAME_DATA - 1) / FRAME_DATA * FRAME_DATA;
+	if (off <= E2END) {
+		f[0] = off;
+		f[1] = off >> 8;
+		for (i = 0; i < FRAME_DATA; i++)
+			f[2 + i] = EEPROM.read(off + i);
+		frame_send(FRAME_EEPROM, f, 2 + FRAME_DATA);
+		return true;
+	}
+
+	if (off == E2END + 1) {
+		f[0] = n;
+		f[1] = n >> 8;
+		frame_send(FRAME_END, f, 2);
+		return true;
+	}
+	return false;
+}
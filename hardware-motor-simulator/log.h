@@ -3,21 +3,37 @@
  */
 
 /*
- * NOTE: code assume that LOG_SIZE+1 fits in an 8-bit integer
+ * The log is a stream of bytes.  Each entry is:
+ * 	op code byte, LOG_HAS_PARAM set if a parameter follows
+ * 	time since the previous entry in milliseconds, as a varint:
+ * 		7 bits per byte, least significant first, the high bit
+ * 		set on every byte but the last
+ * 	the parameter byte, if any
+ * Most entries are 2 or 3 bytes, so LOG_BYTES holds about three times
+ * as many entries as it did at 4 bytes apiece.
+ *
+ * Space is reserved for the important entries: normal entries stop
+ * going in at LOG_MAX_NORMAL bytes, and detail entries at LOG_MAX_DETAIL.
+ *
+ * NOTE: code assumes the number of entries fits in an 8-bit integer.
+ * An entry is at least 2 bytes, so LOG_BYTES must be under 512.
  */
-#define	LOG_SIZE	100	// no more than 200 entries are stored
-#define	LOG_MAX_NORMAL	LOG_SIZE - 20
-#define	LOG_MAX_DETAIL	LOG_MAX_NORMAL - 20
+#define	LOG_BYTES	400
+#define	LOG_MAX_NORMAL	(LOG_BYTES - 80)
+#define	LOG_MAX_DETAIL	(LOG_MAX_NORMAL - 80)
+#define	LOG_MAX_ENTRY	7	// op code, 5 byte varint, parameter
 
-// Log time is managed to ensure that timestamps can always fit in 16 bits
-#define	LOG_ROLLOVER_TIME	10000	// after this many milliseconds, rebase.
+#define	LOG_HAS_PARAM	0x20	// in the stored op code byte
 
 extern bool log_enabled;	// set for full runs, clear for tests and such
 
+/*
+ * A decoded log entry
+ */
 struct log_entry_s {
 	unsigned char log_op;		// see various #defines
 	unsigned char log_param;	// some op codes take a numeric parameter
-	unsigned int timestamp;	// Time when the logged event happened.
+	unsigned long time;		// milliseconds since the log started
 };
 
 /*
@@ -25,7 +41,9 @@ struct log_entry_s {
  *
  * The first log entry always happens at time t=0.
  * All other log events happen at some number of milliseconds since t=0.
- * If the log runs more than 65 seconds, a log rollover event is recorded.
+ * Times only go forward: an event logged with a time before the previous
+ * entry gets the previous entry's time.
+ * Any entry's time can be had in constant time; see log_get().
  */
 
 /*
@@ -45,7 +63,7 @@ struct log_entry_s {
 
 /*
  * Log Op Codes
- * 	NOTE: Codes must be consecutive integers
+ * 	NOTE: Codes must be consecutive integers, less than 32
  * These are the events that can be logged.
  */
 
@@ -63,7 +81,14 @@ struct log_entry_s {
 #define	LOG_MAIN_IPA_CHANGE	(11 | LOG_CRITICAL)
 #define	LOG_MAIN_DONE		(12 | LOG_CRITICAL)	// out of fuel, simulation done
 #define	LOG_MAIN_PCT		(13 | LOG_NORMAL)	// pct of full chamber pressure
-#define	LOG_TIME_ROLLOVER	(14 | LOG_CRITICAL)
+#define	LOG_TIME_ROLLOVER	(14 | LOG_CRITICAL)	// old 4 byte format only; no longer logged
+
+/*
+ * The igniter valve open and close entries are timed to the microsecond.
+ * Their parameter is the time past the millisecond timestamp, in units
+ * of LOG_EDGE_US microseconds (0 to 249).
+ */
+#define	LOG_EDGE_US		4
 
 /*
  * Entry points into log.cpp
@@ -71,8 +96,16 @@ struct log_entry_s {
 
 void log_init();
 void log_commit();
+bool log_commit_busy();
+void log_commit_wait();
 void log_reset();
 void log(unsigned char op, unsigned char param);
+void log_edge(unsigned char op, unsigned long us);
+unsigned char log_n_entries();
+bool log_get(unsigned char entry, struct log_entry_s *e);
+unsigned int log_seqn();
+void log_op_short(unsigned char op, char *p);
 char *log_tos_seqn();
 char *log_tos_short(unsigned char entry);
 char *log_tos_long(unsigned char entry);
+bool log_dump(int n);
@@ -68,4 +68,6 @@ const char * const op_codes_long[] PROGMEM = {
 		ls_10,
 		ls_11,
 		ls_12,
+		ls_13,
+		ls_14,
 };
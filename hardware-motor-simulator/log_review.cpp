@@ -3,63 +3,325 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
 #include "menu.h"
 #include "log.h"
 #include "buffer.h"
 
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 static int lr_min;
 
-static void i_draw() {
+/*
+ * The log viewer
+ *
+ * Row 0 is a status line, rows 1 to 3 show log entries, the top one
+ * being the current entry.  Scrolling moves one entry at a time.
+ *
+ * The action button turns row 0 into a command line: scroll to pick a
+ * command, and the action button does it.  The commands are in
+ * lr_commands[]; they page, jump to the start or end of the log or to
+ * the first or last entry with the current entry's op code, and pick
+ * which log levels are shown.
+ *
+ * On entry the level of every entry goes into lr_levels[], 2 bits
+ * apiece, so moving through the entries of one level never decodes
+ * the ones in between.  Decoding the entries shown is quick thanks
+ * to the log's own index; see log_get().
+ *
+ * A row is only drawn again when its entry changes.
+ */
+#define	LR_ROWS		3	// rows of entries
+#define	LR_NONE		0xff	// no entry
+#define	LR_MAX_ENTRIES	(LOG_BYTES / 2)
+
+static unsigned char lr_levels[(LR_MAX_ENTRIES + 3) / 4];
+static unsigned char lr_n;		// entries in the log
+static unsigned char lr_filter;		// show levels up to this, LOG_CRITICAL >> LOG_LEVEL_SHIFT etc.
+static unsigned char lr_count;		// entries shown at this filter
+static unsigned char lr_top;		// the current entry
+static unsigned char lr_pos;		// its place among the entries shown, from 0
+static unsigned char lr_shown[LR_ROWS];	// entry on each row, as drawn
+static bool lr_command;			// row 0 is the command line
+static unsigned char lr_cmd;
+
+#define	LR_EXIT		0
+#define	LR_LEVEL	1
+#define	LR_PAGE_DOWN	2
+#define	LR_PAGE_UP	3
+#define	LR_FIRST_OP	4
+#define	LR_LAST_OP	5
+#define	LR_START	6
+#define	LR_END		7
+#define	LR_N_COMMANDS	8
+
+const char lc_0[] PROGMEM = "Exit";
+const char lc_1[] PROGMEM = "Show ";
+const char lc_2[] PROGMEM = "Page down";
+const char lc_3[] PROGMEM = "Page up";
+const char lc_4[] PROGMEM = "First ";
+const char lc_5[] PROGMEM = "Last ";
+const char lc_6[] PROGMEM = "Start of log";
+const char lc_7[] PROGMEM = "End of log";
+
+const char * const lr_commands[] PROGMEM = {
+		lc_0,
+		lc_1,
+		lc_2,
+		lc_3,
+		lc_4,
+		lc_5,
+		lc_6,
+		lc_7,
+};
+
+const char ll_0[] PROGMEM = "crit";
+const char ll_1[] PROGMEM = "norm";
+const char ll_2[] PROGMEM = "all";
+
+const char * const lr_level_names[] PROGMEM = {
+		ll_0,
+		ll_1,
+		ll_2,
+};
+
+static unsigned char i_level(unsigned char entry) {
+	return (lr_levels[entry / 4] >> (2 * (entry % 4))) & 3;
+}
+
+static bool i_shown(unsigned char entry) {
+	return i_level(entry) <= lr_filter;
+}
+
+/*
+ * The next entry shown after entry, or LR_NONE.
+ */
+static unsigned char i_next(unsigned char entry) {
+	while (++entry < lr_n)
+		if (i_shown(entry))
+			return entry;
+	return LR_NONE;
+}
+
+static unsigned char i_prev(unsigned char entry) {
+	while (entry-- > 0)
+		if (i_shown(entry))
+			return entry;
+	return LR_NONE;
+}
+
+static void i_index() {
+	struct log_entry_s e;
 	unsigned char i;
+
+	lr_n = log_n_entries();
+	for (i = 0; i < lr_n; i++) {
+		log_get(i, &e);
+		if (i % 4 == 0)
+			lr_levels[i / 4] = 0;
+		lr_levels[i / 4] |= (LOG_LEVEL(e.log_op) >> LOG_LEVEL_SHIFT) << (2 * (i % 4));
+	}
+}
+
+/*
+ * Make entry the current one, or the first shown after it if it
+ * isn't shown itself.  Counts lr_pos again, since the filter may
+ * have changed.
+ */
+static void i_go(unsigned char entry) {
+	unsigned char i;
+
+	lr_count = 0;
+	lr_top = LR_NONE;
+	for (i = 0; i < lr_n; i++) {
+		if (!i_shown(i))
+			continue;
+		if (lr_top == LR_NONE && i >= entry) {
+			lr_top = i;
+			lr_pos = lr_count;
+		}
+		lr_count++;
+	}
+	if (lr_top == LR_NONE && lr_count) {
+		lr_top = i_prev(lr_n);
+		lr_pos = lr_count - 1;
+	}
+}
+
+static void i_down(unsigned char n) {
+	unsigned char e;
+
+	while (n-- && (e = i_next(lr_top)) != LR_NONE) {
+		lr_top = e;
+		lr_pos++;
+	}
+}
+
+static void i_up(unsigned char n) {
+	unsigned char e;
+
+	while (n-- && lr_top != LR_NONE && (e = i_prev(lr_top)) != LR_NONE) {
+		lr_top = e;
+		lr_pos--;
+	}
+}
+
+/*
+ * The first (or last) entry with the current entry's op code.
+ */
+static void i_find_op(bool last) {
+	struct log_entry_s e;
+	unsigned char op, i, found;
+
+	if (!log_get(lr_top, &e))
+		return;
+	op = e.log_op;
+	found = lr_top;
+	for (i = 0; i < lr_n; i++) {
+		log_get(i, &e);
+		if (e.log_op != op)
+			continue;
+		found = i;
+		if (!last)
+			break;
+	}
+	i_go(found);
+}
+
+static void i_do_command() {
+	switch (lr_cmd) {
+	case LR_LEVEL:
+		lr_filter = lr_filter? lr_filter - 1: LOG_DETAIL >> LOG_LEVEL_SHIFT;
+		i_go(lr_top);
+		break;
+	case LR_PAGE_DOWN:
+		i_down(LR_ROWS);
+		break;
+	case LR_PAGE_UP:
+		i_up(LR_ROWS);
+		break;
+	case LR_FIRST_OP:
+		i_find_op(false);
+		break;
+	case LR_LAST_OP:
+		i_find_op(true);
+		break;
+	case LR_START:
+		i_go(0);
+		break;
+	case LR_END:
+		i_go(lr_n);
+		break;
+	}
+}
+
+/*
+ * Row 0: the status line, or the command line.
+ */
+static void i_draw_top() {
+	struct log_entry_s e;
 	char *p;
 
-	// draw the screen
-	for (i = 0; i < 4; i++) {
-		lcd.setCursor(0, i);
-		if (i + lr_min < 0)
-			p = log_tos_seqn();
-		else
-			p = log_tos_short(i + lr_min);
-		if (*p)
-			lcd.print(p);
-		else {
-			buffer_zip_short();
+	buffer_zip();
+	buffer[20] = '\0';
+	if (lr_command) {
+		buffer[0] = '>';
+		p = buffer + 2;
+		strcpy_P(p, (char*)pgm_read_word(&(lr_commands[lr_cmd])));
+		while (*p)
+			p++;
+		if (lr_cmd == LR_LEVEL)
+			strcpy_P(p, (char*)pgm_read_word(&(lr_level_names[lr_filter])));
+		else if ((lr_cmd == LR_FIRST_OP || lr_cmd == LR_LAST_OP) && log_get(lr_top, &e))
+			log_op_short(e.log_op & ~LOG_LEVEL_MASK, p);
+		while (*p)
+			p++;
+		*p = ' ';
+	} else {
+		buffer[0] = '#';
+		buffer_print_n_l(1, 5, log_seqn());
+		p = buffer + 7;
+		strcpy_P(p, (char*)pgm_read_word(&(lr_level_names[lr_filter])));
+		while (*p)
+			p++;
+		*p = ' ';
+		if (lr_count) {
+			buffer_print_n_c(12, lr_pos + 1);
+			buffer[15] = '/';
+			buffer_print_n_c(16, lr_count);
+		}
+	}
+	lcd.setCursor(0, 0);
+	lcd.print(buffer);
+}
+
+static void i_draw() {
+	unsigned char i, e;
+	char *p;
+
+	e = lr_top;
+	for (i = 0; i < LR_ROWS; i++) {
+		if (e != lr_shown[i]) {
+			lr_shown[i] = e;
+			p = e == LR_NONE? buffer: log_tos_short(e);
+			if (e == LR_NONE || !*p) {
+				buffer_zip();
+				buffer[20] = '\0';
+			}
+			lcd.setCursor(0, i + 1);
 			lcd.print(buffer);
 		}
+		if (e != LR_NONE)
+			e = i_next(e);
 	}
+	i_draw_top();
 }
 
 void log_review_state(bool first_time) {
+	unsigned char i;
 
 	if (first_time) {
-		lr_min = -1;
+		i_index();
+		lr_filter = LOG_DETAIL >> LOG_LEVEL_SHIFT;
+		lr_command = false;
+		lr_cmd = LR_EXIT;
+		for (i = 0; i < LR_ROWS; i++)
+			lr_shown[i] = LR_NONE - 1;	// never an entry, so all get drawn
+		lcd.clear();
+		i_go(0);
 	}
 
 	if (input_action_button)  {
 		input_action_button = false;
-		output_led = LED_OFF;
-		state_new(menu_state);
+		if (lr_command && lr_cmd == LR_EXIT) {
+			output_led = LED_OFF;
+			state_new(menu_state);
+			return;
+		}
+		if (lr_command)
+			i_do_command();
+		lr_command = !lr_command;
+		first_time = true;
 	}
 
 	if (input_scroll_up) {
 		input_scroll_up = false;
-		if (lr_min > -1) {
-			lr_min--;
-			first_time = true;
-		}
+		if (lr_command)
+			lr_cmd = lr_cmd? lr_cmd - 1: LR_N_COMMANDS - 1;
+		else
+			i_up(1);
+		first_time = true;
 	}
 
 	if (input_scroll_down) {
 		input_scroll_down = false;
-		if (*log_tos_short(lr_min+3)) {
-			lr_min++;
-			first_time = true;
-		}
+		if (lr_command)
+			lr_cmd = lr_cmd < LR_N_COMMANDS - 1? lr_cmd + 1: 0;
+		else
+			i_down(1);
+		first_time = true;
 	}
 
 	if (first_time) {
@@ -81,7 +343,7 @@ void log_to_serial(bool first_time) {
 	if (first_time) {
 		lr_min = -1;
 		lcd.clear();
-		lcd.print("  Log to Serial");
+		lcd.print(F("  Log to Serial"));
 	}
 
 	if (lr_min < 0)
@@ -89,7 +351,6 @@ void log_to_serial(bool first_time) {
 	else
 		p = log_tos_long((unsigned char)lr_min);
 	lr_min++;
-	/*xxx*/Serial.print(" -- ");Serial.print(lr_min);Serial.print("\n");
 
 	if (*p) {
 		Serial.print(p);
@@ -98,3 +359,25 @@ void log_to_serial(bool first_time) {
 		state_new(menu_state);
 }
 
+
+/*
+ * The log and EEPROM as binary frames, for host/logdump.  See log_dump().
+ */
+void log_dump_state(bool first_time) {
+
+	if (input_action_button) {
+		input_action_button = false;
+		state_new(menu_state);
+		return;
+	}
+
+	if (first_time) {
+		lr_min = 0;
+		lcd.clear();
+		lcd.print(F("  Log Dump"));
+		log_commit_wait();
+	}
+
+	if (!log_dump(lr_min++))
+		state_new(menu_state);
+}
@@ -0,0 +1,28 @@
+/*
+ * Lookup tables built at compile time.
+ *
+ * A table is filled by calling a constexpr function for each index, so
+ * it always matches the arithmetic it replaces, and changing a #define
+ * rebuilds it.  For a function f(i):
+ *
+ * 	template <unsigned... I>
+ * 	constexpr struct lookup_s<unsigned char, sizeof...(I)> f_table(lookup_index<I...>) {
+ * 		return {{ f(I)... }};
+ * 	}
+ * 	const struct lookup_s<unsigned char, N> t PROGMEM = f_table(lookup_make<N>::type());
+ *
+ * and read entries with pgm_read_byte(&t.v[i]).  This is C++11, as the
+ * Arduino IDE compiles it.
+ */
+
+template <class T, unsigned N> struct lookup_s {
+	T v[N];
+};
+
+template <unsigned... I> struct lookup_index {};
+
+// lookup_make<N>::type is lookup_index<0, 1, ... N-1>
+template <unsigned N, unsigned... I> struct lookup_make : lookup_make<N - 1, N - 1, I...> {};
+template <unsigned... I> struct lookup_make<0, I...> {
+	typedef lookup_index<I...> type;
+};
@@ -0,0 +1,252 @@
+/*
+ * Loop timing statistics and the "Loop Stats" screen.
+ *
+ * For each stage of loop() (and for the loop period) we keep
+ * min, max, mean and a histogram with one bucket per power of two
+ * microseconds.  Bucket 0 holds 0 and 1 us, bucket n holds
+ * 2^n to 2^(n+1)-1 us.
+ *
+ * The screen has several pages, selected with the scroll switch:
+ *	0	loop count and missed 1 ms deadlines
+ *	1	min/mean/max for each stage
+ *	2-5	histogram for each stage
+ */
+
+#include <Arduino.h>
+#include "screen.h"
+#include "io_ref.h"
+#include "state.h"
+#include "menu.h"
+#include "buffer.h"
+#include "loop_stats.h"
+
+extern Screen lcd;
+
+bool loop_stats_enabled;
+struct loop_stat_s loop_stat[LS_N_STAGES];
+unsigned long loop_stats_count;
+unsigned long loop_stats_missed;
+
+static bool have_last_start;
+static unsigned long last_start;
+
+// stage names, 3 chars max
+const char ls_name_0[] PROGMEM = "in";
+const char ls_name_1[] PROGMEM = "st";
+const char ls_name_2[] PROGMEM = "out";
+const char ls_name_3[] PROGMEM = "per";
+
+const char * const ls_names[] PROGMEM = {
+		ls_name_0,
+		ls_name_1,
+		ls_name_2,
+		ls_name_3,
+};
+
+void loop_stats_reset() {
+	unsigned char i, j;
+
+	for (i = 0; i < LS_N_STAGES; i++) {
+		loop_stat[i].min = 0xffff;
+		loop_stat[i].max = 0;
+		loop_stat[i].sum = 0;
+		for (j = 0; j < LS_HIST; j++)
+			loop_stat[i].hist[j] = 0;
+	}
+	loop_stats_count = 0;
+	loop_stats_missed = 0;
+	have_last_start = false;
+}
+
+static void i_record(struct loop_stat_s *s, unsigned long us) {
+	unsigned int d;
+	unsigned char b;
+
+	d = (us > 0xffff)? 0xffff: us;
+	if (d < s->min)
+		s->min = d;
+	if (d > s->max)
+		s->max = d;
+	s->sum += us;
+
+	for (b = 0; d > 1 && b < LS_HIST - 1; b++)
+		d >>= 1;
+	if (s->hist[b] != 0xffff)
+		s->hist[b]++;
+}
+
+/*
+ * Called at the end of every loop with the micros() times taken
+ * before inputs(), state_machine(), outputs() and after outputs().
+ */
+void loop_stats(unsigned long t0, unsigned long t1, unsigned long t2, unsigned long t3) {
+	unsigned long period;
+
+	if (!loop_stats_enabled) {
+		have_last_start = false;
+		return;
+	}
+
+	i_record(&loop_stat[LS_INPUTS], t1 - t0);
+	i_record(&loop_stat[LS_STATE], t2 - t1);
+	i_record(&loop_stat[LS_OUTPUTS], t3 - t2);
+	loop_stats_count++;
+
+	if (have_last_start) {
+		period = t0 - last_start;
+		i_record(&loop_stat[LS_PERIOD], period);
+		if (period > LS_DEADLINE)
+			loop_stats_missed++;
+	}
+	last_start = t0;
+	have_last_start = true;
+}
+
+/*
+ * Number of samples behind a stage's statistics
+ */
+static unsigned long i_samples(unsigned char stage) {
+	if (stage == LS_PERIOD)
+		return loop_stats_count? loop_stats_count - 1: 0;
+	return loop_stats_count;
+}
+
+static unsigned long i_mean(unsigned char stage) {
+	unsigned long n;
+
+	n = i_samples(stage);
+	return n? loop_stat[stage].sum / n: 0;
+}
+
+static unsigned int i_min(unsigned char stage) {
+	return i_samples(stage)? loop_stat[stage].min: 0;
+}
+
+/*
+ * Dump everything in a form that is easy to read and easy to parse.
+ */
+void loop_stats_to_serial() {
+	unsigned char i, j;
+
+	Serial.print(F("Loop stats: "));
+	Serial.print(loop_stats_count);
+	Serial.print(F(" loops, "));
+	Serial.print(loop_stats_missed);
+	Serial.print(F(" missed 1 ms deadlines\n"));
+	Serial.print(F("stage min mean max hist(log2 us)\n"));
+
+	for (i = 0; i < LS_N_STAGES; i++) {
+		strcpy_P(buffer, (char*)pgm_read_word(&(ls_names[i])));
+		Serial.print(buffer);
+		Serial.print(' ');
+		Serial.print(i_min(i));
+		Serial.print(' ');
+		Serial.print(i_mean(i));
+		Serial.print(' ');
+		Serial.print(loop_stat[i].max);
+		for (j = 0; j < LS_HIST; j++) {
+			Serial.print(' ');
+			Serial.print(loop_stat[i].hist[j]);
+		}
+		Serial.print('\n');
+	}
+}
+
+#define	N_PAGES	(2 + LS_N_STAGES)
+
+static unsigned char page;
+
+static void i_name(unsigned char stage) {
+	char *p;
+
+	strcpy_P(buffer, (char*)pgm_read_word(&(ls_names[stage])));
+	for (p = buffer; *p; p++)
+		;
+	*p = ' ';
+}
+
+static void i_draw() {
+	unsigned char i, j;
+
+	lcd.clear();
+
+	if (page == 0) {
+		lcd.print(F("Loop Stats"));
+		buffer_zip_short();
+		memcpy(buffer, "Loops:", 6);
+		buffer_print_n_l(9, 10, loop_stats_count);
+		lcd.setCursor(0, 1);
+		lcd.print(buffer);
+		buffer_zip_short();
+		memcpy(buffer, "Missed 1ms:", 11);
+		buffer_print_n_l(12, 7, loop_stats_missed);
+		lcd.setCursor(0, 2);
+		lcd.print(buffer);
+		lcd.setCursor(0, 3);
+		lcd.print(F("Scroll for uSec"));
+		return;
+	}
+
+	// min, mean and max, one line per stage
+	if (page == 1) {
+		for (i = 0; i < LS_N_STAGES; i++) {
+			buffer_zip_short();
+			i_name(i);
+			buffer_print_n_l(3, 5, i_min(i));
+			buffer_print_n_l(8, 5, i_mean(i));
+			buffer_print_n_l(13, 6, loop_stat[i].max);
+			lcd.setCursor(0, i);
+			lcd.print(buffer);
+		}
+		return;
+	}
+
+	// histogram pages, 4 buckets of 5 columns per line
+	i = page - 2;
+	buffer_zip_short();
+	i_name(i);
+	memcpy(buffer + 4, "log2 uS hist", 12);
+	lcd.print(buffer);
+	for (j = 0; j < LS_HIST; j++) {
+		if ((j & 3) == 0)
+			buffer_zip_short();
+		buffer_print_n_l((j & 3) * 5, 4, loop_stat[i].hist[j]);
+		if ((j & 3) == 3) {
+			lcd.setCursor(0, 1 + j / 4);
+			lcd.print(buffer);
+		}
+	}
+}
+
+/*
+ * Show the statistics from the last run.
+ */
+void loop_stats_state(bool first_time) {
+	if (first_time)
+		page = 0;
+
+	if (input_action_button) {
+		input_action_button = false;
+		state_new(menu_state);
+		return;
+	}
+
+	if (input_scroll_up) {
+		input_scroll_up = false;
+		if (page > 0) {
+			page--;
+			first_time = true;
+		}
+	}
+
+	if (input_scroll_down) {
+		input_scroll_down = false;
+		if (page < N_PAGES - 1) {
+			page++;
+			first_time = true;
+		}
+	}
+
+	if (first_time)
+		i_draw();
+}
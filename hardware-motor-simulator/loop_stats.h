@@ -0,0 +1,33 @@
+/*
+ * Loop timing statistics
+ *
+ * loop() measures each of its stages with micros() and hands the
+ * times to loop_stats().  Statistics are only gathered while
+ * loop_stats_enabled is set, which full_run does for the length of a run.
+ */
+
+#define	LS_INPUTS	0	// inputs()
+#define	LS_STATE	1	// state_machine()
+#define	LS_OUTPUTS	2	// outputs()
+#define	LS_PERIOD	3	// start of one loop to start of the next
+#define	LS_N_STAGES	4
+
+#define	LS_HIST		12	// log2 histogram buckets; last is 2048 us and up
+#define	LS_DEADLINE	1000	// microseconds.  Physics wants to run every 1 ms
+
+struct loop_stat_s {
+	unsigned int min;		// microseconds, saturates at 65535
+	unsigned int max;
+	unsigned long sum;
+	unsigned int hist[LS_HIST];	// saturating counts
+};
+
+extern bool loop_stats_enabled;
+extern struct loop_stat_s loop_stat[LS_N_STAGES];
+extern unsigned long loop_stats_count;		// loops measured
+extern unsigned long loop_stats_missed;		// loop periods over LS_DEADLINE
+
+void loop_stats_reset();
+void loop_stats(unsigned long t0, unsigned long t1, unsigned long t2, unsigned long t3);
+void loop_stats_to_serial();
+void loop_stats_state(bool first_time);
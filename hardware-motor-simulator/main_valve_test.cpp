@@ -7,13 +7,13 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
 #include "menu.h"
 #include "buffer.h"
 
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 static unsigned long next_update_time;
 extern unsigned long loop_time;
@@ -26,11 +26,11 @@ void main_valve_test_state(bool first_time) {
 	if (first_time) {
 		lcd.clear();
 		lcd.setCursor(3, 0);
-		lcd.print("Main Valve Test");
+		lcd.print(F("Main Valve Test"));
 		lcd.setCursor(0, 2);
-		lcd.print("IPA Valve:");
+		lcd.print(F("IPA Valve:"));
 		lcd.setCursor(0, 3);
-		lcd.print("N2O Valve:");
+		lcd.print(F("N2O Valve:"));
 		next_update_time = 0;
 	}
 	
@@ -48,13 +48,11 @@ void main_valve_test_state(bool first_time) {
 	// schedule next update.
 	next_update_time = loop_time + update_period;
 
-	// get the data.  Must disable interrupts.
-	noInterrupts();
-	vipa = input_ipa_servo;
-	vn2o = input_n2o_servo;
-	interrupts();
+	// get the data.  Reading the position updates the pulse width.
 	dipa = servo_read_ipa();
 	dn2o = servo_read_n2o();
+	vipa = input_ipa_servo;
+	vn2o = input_n2o_servo;
 
 	buffer_zip();
 	buffer[8] = '\0';
@@ -63,9 +61,9 @@ void main_valve_test_state(bool first_time) {
 	lcd.print(buffer);
 	lcd.setCursor(12, 2);
 	if (dipa == -1) 
-		lcd.print("N/C");
+		lcd.print(F("N/C"));
 	else if (dipa == -2)
-		lcd.print("error");
+		lcd.print(F("error"));
 	else
 		lcd.print(vipa);
 
@@ -73,9 +71,9 @@ void main_valve_test_state(bool first_time) {
 	lcd.print(buffer);
 	lcd.setCursor(12, 3);
 	if (dn2o == -1) 
-		lcd.print("N/C");
+		lcd.print(F("N/C"));
 	else if (dn2o == -2)
-		lcd.print("error");
+		lcd.print(F("error"));
 	else
 		lcd.print(vn2o);
 }
@@ -5,10 +5,10 @@
 #include <Arduino.h>
 #include "state.h"
 #include "io_ref.h"
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "avr/pgmspace.h"
 #include "buffer.h"
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 #define	N_MENU_LINES	4
 
@@ -32,6 +32,12 @@ const char  m_3[] PROGMEM = "Spark Test";
 const char  m_4[] PROGMEM = "IG Valve Test";
 const char  m_5[] PROGMEM = "Main Valve Test";
 const char  m_6[] PROGMEM = "Ig Pressure Sensor";
+const char  m_7[] PROGMEM = "Loop Stats";
+const char  m_8[] PROGMEM = "Servo Analyzer";
+const char  m_9[] PROGMEM = "Log Dump";
+const char m_10[] PROGMEM = "Telemetry Run";
+const char m_11[] PROGMEM = "Trace Run";
+const char m_12[] PROGMEM = "Memory";
 
 const char * const menu_table[] PROGMEM = {
 		m_0,
@@ -41,6 +47,12 @@ const char * const menu_table[] PROGMEM = {
 		m_4,
 		m_5,
 		m_6,
+		m_7,
+		m_8,
+		m_9,
+		m_10,
+		m_11,
+		m_12,
 };
 
 /*
@@ -53,6 +65,12 @@ extern void spark_test_state(bool);
 extern void ig_valve_test_state(bool);
 extern void main_valve_test_state(bool);
 extern void ig_press_test_state(bool);
+extern void loop_stats_state(bool);
+extern void servo_analyzer_state(bool);
+extern void log_dump_state(bool);
+extern void telem_run_state(bool);
+extern void trace_run_state(bool);
+extern void stack_state(bool);
 
 void (*menu_state_functions[])(bool) = {
 	full_run_state,
@@ -62,9 +80,15 @@ void (*menu_state_functions[])(bool) = {
 	ig_valve_test_state,
 	main_valve_test_state,
 	ig_press_test_state,
+	loop_stats_state,
+	servo_analyzer_state,
+	log_dump_state,
+	telem_run_state,
+	trace_run_state,
+	stack_state,
 };
 
-#define	N_MENU_ITEMS	7
+#define	N_MENU_ITEMS	13
 
 static unsigned char menu_selection;	// which is the current menu item?
 
@@ -109,8 +133,6 @@ void menu_state(bool first_time) {
 	// If the action button has been hit, then switch states.
 	if (input_action_button) {
 		input_action_button = false;
-		/*xxx*/Serial.print("Selecting menu item "); {Serial.println((int)menu_selection); delay(500);}
-
 		state_new(menu_state_functions[menu_selection]);
 		return;
 	}
@@ -1,18 +1,22 @@
 /*
  * Handle some of the output processing.
- * DOES NOT handle the LCD screen.  Various bits of code do that whereever.
  * DOES NOT handle the DAC outputs.  Those are directly manipulated by the code.
  *
- * Only one output handled here:
+ * Two outputs handled here:
  * Status LED
  * 	This is the green LED below the scroll switch.
  * 	This routine sets it according to a state variable
  * 	that anybody can manipulate.
+ * LCD screen
+ * 	Various bits of code draw the screen whereever, into RAM.
+ * 	This routine sends the changes to the display, a few
+ * 	characters per loop.  See screen.cpp.
  */
 
 #include "Arduino.h"
 #include "io_ref.h"
 #include "pins.h"
+#include "screen.h"
 
 // The output
 unsigned char output_led;
@@ -59,4 +63,5 @@ void output_setup() {
 
 void outputs() {
 	i_led();
+	screen_flush();
 }
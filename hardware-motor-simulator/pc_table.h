@@ -0,0 +1,19 @@
+/*
+ * Chamber pressure percent over flow and mixture; see physics.h.
+ * Made by host/pcgen from host/data/pc.csv.  Do not edit.
+ */
+
+#include "avr/pgmspace.h"
+
+const unsigned char pc_table[PC_FLOW_POINTS][PC_MIX_POINTS] PROGMEM = {
+//	mixture 0 to 256 by 32
+	{   0,   0,   0,   0,   0,   0,   0,   0,   0 },	// flow 0.0%
+	{   0,   3,   7,  10,  11,  10,   8,   5,   0 },	// flow 12.5%
+	{   0,   7,  15,  21,  22,  21,  16,   9,   0 },	// flow 25.0%
+	{   0,  10,  23,  31,  34,  32,  25,  15,   0 },	// flow 37.5%
+	{   0,  14,  31,  42,  46,  43,  34,  20,   0 },	// flow 50.0%
+	{   0,  17,  40,  54,  59,  55,  43,  25,   0 },	// flow 62.4%
+	{   0,  21,  49,  66,  72,  67,  53,  31,   0 },	// flow 74.9%
+	{   0,  26,  58,  78,  86,  80,  63,  37,   0 },	// flow 87.4%
+	{   0,  30,  68,  91, 100,  93,  74,  43,   0 },	// flow 99.9%
+};
@@ -0,0 +1,174 @@
+/*
+ * The physics lookup tables and pressure dynamics.  See physics.h.
+ */
+
+#include <Arduino.h>
+#include "physics.h"
+#include "pc_table.h"
+
+/*
+ * Valve flow curves, percent of full flow every VALVE_STEP degrees; see
+ * physics.h.  The N2O valve's seat is taken to cover the first step.
+ */
+const unsigned char ipa_valve_curve[VALVE_POINTS(IPA_SERVO_MIN, IPA_SERVO_MAX)] PROGMEM = {
+	0, 2, 5, 9, 15, 23, 33, 46, 63, 82, 100,
+};
+
+const unsigned char n2o_valve_curve[VALVE_POINTS(N2O_SERVO_MIN, N2O_SERVO_MAX)] PROGMEM = {
+	0, 0, 2, 5, 10, 17, 27, 40, 57, 78, 100,
+};
+
+const struct lookup_s<unsigned char, 101> chamber_pct_table PROGMEM =
+	physics_chamber_pct_table(lookup_make<101>::type());
+
+const struct lookup_s<unsigned int, CHAMBER_PCT_TOP + 1> chamber_p_table PROGMEM =
+	physics_chamber_p_table(lookup_make<CHAMBER_PCT_TOP + 1>::type());
+
+/*
+ * Pressure dynamics
+ *
+ * Pressures are DAC counts in Q16.16.  Each 1 ms step moves a pressure
+ * a fixed fraction of the way to its target, a first-order lag:
+ * 	p += (target - p) * alpha,	alpha = 1 ms / tau
+ * alpha is Q8.8.  The gap is cut to Q16.8 before the multiply, so the
+ * product is Q16.16 and fits in 32 bits.  Rising and falling pressures
+ * have their own time constants.
+ *
+ * The igniter heads for the target its caller works out, but never
+ * sits below the chamber: the chamber feeds it.  The chamber lights
+ * once the igniter pressure is good with propellants flowing, stays lit
+ * while the flow is at least CHAMBER_MIN_PCT, and heads for the
+ * pressure of the flow.  Unlit, the flow only gives a little pressure.
+ *
+ * Noise is the sum of the two bytes of a 16-bit xorshift generator,
+ * which has a triangular distribution, scaled to +-NOISE counts.
+ */
+#define	ALPHA(tau)	((256 + (tau) / 2) / (tau))	// Q8.8
+#define	Q16(counts)	((long)(counts) << 16)
+
+static long ig_q16;
+static long chamber_q16;
+static bool chamber_lit;
+static uint16_t noise_state;
+
+void physics_reset() {
+	ig_q16 = Q16(NO_PRESSURE);
+	chamber_q16 = Q16(NO_PRESSURE);
+	chamber_lit = false;
+	noise_state = 0xace1;
+}
+
+static void i_lag(long *p, int target, unsigned char alpha_fill, unsigned char alpha_empty) {
+	long gap;
+
+	gap = (Q16(target) - *p) >> 8;		// Q16.8
+	*p += gap * (gap > 0? alpha_fill: alpha_empty);
+}
+
+/*
+ * The pressure p with noise, in whole DAC counts
+ */
+static int i_out(long p) {
+	uint16_t x;
+
+	x = noise_state;
+	x ^= x << 7;
+	x ^= x >> 9;
+	x ^= x << 8;
+	noise_state = x;
+	p += (long)((int)(x & 0xff) + (int)(x >> 8) - 255) * (NOISE << 8);
+	return (p + 0x8000) >> 16;
+}
+
+int physics_ig(int target) {
+	if (target < (int)(chamber_q16 >> 16))
+		target = chamber_q16 >> 16;
+	i_lag(&ig_q16, target, ALPHA(IG_TAU_FILL), ALPHA(IG_TAU_EMPTY));
+	return i_out(ig_q16);
+}
+
+/*
+ * pct is the chamber percentage the valves allow, ig_p the igniter
+ * pressure in DAC counts.
+ */
+int physics_chamber(int pct, int ig_p) {
+	if (pct < CHAMBER_MIN_PCT)
+		chamber_lit = false;
+	else if (ig_p >= IG_PRESS_GOOD)
+		chamber_lit = true;
+	if (!chamber_lit)
+		pct >>= CHAMBER_COLD_SHIFT;
+	i_lag(&chamber_q16, physics_chamber_p_of(pct), ALPHA(CHAMBER_TAU_FILL), ALPHA(CHAMBER_TAU_EMPTY));
+	return i_out(chamber_q16);
+}
+
+bool physics_lit() {
+	return chamber_lit;
+}
+
+/*
+ * One 1 ms step of a servo commanded to deg degrees; deg 0 or less is no
+ * pulse, and the servo keeps heading where it was last sent.
+ *
+ * The work is done as if the target were ahead.  Braking from speed v
+ * takes v + (v - a) + ... = v (v + a) / 2a, so speed up if the target is
+ * still that far off at the new speed, hold the speed if it is at this
+ * one, and brake if not.  Sitting on the target it brakes to a stop.
+ */
+#define	STOP_DIST(v)	(((v) * ((v) + SERVO_ACCEL)) >> (SERVO_ACCEL_SHIFT + 1))
+
+void physics_servo(struct physics_servo_s *s, int deg) {
+	int gap, v;
+	bool back;
+
+	if (deg > 0)
+		s->target = deg << SERVO_POS_SHIFT;
+	gap = s->target - s->pos;
+	v = s->vel;
+	back = gap < 0;
+	if (back) {
+		gap = -gap;
+		v = -v;
+	}
+
+	if (v < 0)
+		v += SERVO_ACCEL;		// going the wrong way
+	else if (v < SERVO_RATE && STOP_DIST(v + SERVO_ACCEL) <= gap)
+		v += SERVO_ACCEL;
+	else if (STOP_DIST(v) > gap)
+		v -= SERVO_ACCEL;
+
+	// arriving, it is still moving until the next step brakes it
+	if (v >= gap)
+		s->pos = s->target;
+	else
+		s->pos += back? -v: v;
+	s->vel = back? -v: v;
+}
+
+/*
+ * Step timing.  Timer1 runs at 16 MHz / 8, so a tick is 8 cycles.
+ */
+static unsigned int step_max;
+static unsigned long step_sum;
+static unsigned long step_n;
+
+void physics_time(unsigned int timer1_ticks) {
+	if (timer1_ticks > step_max)
+		step_max = timer1_ticks;
+	step_sum += timer1_ticks;
+	step_n++;
+}
+
+void physics_to_serial() {
+	Serial.print(F("Physics steps: "));
+	Serial.print(step_n);
+	Serial.print(F(", mean "));
+	Serial.print(step_n? step_sum * 8 / step_n: 0);
+	Serial.print(F(" max "));
+	Serial.print((unsigned long)step_max * 8);
+	Serial.print(F(" cycles\n"));
+	step_max = 0;
+	step_sum = 0;
+	step_n = 0;
+}
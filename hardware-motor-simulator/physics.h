@@ -0,0 +1,238 @@
+/*
+ * Parameters, lookup tables and pressure dynamics for the full run physics.
+ *
+ * The conversions that run every simulated millisecond are PROGMEM
+ * tables, so a step costs table reads instead of divides.  The chamber
+ * tables are built from these #defines at compile time (see lookup.h),
+ * and host/test_tables.cpp checks every entry against the arithmetic
+ * they replaced.
+ *
+ * The servos, and the pressures themselves, are modeled in fixed point;
+ * see physics.cpp.
+ */
+
+#include <avr/pgmspace.h>
+#include "lookup.h"
+#include "pressure.h"
+
+#define	N2O_SERVO_MIN		(44+5)		// degress.  Off.
+#define	N2O_SERVO_MAX		(N2O_SERVO_MIN + 80)
+#define	IPA_SERVO_MIN		(44+5)		// degress.  Off.
+#define	IPA_SERVO_MAX		(IPA_SERVO_MIN + 80)
+
+//chamber behavior parameters: permit things like no/low pressure on main chamber startup,
+//or failure to reach full pressure when main valves open fully
+#ifndef CHAMBER_EFF
+#define CHAMBER_EFF		100		// relative pressure
+#endif
+#define CHAMBER_MAX_PCT		100		// max pressure percentage
+
+#define	CHAMBER_MIN_PCT		10		// flame goes out below this
+#define	CHAMBER_COLD_SHIFT	3		// unlit, flow gives 1/8 the pressure
+
+/*
+ * Time constants, milliseconds: how long a pressure takes to get
+ * 63% of the way to where it is heading.
+ */
+#define	IG_TAU_FILL		5
+#define	IG_TAU_EMPTY		10
+#define	CHAMBER_TAU_FILL	30
+#define	CHAMBER_TAU_EMPTY	50
+
+// amount of noise we put on simulated pressure traces, DAC counts.
+// Should be smaller than hysteresis value (3) in inputs.cpp
+#define	NOISE			2
+
+// highest chamber percentage there can be
+#define	CHAMBER_PCT_TOP		(CHAMBER_EFF > 100? CHAMBER_EFF: 100)
+
+/*
+ * Chamber pressure, percent, for the combustion table's percentage
+ */
+constexpr unsigned char physics_chamber_pct(int pct) {
+	return CHAMBER_EFF * pct / 100;
+}
+
+template <unsigned... I>
+constexpr struct lookup_s<unsigned char, sizeof...(I)> physics_chamber_pct_table(lookup_index<I...>) {
+	return {{ physics_chamber_pct(I)... }};
+}
+
+/*
+ * DAC counts for a chamber pressure percentage.  The product is over
+ * 32767 at full pressure, so it is a long: int is 16 bits on the AVR.
+ */
+constexpr unsigned int physics_chamber_p(int pct) {
+	return (long)pct * (MAX_MAIN_PRESSURE - SENSOR_ZERO) / 100 + SENSOR_ZERO;
+}
+
+static_assert(physics_chamber_p(100) == MAX_MAIN_PRESSURE, "chamber_p_table is wrong at full pressure");
+
+template <unsigned... I>
+constexpr struct lookup_s<unsigned int, sizeof...(I)> physics_chamber_p_table(lookup_index<I...>) {
+	return {{ physics_chamber_p(I)... }};
+}
+
+extern const struct lookup_s<unsigned char, 101> chamber_pct_table;
+extern const struct lookup_s<unsigned int, CHAMBER_PCT_TOP + 1> chamber_p_table;
+
+/*
+ * The valve servos.  Positions are in 1/64 degree; a servo moves toward
+ * where it is commanded no faster than SERVO_RATE and speeds up or slows
+ * down by at most SERVO_ACCEL each 1 ms step, stopping on the spot.
+ * 0.5 degree/ms is the 2 ms per degree the servos used to slew at.
+ */
+#define	SERVO_POS_SHIFT		6
+#define	SERVO_RATE		32		// 1/64 degree per ms
+#define	SERVO_ACCEL_SHIFT	1
+#define	SERVO_ACCEL		(1 << SERVO_ACCEL_SHIFT)	// 1/64 degree per ms per ms
+
+static_assert(SERVO_RATE % SERVO_ACCEL == 0, "SERVO_RATE is not whole steps of SERVO_ACCEL");
+
+struct physics_servo_s {
+	int pos;		// 1/64 degree
+	int vel;		// 1/64 degree per ms
+	int target;		// 1/64 degree
+};
+
+extern void physics_servo(struct physics_servo_s *s, int deg);
+
+/*
+ * Valve flow curves: percent of full flow at every VALVE_STEP degrees
+ * from the valve's SERVO_MIN to its SERVO_MAX.  These are placeholders,
+ * drawn by hand in the shape a ball valve's curve usually has: little
+ * flow until well open, so far from straight lines.  Nothing has been
+ * measured yet; replace them with bench data when there is some.  Flow
+ * between the points is interpolated; the curves must not go down,
+ * which host/test_tables.cpp checks.
+ */
+#define	VALVE_STEP_SHIFT	3
+#define	VALVE_STEP		(1 << VALVE_STEP_SHIFT)	// degrees
+#define	VALVE_POINTS(lo, hi)	(((hi) - (lo)) / VALVE_STEP + 1)
+
+static_assert((IPA_SERVO_MAX - IPA_SERVO_MIN) % VALVE_STEP == 0, "IPA valve travel is not whole steps");
+static_assert((N2O_SERVO_MAX - N2O_SERVO_MIN) % VALVE_STEP == 0, "N2O valve travel is not whole steps");
+
+extern const unsigned char ipa_valve_curve[VALVE_POINTS(IPA_SERVO_MIN, IPA_SERVO_MAX)];
+extern const unsigned char n2o_valve_curve[VALVE_POINTS(N2O_SERVO_MIN, N2O_SERVO_MAX)];
+
+/*
+ * Percent flow at pos (1/64 degree) of a valve that opens from lo to
+ * hi degrees.  The fraction of a step is cut to 8 bits, so the multiply
+ * is at most 100 * 255 and fits in an int.
+ */
+static inline int physics_valve_pct(const unsigned char *curve, int lo, int hi, int pos) {
+	unsigned int off;
+	unsigned char i, f;
+	int a, b;
+
+	if (pos <= lo << SERVO_POS_SHIFT)
+		return 0;
+	if (pos >= hi << SERVO_POS_SHIFT)
+		return 100;
+	off = pos - (lo << SERVO_POS_SHIFT);
+	i = off >> (SERVO_POS_SHIFT + VALVE_STEP_SHIFT);
+	f = off >> (SERVO_POS_SHIFT + VALVE_STEP_SHIFT - 8);	// the low 8 bits are the fraction
+	a = pgm_read_byte(&curve[i]);
+	b = pgm_read_byte(&curve[i + 1]);
+	return a + (((b - a) * f) >> 8);
+}
+
+static inline int physics_ipa_pct(int pos) {
+	return physics_valve_pct(ipa_valve_curve, IPA_SERVO_MIN, IPA_SERVO_MAX, pos);
+}
+
+static inline int physics_n2o_pct(int pos) {
+	return physics_valve_pct(n2o_valve_curve, N2O_SERVO_MIN, N2O_SERVO_MAX, pos);
+}
+
+/*
+ * Combustion: chamber pressure percent for the two valves' flows, from
+ * pc_table.h, which host/pcgen makes from host/data/pc.csv.
+ *
+ * The table is over total flow and mixture.  Flow is the sum of the two
+ * valves' percentages scaled by 41/32, so both wide open is 256; mixture
+ * is N2O's share of that sum in 1/256, so the design ratio is 128.  The
+ * points are every 32 on both axes.  Between them the table is
+ * interpolated along flow and then mixture, 5 bits of fraction at a
+ * time, rounding, so every product fits in an int.  Working out the
+ * mixture takes the one divide in the step.
+ */
+#define	PC_SHIFT		5
+#define	PC_HALF			(1 << (PC_SHIFT - 1))	// rounds the interpolation
+#define	PC_FLOW_MUL		41		// 200 * 41 >> 5 is 256
+#define	PC_FLOW_POINTS		((256 >> PC_SHIFT) + 1)
+#define	PC_MIX_POINTS		((256 >> PC_SHIFT) + 1)
+
+extern const unsigned char pc_table[PC_FLOW_POINTS][PC_MIX_POINTS];
+
+// the cell an axis value x (0 to 256) is in, and how far along it
+static inline unsigned char physics_pc_cell(unsigned int x, unsigned char n, unsigned char *f) {
+	unsigned char i;
+
+	i = x >> PC_SHIFT;
+	if (i > n - 2)
+		i = n - 2;
+	*f = x - (i << PC_SHIFT);	// 0 to 32
+	return i;
+}
+
+// ipa and n2o are percent of each valve's full flow, 0 to 100
+static inline int physics_pc_pct(int ipa, int n2o) {
+	unsigned int sum, flow, mix;
+	unsigned char i, j, fi, fj;
+	int a, b, c, d;
+
+	sum = ipa + n2o;
+	if (sum == 0)
+		return pgm_read_byte(&pc_table[0][0]);
+	flow = (sum * PC_FLOW_MUL) >> PC_SHIFT;
+	mix = ((unsigned int)n2o << 8) / sum;
+	i = physics_pc_cell(flow, PC_FLOW_POINTS, &fi);
+	j = physics_pc_cell(mix, PC_MIX_POINTS, &fj);
+
+	a = pgm_read_byte(&pc_table[i][j]);
+	b = pgm_read_byte(&pc_table[i + 1][j]);
+	c = pgm_read_byte(&pc_table[i][j + 1]);
+	d = pgm_read_byte(&pc_table[i + 1][j + 1]);
+	a += ((b - a) * fi + PC_HALF) >> PC_SHIFT;
+	c += ((d - c) * fi + PC_HALF) >> PC_SHIFT;
+	return a + (((c - a) * fj + PC_HALF) >> PC_SHIFT);
+}
+
+// pct is 0 to 100
+static inline int physics_chamber_pct_of(int pct) {
+	return pgm_read_byte(&chamber_pct_table.v[pct]);
+}
+
+// pct is 0 to CHAMBER_PCT_TOP
+static inline int physics_chamber_p_of(int pct) {
+	return pgm_read_word(&chamber_p_table.v[pct]);
+}
+
+/*
+ * Use up propellant: pct hundredths of a unit of *level, carrying the
+ * remainder in *frac.  *frac stays under 100 and pct is at most 100,
+ * so at most one unit goes at a time and no divide is needed.
+ */
+static inline void physics_consume(int *level, int *frac, int pct) {
+	*frac += pct;
+	if (*frac >= 100) {
+		*frac -= 100;
+		(*level)--;
+	}
+}
+
+/*
+ * Pressure dynamics, one step per millisecond
+ */
+extern void physics_reset();
+extern int physics_ig(int target);
+extern int physics_chamber(int pct, int ig_p);
+extern bool physics_lit();
+
+/*
+ * Time taken by physics steps, as measured by the caller
+ */
+extern void physics_time(unsigned int timer1_ticks);
+extern void physics_to_serial();
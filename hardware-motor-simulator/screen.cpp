@@ -0,0 +1,111 @@
+/*
+ * LCD framebuffer
+ *
+ * The display is slow: clear() takes about 1.5 ms, and each character
+ * or cursor move about 40 us, all spent waiting.  So drawing goes into
+ * frame[], a copy of the screen in RAM, and screen_flush() sends the
+ * cells that differ from what the display shows (shown[]).
+ *
+ * screen_flush() runs once a loop and stops starting new cells after
+ * SCREEN_BUDGET_US, so a screen update costs the loop at most that plus
+ * one cell.  A full redraw trickles out over a few milliseconds.  The
+ * cursor is only moved when the next changed cell isn't where the
+ * display's cursor already is.
+ *
+ * Rows with changes are marked in frame_dirty, so a quiet screen costs
+ * next to nothing.
+ */
+
+#include <Arduino.h>
+#include <LiquidCrystal.h>
+#include "screen.h"
+#include "pins.h"
+
+Screen lcd;
+
+static LiquidCrystal panel(PIN_LCD_RS, PIN_LCD_EN, PIN_LCD_D4, PIN_LCD_D5, PIN_LCD_D6, PIN_LCD_D7);
+
+static char frame[SCREEN_ROWS][SCREEN_COLS];
+static char shown[SCREEN_ROWS][SCREEN_COLS];
+static unsigned char frame_dirty;	// bit per row
+static unsigned char frame_row, frame_col;	// where lcd.print() goes next
+static unsigned char panel_row, panel_col;	// the display's cursor
+
+#define	NOWHERE		0xff
+
+void Screen::begin(unsigned char cols, unsigned char rows) {
+	unsigned char r, c;
+
+	panel.begin(cols, rows);
+	for (r = 0; r < SCREEN_ROWS; r++)
+		for (c = 0; c < SCREEN_COLS; c++)
+			shown[r][c] = ' ';
+	panel_row = 0;
+	panel_col = 0;
+	clear();
+}
+
+void Screen::clear() {
+	unsigned char r, c;
+
+	for (r = 0; r < SCREEN_ROWS; r++)
+		for (c = 0; c < SCREEN_COLS; c++)
+			frame[r][c] = ' ';
+	frame_dirty = (1 << SCREEN_ROWS) - 1;
+	frame_row = 0;
+	frame_col = 0;
+}
+
+void Screen::setCursor(unsigned char col, unsigned char row) {
+	frame_row = row;
+	frame_col = col;
+}
+
+/*
+ * Past the end of a line the display runs on the way the HD44780's
+ * display RAM is laid out on a 20x4 panel: row 0 into row 2, 2 into 1,
+ * 1 into 3, and 3 back round into 0.  So does this, so frame[] holds
+ * what the panel would show.
+ */
+static const unsigned char next_row[SCREEN_ROWS] = { 2, 3, 1, 0 };
+
+size_t Screen::write(uint8_t c) {
+	if (frame_col >= SCREEN_COLS && frame_row < SCREEN_ROWS) {
+		frame_col -= SCREEN_COLS;
+		frame_row = next_row[frame_row];
+	}
+	if (frame_row < SCREEN_ROWS && frame_col < SCREEN_COLS &&
+	    frame[frame_row][frame_col] != (char)c) {
+		frame[frame_row][frame_col] = c;
+		frame_dirty |= 1 << frame_row;
+	}
+	if (frame_col < 0xff)
+		frame_col++;
+	return 1;
+}
+
+void screen_flush() {
+	unsigned long start;
+	unsigned char r, c;
+
+	if (!frame_dirty)
+		return;
+	start = micros();
+	for (r = 0; r < SCREEN_ROWS; r++) {
+		if (!(frame_dirty & (1 << r)))
+			continue;
+		for (c = 0; c < SCREEN_COLS; c++) {
+			if (frame[r][c] == shown[r][c])
+				continue;
+			if (micros() - start >= SCREEN_BUDGET_US)
+				return;
+			if (r != panel_row || c != panel_col)
+				panel.setCursor(c, r);
+			panel.write(frame[r][c]);
+			shown[r][c] = frame[r][c];
+			panel_row = r;
+			panel_col = c + 1 < SCREEN_COLS? c + 1: NOWHERE;
+		}
+		frame_dirty &= ~(1 << r);
+	}
+}
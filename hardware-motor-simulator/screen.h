@@ -0,0 +1,24 @@
+/*
+ * The LCD screen, in RAM.  See screen.cpp.
+ *
+ * Screen has the parts of LiquidCrystal the drawing code uses, so
+ * lcd.print() and friends work as before; they just don't touch the
+ * display.  outputs() calls screen_flush() to catch the display up.
+ */
+
+#include <Arduino.h>
+
+#define	SCREEN_COLS		20
+#define	SCREEN_ROWS		4
+#define	SCREEN_BUDGET_US	200	// most time screen_flush() starts cells in
+
+class Screen : public Print {
+public:
+	void begin(unsigned char cols, unsigned char rows);
+	void clear();
+	void setCursor(unsigned char col, unsigned char row);
+	size_t write(uint8_t c);
+	using Print::write;
+};
+
+extern void screen_flush();
@@ -1,212 +1,189 @@
 /*
  * This routine services the servo input interrupts and keeps track of
  * the servo pulse widths.
+ *
+ * The interrupts do as little as possible: each edge latches Timer1 and
+ * the pin level, and a falling edge stores the pulse (rising and falling
+ * counts) in a small ring.  Timer1 runs free at 2 MHz, so the counts
+ * have half microsecond resolution and the 16-bit subtraction handles
+ * wrap-around for any pulse or frame shorter than 32 ms.
+ *
+ * Converting the width to degrees happens in servo_read(), in the loop.
+ * Pulses are numbered by an 8-bit count that the interrupt bumps after
+ * storing each one, as in adc.cpp, so readers copy a pulse and then
+ * check it wasn't overwritten rather than turning off interrupts.
+ *
+ * NOTE: Timer1 belongs to this module.  Nothing else may use it
+ * (no Servo library, no analogWrite() on pins 9 or 10).
  */
 
 #include "Arduino.h"
 #include "io_ref.h"
 #include "pins.h"
-
-#define	SERVO_MIN	544UL
-#define	SERVO_MAX	2400UL
-#define	SERVO_ERROR	10UL
-#define MIN_CHANGE	8		// minimum change that we ignore.  Min possible change is 4 uSec
-#define MAX_TIME_SINCE	((unsigned char)5) // units are 16 milliseconds
-#define	DEGREES_ERROR	255		// flag value
+#include "servo.h"
+#include "trace.h"
 
 /*
  * Externally visible
  *
- * Usage:
- * 	Can just read the _degrees variable.  That gives the last
- * 	valid reading, or DEGREES_ERROR value if none.
- *
- * 	Last valid short variables contain the value (millis()>>4)&0xff
- * 	of last reading.
+ * The pulse width of the last pulse servo_read() looked at, in
+ * microseconds.  Used for test routines only.
  */
-volatile int input_ipa_servo;			// pulse width in microseconds
-volatile int input_n2o_servo;			// used for test routine only
-volatile unsigned char input_ipa_servo_degrees;	// servo position in degrees
-volatile unsigned char input_n2o_servo_degrees;
-volatile bool ipa_servo_change;	
-volatile bool n2o_servo_change;
-volatile unsigned char ipa_last_valid_short;
-volatile unsigned char n2o_last_valid_short;
-volatile unsigned char ipa_last_last_valid_short;
-volatile unsigned char n2o_last_last_valid_short;
+int input_ipa_servo;
+int input_n2o_servo;
 
 /*
  * Internal variables.
  */
-static unsigned long ipa_raise_time;
-static unsigned long n2o_raise_time;
-static volatile bool ipa_valid;
-static volatile bool n2o_valid;
-static volatile unsigned long ipa_last_valid;
-static volatile unsigned long n2o_last_valid;
-static bool ipa_waiting;
-static bool n2o_waiting;
+static volatile struct servo_capture_s servo_ring[SERVO_N_CHANNELS][SERVO_RING];
+static volatile unsigned char servo_counts[SERVO_N_CHANNELS];
+static volatile unsigned int servo_rise[SERVO_N_CHANNELS];
+static volatile bool servo_high[SERVO_N_CHANNELS];	// seen the rising edge
+
+// for servo_read()
+static unsigned char servo_seen[SERVO_N_CHANNELS];	// count at the last new pulse
+static unsigned long servo_seen_time[SERVO_N_CHANNELS];
+static bool servo_any[SERVO_N_CHANNELS];		// ever seen a pulse
 
 extern unsigned long loop_time;
 
-// ISR for IPA servo pin change
-static void ipa_isr() {
-	unsigned long w;
-	unsigned char c;
+static inline void i_edge(unsigned char ch, unsigned int t, bool high) {
+	volatile struct servo_capture_s *c;
+	unsigned char n;
 
-	// on rising edge record time and mark state
-	if (digitalRead(PIN_MAIN_IPA)) {
-		ipa_raise_time = micros();
-		ipa_valid = true;
+	if (high) {
+		servo_rise[ch] = t;
+		servo_high[ch] = true;
 		return;
 	}
 
 	// on falling edge, if no rising edge, do nothing.
-	if (!ipa_valid)
-		return;
-
-	ipa_valid = false;
-
-	// Note that an out-of-range pulse width is considered a valid result
-	ipa_last_valid = millis();
-	c = ((ipa_last_valid >> 4) & 0xff);
-
-	// compute the pulse width
-	// unsigned math should handle wrap-around
-	w = micros() - ipa_raise_time;
-
-	// Note that each run through the ISR changes last_valid_short.
-	if (c == ipa_last_valid_short)
-		c--;
-	ipa_last_valid_short = c;
-
-	/*
-	 * Bounds check on servo pulse width
-	 */
-	if (w < SERVO_MIN - SERVO_ERROR || w > SERVO_MAX + SERVO_ERROR) {
-		input_ipa_servo_degrees = DEGREES_ERROR;
+	if (!servo_high[ch])
 		return;
-	}
-
-	if (w < SERVO_MIN)
-		w = SERVO_MIN;
+	servo_high[ch] = false;
 
-	if (w > SERVO_MAX)
-		w = SERVO_MAX;
+	n = servo_counts[ch] + 1;
+	c = &servo_ring[ch][n & (SERVO_RING - 1)];
+	c->rise = servo_rise[ch];
+	c->fall = t;
+	servo_counts[ch] = n;
+}
 
-	c = ((w - SERVO_MIN) * 180UL) / (SERVO_MAX-SERVO_MIN);
-	input_ipa_servo_degrees = ((w - SERVO_MIN) * 180UL) / (SERVO_MAX-SERVO_MIN);
+// ISR for IPA servo pin change
+static void ipa_isr() {
+	i_edge(SERVO_IPA, TCNT1, PIND & _BV(PIN_MAIN_IPA));
 }
 
 // ISR for N2O servo pin change
 static void n2o_isr() {
-	unsigned long w;
-	unsigned char c;
-
-	// on rising edge record time and mark state
-	if (digitalRead(PIN_MAIN_IPA)) {
-		n2o_raise_time = micros();
-		n2o_valid = true;
-		return;
-	}
-
-	// on falling edge, if no rising edge, do nothing.
-	if (!n2o_valid)
-		return;
-
-	n2o_valid = false;
+	i_edge(SERVO_N2O, TCNT1, PIND & _BV(PIN_MAIN_N2O));
+}
 
-	// Note that an out-of-range pulse width is considered a valid result
-	n2o_last_valid = millis();
-	c = ((n2o_last_valid >> 4) & 0xff);
+void servo_setup() {
+	unsigned char ch;
 
-	// compute the pulse width
-	// unsigned math should handle wrap-around
-	w = micros() - n2o_raise_time;
+	pinMode(PIN_MAIN_IPA, INPUT);
+	pinMode(PIN_MAIN_N2O, INPUT);
 
-	// Note that each run through the ISR changes last_valid_short.
-	if (c == n2o_last_valid_short)
-		c--;
-	n2o_last_valid_short = c;
+	// Timer1 free running at clk / 8
+	TCCR1A = 0;
+	TCCR1B = _BV(CS11);
 
-	/*
-	 * Bounds check on servo pulse width
-	 */
-	if (w < SERVO_MIN - SERVO_ERROR || w > SERVO_MAX + SERVO_ERROR) {
-		input_n2o_servo_degrees = DEGREES_ERROR;
-		return;
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++) {
+		servo_counts[ch] = 0;
+		servo_high[ch] = false;
+		servo_seen[ch] = 0;
+		servo_any[ch] = false;
 	}
+	attachInterrupt(digitalPinToInterrupt(PIN_MAIN_IPA), ipa_isr, CHANGE);
+	attachInterrupt(digitalPinToInterrupt(PIN_MAIN_N2O), n2o_isr, CHANGE);
+}
 
-	if (w < SERVO_MIN)
-		w = SERVO_MIN;
-
-	if (w > SERVO_MAX)
-		w = SERVO_MAX;
+/*
+ * Read Timer1 from the loop.  The two bytes of a 16-bit read go through
+ * the one TEMP register the servo ISRs also use, so an edge between
+ * them would tear the count.
+ */
+unsigned int servo_tcnt1() {
+	unsigned int t;
 
-	c = ((w - SERVO_MIN) * 180UL) / (SERVO_MAX-SERVO_MIN);
-	input_n2o_servo_degrees = ((w - SERVO_MIN) * 180UL) / (SERVO_MAX-SERVO_MIN);
+	noInterrupts();
+	t = TCNT1;
+	interrupts();
+	return t;
 }
 
-void servo_setup() {
-	pinMode(PIN_MAIN_IPA, INPUT);
-	pinMode(PIN_MAIN_N2O, INPUT);
-	ipa_valid = false;
-	n2o_valid = false;
-	ipa_last_valid_short = 0;
-	n2o_last_valid_short = 0;
-	ipa_last_last_valid_short = 0;
-	n2o_last_last_valid_short = 0;
-	ipa_waiting = true;
-	n2o_waiting = true;
-	attachInterrupt(digitalPinToInterrupt(PIN_MAIN_IPA), ipa_isr, CHANGE);
-	attachInterrupt(digitalPinToInterrupt(PIN_MAIN_N2O), n2o_isr, CHANGE);
+/*
+ * Number of the newest pulse on a channel.  Wraps at 256.
+ */
+unsigned char servo_count(unsigned char ch) {
+	return servo_counts[ch];
 }
 
-
 /*
- * Routines retrieve the servo pulse width in degrees.
- * They return -1 if no recent valid pulse width, and -2 if the pulse is too wide or too narrow
+ * Get pulse number n of a channel.
+ * Returns false if that pulse has been overwritten (or not seen yet).
  */
-unsigned char servo_read_ipa() {
-	unsigned char d;
+bool servo_capture(unsigned char ch, unsigned char n, struct servo_capture_s *c) {
+	if ((unsigned char)(servo_counts[ch] - n) >= SERVO_RING)
+		return false;
+	c->rise = servo_ring[ch][n & (SERVO_RING - 1)].rise;
+	c->fall = servo_ring[ch][n & (SERVO_RING - 1)].fall;
+	return (unsigned char)(servo_counts[ch] - n) < SERVO_RING;
+}
 
-	// If we've not seen anything for awhile, say so
-	if (ipa_waiting && ipa_last_valid == ipa_last_last_valid_short)
-		return -1;
+/*
+ * Retrieve the servo position in degrees.
+ * Returns -1 if no recent pulse, and -2 if the pulse is too wide or too narrow.
+ */
+int servo_read(unsigned char ch) {
+	struct servo_capture_s c;
+	unsigned char n;
+	unsigned long w;
 
-	ipa_waiting = false;
+	n = servo_counts[ch];
+	if (n != servo_seen[ch]) {
+		servo_seen[ch] = n;
+		servo_seen_time[ch] = loop_time;
+		servo_any[ch] = true;
+	}
 
-	if (((millis() >> 4) && 0xff) - ipa_last_valid_short >= MAX_TIME_SINCE) {
-		ipa_waiting = true;
-		ipa_last_last_valid_short = ipa_last_valid_short;
+	// If we've not seen anything for awhile, say so
+	if (!servo_any[ch] || loop_time - servo_seen_time[ch] >= SERVO_TIMEOUT) {
+		trace_servo_lost(ch);
 		return -1;
 	}
 
-	d = input_ipa_servo_degrees;
-	if (d == DEGREES_ERROR)
-		return -2;
+	while (!servo_capture(ch, n, &c))
+		n = servo_counts[ch];
+	w = ((c.fall - c.rise) & 0xffff) / SERVO_TICKS_PER_US;	// 16-bit wrap
+	trace_servo(ch, w, c.rise);
 
-	return d;
-}
+	if (ch == SERVO_IPA)
+		input_ipa_servo = w;
+	else
+		input_n2o_servo = w;
 
-unsigned char servo_read_n2o() {
-	unsigned char d;
+	/*
+	 * Bounds check on servo pulse width
+	 */
+	if (w < SERVO_MIN - SERVO_ERROR || w > SERVO_MAX + SERVO_ERROR)
+		return -2;
 
-	// If we've not seen anything for awhile, say so
-	if (n2o_waiting && n2o_last_valid == n2o_last_last_valid_short)
-		return -1;
+	if (w < SERVO_MIN)
+		w = SERVO_MIN;
 
-	n2o_waiting = false;
+	if (w > SERVO_MAX)
+		w = SERVO_MAX;
 
-	if (((millis() >> 4) && 0xff) - n2o_last_valid_short >= MAX_TIME_SINCE) {
-		n2o_waiting = true;
-		n2o_last_last_valid_short = n2o_last_valid_short;
-		return -1;
-	}
+	static_assert(SERVO_DEG_MUL < 0x10000UL, "SERVO_DEG_MUL must fit in 16 bits");
+	return ((unsigned long)(unsigned int)(w - SERVO_MIN) * SERVO_DEG_MUL) >> SERVO_DEG_SHIFT;
+}
 
-	d = input_n2o_servo_degrees;
-	if (d == DEGREES_ERROR)
-		return -2;
+int servo_read_ipa() {
+	return servo_read(SERVO_IPA);
+}
 
-	return d;
+int servo_read_n2o() {
+	return servo_read(SERVO_N2O);
 }
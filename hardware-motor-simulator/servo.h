@@ -0,0 +1,34 @@
+/*
+ * Servo pulse capture.  See servo.cpp.
+ */
+
+#define	SERVO_IPA	0	// main IPA valve, PIN_MAIN_IPA
+#define	SERVO_N2O	1	// main N2O valve, PIN_MAIN_N2O
+#define	SERVO_N_CHANNELS 2
+
+#define	SERVO_MIN	544UL	// pulse widths, microseconds
+#define	SERVO_MAX	2400UL
+#define	SERVO_ERROR	10UL	// slop allowed outside MIN and MAX
+#define	SERVO_TIMEOUT	80		// milliseconds without a pulse before we say so
+
+/*
+ * Degrees for a width w - SERVO_MIN: * 180 / (SERVO_MAX - SERVO_MIN)
+ * done as a 16x16 bit multiply and a shift, which is exact over the
+ * whole range (host/test_tables.cpp checks every width).
+ */
+#define	SERVO_DEG_SHIFT	19
+#define	SERVO_DEG_MUL	(((180UL << SERVO_DEG_SHIFT) + (SERVO_MAX - SERVO_MIN) - 1) / (SERVO_MAX - SERVO_MIN))
+
+#define	SERVO_RING	4	// pulses kept per channel.  Must be a power of 2
+#define	SERVO_TICKS_PER_US 2	// Timer1 runs at 16 MHz / 8
+
+struct servo_capture_s {
+	unsigned int rise;	// Timer1 count at the rising edge
+	unsigned int fall;	// and at the falling edge
+};
+
+extern void servo_setup();
+extern unsigned int servo_tcnt1();
+extern unsigned char servo_count(unsigned char ch);
+extern bool servo_capture(unsigned char ch, unsigned char n, struct servo_capture_s *c);
+extern int servo_read(unsigned char ch);
@@ -0,0 +1,400 @@
+/*
+ * Servo signal analyzer.
+ *
+ * Collects statistics on every pulse of both main valve servo inputs,
+ * for as long as the state runs:
+ * 	pulse count, and pulses outside SERVO_MIN..SERVO_MAX (bad)
+ * 	pulse width min/mean/max and standard deviation (good pulses only)
+ * 	frame period (rising edge to rising edge) min/mean/max
+ * 	longest gap between pulses, in milliseconds
+ * 	a histogram of the change in width from one good pulse to the next
+ *
+ * The histogram has one bucket per power of two Timer1 counts (half
+ * microseconds): bucket 0 is no change, bucket 1 is 0.5 us, bucket 2
+ * is 1 to 1.5 us, bucket 3 is 2 to 3.5 us and so on.  A steady servo
+ * command should land in the first few buckets; the last ones catch
+ * the sequencer actually moving the valve, or glitches.
+ *
+ * Pulses come from the servo.cpp capture rings, which hold four pulses,
+ * so the loop has 80 ms to pick each one up.  If it falls further
+ * behind than that, the missed pulses are counted as lost.
+ *
+ * The screen has four pages, selected with the scroll switch: summary
+ * and histogram for IPA, then for N2O.  It is redrawn a few times a
+ * second.  The action button dumps everything to serial and exits.
+ */
+
+#include <Arduino.h>
+#include "screen.h"
+#include "io_ref.h"
+#include "state.h"
+#include "menu.h"
+#include "buffer.h"
+#include "servo.h"
+
+extern Screen lcd;
+extern unsigned long loop_time;
+
+#define	SA_HIST		8	// histogram buckets; last is 64 counts (32 us) and up
+#define	SA_FRAME_MAX	30	// ms.  Longer gaps aren't frames; Timer1 wraps at 32 ms
+#define	SA_UPDATE	250	// ms between screen updates
+
+struct sa_channel_s {
+	unsigned char seen;		// last capture looked at
+	bool have_last;			// last_rise and last_time are good
+	bool have_last_width;		// last_width is good
+	unsigned int last_rise;		// Timer1 counts
+	unsigned int last_width;
+	unsigned long last_time;	// loop_time of the last pulse
+
+	unsigned long pulses;
+	unsigned long bad;		// out of range
+	unsigned long lost;		// overwritten before we saw them
+
+	unsigned long good;		// width statistics, in Timer1 counts
+	unsigned int w_min;
+	unsigned int w_max;
+	unsigned int w_ref;		// first good width; sums are relative to it
+	long w_sum;
+	unsigned long long w_sq;	// exact, so no precision is lost to a big step
+
+	unsigned long frames;		// frame period, microseconds
+	unsigned int f_min;
+	unsigned int f_max;
+	unsigned long f_sum;
+
+	unsigned long gap_max;		// milliseconds
+	unsigned int hist[SA_HIST];	// saturating counts
+};
+
+static struct sa_channel_s sa[SERVO_N_CHANNELS];
+static unsigned char page;
+static unsigned long next_update_time;
+
+// channel names, 3 chars
+const char sa_name_0[] PROGMEM = "IPA";
+const char sa_name_1[] PROGMEM = "N2O";
+
+const char * const sa_names[] PROGMEM = {
+		sa_name_0,
+		sa_name_1,
+};
+
+static void i_reset() {
+	unsigned char ch;
+	struct sa_channel_s *s;
+
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++) {
+		s = &sa[ch];
+		memset(s, 0, sizeof(*s));
+		s->seen = servo_count(ch);
+		s->w_min = 0xffff;
+		s->f_min = 0xffff;
+	}
+}
+
+static void i_pulse(struct sa_channel_s *s, struct servo_capture_s *c) {
+	unsigned int w, f, d;
+	unsigned long gap;
+	long dw;
+	unsigned char b;
+
+	s->pulses++;
+	w = (c->fall - c->rise) & 0xffff;
+
+	if (s->have_last) {
+		gap = loop_time - s->last_time;
+		if (gap > s->gap_max)
+			s->gap_max = gap;
+		if (gap < SA_FRAME_MAX) {
+			f = ((c->rise - s->last_rise) & 0xffff) / SERVO_TICKS_PER_US;
+			if (f < s->f_min)
+				s->f_min = f;
+			if (f > s->f_max)
+				s->f_max = f;
+			s->f_sum += f;
+			s->frames++;
+		}
+	}
+	s->have_last = true;
+	s->last_rise = c->rise;
+	s->last_time = loop_time;
+
+	if (w < (SERVO_MIN - SERVO_ERROR) * SERVO_TICKS_PER_US ||
+	    w > (SERVO_MAX + SERVO_ERROR) * SERVO_TICKS_PER_US) {
+		s->bad++;
+		s->have_last_width = false;
+		return;
+	}
+
+	if (!s->good)
+		s->w_ref = w;
+	s->good++;
+	if (w < s->w_min)
+		s->w_min = w;
+	if (w > s->w_max)
+		s->w_max = w;
+	dw = (long)w - s->w_ref;
+	s->w_sum += dw;
+	s->w_sq += (unsigned long)(dw * dw);
+
+	if (s->have_last_width) {
+		d = (w > s->last_width)? w - s->last_width: s->last_width - w;
+		for (b = 0; d && b < SA_HIST - 1; b++)
+			d >>= 1;
+		if (s->hist[b] != 0xffff)
+			s->hist[b]++;
+	}
+	s->have_last_width = true;
+	s->last_width = w;
+}
+
+/*
+ * Take every pulse the capture rings have that we haven't seen.
+ */
+static void i_collect() {
+	struct servo_capture_s c;
+	struct sa_channel_s *s;
+	unsigned char ch, n;
+
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++) {
+		s = &sa[ch];
+		n = servo_count(ch);
+		if ((unsigned char)(n - s->seen) > SERVO_RING) {
+			s->lost += (unsigned char)(n - s->seen) - SERVO_RING;
+			s->seen = n - SERVO_RING;
+			s->have_last = false;
+			s->have_last_width = false;
+		}
+		while (s->seen != n) {
+			s->seen++;
+			if (!servo_capture(ch, s->seen, &c)) {
+				s->lost++;
+				s->have_last = false;
+				s->have_last_width = false;
+				continue;
+			}
+			i_pulse(s, &c);
+		}
+	}
+}
+
+/*
+ * Width statistics, in microseconds.  Standard deviation in tenths.
+ */
+static unsigned int i_w_us(unsigned int w) {
+	return w / SERVO_TICKS_PER_US;
+}
+
+static unsigned int i_w_mean(struct sa_channel_s *s) {
+	if (!s->good)
+		return 0;
+	return i_w_us(s->w_ref + s->w_sum / (long)s->good);
+}
+
+/*
+ * Square root, rounded to the nearest
+ */
+static unsigned int i_sqrt(unsigned long x) {
+	unsigned long r, bit;
+
+	r = 0;
+	for (bit = 1UL << 30; bit > x; bit >>= 2)
+		;
+	for (; bit; bit >>= 2) {
+		if (x >= r + bit) {
+			x -= r + bit;
+			r = (r >> 1) + bit;
+		} else
+			r >>= 1;
+	}
+	return x > r? r + 1: r;		// x is what is left over r squared
+}
+
+/*
+ * The variance is (sum of squares - sum squared / n) / n, in Timer1
+ * counts squared; scaled by (10 / SERVO_TICKS_PER_US)^2 its square root
+ * is the deviation in tenths of a microsecond.
+ */
+static unsigned int i_w_sd10(struct sa_channel_s *s) {
+	unsigned long long ss;
+	unsigned long v;
+
+	if (!s->good)
+		return 0;
+	ss = (unsigned long long)((long long)s->w_sum * s->w_sum) / s->good;
+	v = (s->w_sq - ss) * (100 / (SERVO_TICKS_PER_US * SERVO_TICKS_PER_US)) / s->good;
+	return i_sqrt(v);
+}
+
+static unsigned int i_f_mean(struct sa_channel_s *s) {
+	return s->frames? s->f_sum / s->frames: 0;
+}
+
+/*
+ * The longest gap, counting the one we may be in now.
+ */
+static unsigned long i_gap(struct sa_channel_s *s) {
+	unsigned long g;
+
+	if (!s->have_last)
+		return s->gap_max;
+	g = loop_time - s->last_time;
+	return (g > s->gap_max)? g: s->gap_max;
+}
+
+/*
+ * Dump everything in a form that is easy to read and easy to parse.
+ */
+static void i_to_serial() {
+	struct sa_channel_s *s;
+	unsigned char ch, j;
+
+	Serial.print(F("Servo analyzer:\n"));
+	Serial.print(F("ch pulses bad lost wmin wmean wmax wsd(0.1us) fmin fmean fmax gap(ms) hist(log2 0.5us)\n"));
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++) {
+		s = &sa[ch];
+		strcpy_P(buffer, (char*)pgm_read_word(&(sa_names[ch])));
+		Serial.print(buffer);
+		Serial.print(' ');
+		Serial.print(s->pulses);
+		Serial.print(' ');
+		Serial.print(s->bad);
+		Serial.print(' ');
+		Serial.print(s->lost);
+		Serial.print(' ');
+		Serial.print(s->good? i_w_us(s->w_min): 0);
+		Serial.print(' ');
+		Serial.print(i_w_mean(s));
+		Serial.print(' ');
+		Serial.print(i_w_us(s->w_max));
+		Serial.print(' ');
+		Serial.print(i_w_sd10(s));
+		Serial.print(' ');
+		Serial.print(s->frames? s->f_min: 0);
+		Serial.print(' ');
+		Serial.print(i_f_mean(s));
+		Serial.print(' ');
+		Serial.print(s->f_max);
+		Serial.print(' ');
+		Serial.print(i_gap(s));
+		for (j = 0; j < SA_HIST; j++) {
+			Serial.print(' ');
+			Serial.print(s->hist[j]);
+		}
+		Serial.print('\n');
+	}
+}
+
+#define	N_PAGES	(2 * SERVO_N_CHANNELS)
+
+static void i_line(unsigned char row) {
+	lcd.setCursor(0, row);
+	lcd.print(buffer);
+}
+
+/*
+ * Redraw the current page.  Every line is written in full, so there
+ * is no need to clear the screen except when the page changes.
+ */
+static void i_draw() {
+	struct sa_channel_s *s;
+	unsigned int sd;
+	unsigned char j;
+
+	s = &sa[page / 2];
+
+	buffer_zip_short();
+	strcpy_P(buffer, (char*)pgm_read_word(&(sa_names[page / 2])));
+	buffer[3] = ' ';
+
+	// summary: counts, width, frame period, deviation and gap
+	if ((page & 1) == 0) {
+		buffer[4] = 'n';
+		buffer_print_n_l(5, 7, s->pulses);
+		memcpy(buffer + 13, "bad", 3);
+		buffer_print_n_l(16, 3, s->bad);
+		i_line(0);
+
+		buffer_zip_short();
+		buffer[0] = 'W';
+		buffer_print_n_l(2, 5, s->good? i_w_us(s->w_min): 0);
+		buffer_print_n_l(8, 5, i_w_mean(s));
+		buffer_print_n_l(14, 5, i_w_us(s->w_max));
+		i_line(1);
+
+		buffer_zip_short();
+		buffer[0] = 'F';
+		buffer_print_n_l(2, 5, s->frames? s->f_min: 0);
+		buffer_print_n_l(8, 5, i_f_mean(s));
+		buffer_print_n_l(14, 5, s->f_max);
+		i_line(2);
+
+		buffer_zip_short();
+		sd = i_w_sd10(s);
+		memcpy(buffer, "sd", 2);
+		buffer_print_n_l(3, 3, sd / 10);
+		buffer[6] = '.';
+		buffer[7] = '0' + sd % 10;
+		memcpy(buffer + 9, "gap", 3);
+		buffer_print_n_l(13, 6, i_gap(s));
+		i_line(3);
+		return;
+	}
+
+	// histogram, 4 buckets of 5 columns per line
+	memcpy(buffer + 4, "dW log2 .5us", 12);
+	i_line(0);
+	for (j = 0; j < SA_HIST; j++) {
+		if ((j & 3) == 0)
+			buffer_zip_short();
+		buffer_print_n_l((j & 3) * 5, 4, s->hist[j]);
+		if ((j & 3) == 3)
+			i_line(1 + j / 4);
+	}
+	buffer_zip_short();
+	memcpy(buffer, "lost", 4);
+	buffer_print_n_l(5, 7, s->lost);
+	i_line(3);
+}
+
+void servo_analyzer_state(bool first_time) {
+	if (first_time) {
+		page = 0;
+		i_reset();
+		lcd.clear();
+		next_update_time = 0;
+	}
+
+	i_collect();
+
+	if (input_action_button) {
+		input_action_button = false;
+		i_to_serial();
+		state_new(menu_state);
+		return;
+	}
+
+	if (input_scroll_up) {
+		input_scroll_up = false;
+		if (page > 0) {
+			page--;
+			lcd.clear();
+			next_update_time = 0;
+		}
+	}
+
+	if (input_scroll_down) {
+		input_scroll_down = false;
+		if (page < N_PAGES - 1) {
+			page++;
+			lcd.clear();
+			next_update_time = 0;
+		}
+	}
+
+	if (loop_time < next_update_time)
+		return;
+	next_update_time = loop_time + SA_UPDATE;
+	i_draw();
+}
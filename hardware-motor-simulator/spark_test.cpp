@@ -6,13 +6,13 @@
  */
 
 #include <Arduino.h>
-#include <LiquidCrystal.h>
+#include "screen.h"
 #include "io_ref.h"
 #include "state.h"
 #include "menu.h"
 #include "buffer.h"
 
-extern LiquidCrystal lcd;
+extern Screen lcd;
 
 static unsigned long next_update_time;
 extern unsigned long loop_time;
@@ -22,11 +22,11 @@ void spark_test_state(bool first_time) {
 	if (first_time) {
 		lcd.clear();
 		lcd.setCursor(3, 0);
-		lcd.print("Spark Test");
+		lcd.print(F("Spark Test"));
 		lcd.setCursor(0, 2);
-		lcd.print("Spark Sense:");
+		lcd.print(F("Spark Sense:"));
 		lcd.setCursor(0, 2);
-		lcd.print("Spark Value:");
+		lcd.print(F("Spark Value:"));
 		next_update_time = 0;
 	}
 	
@@ -0,0 +1,110 @@
+/*
+ * Stack high water mark, and the "Memory" screen.
+ *
+ * .data and .bss sit at the bottom of the Nano's 2 KB of RAM and the
+ * stack grows down from the top.  Nothing uses malloc, so the RAM in
+ * between is only ever the stack's.  stack_paint(), first thing in
+ * setup(), fills it with STACK_PAINT.  Wherever the stack has been since
+ * is no longer painted, so the painted bytes left above the end of .bss
+ * are the least free stack there has been since boot.  (A push of a byte
+ * that happens to be STACK_PAINT can make it look a byte better.)
+ *
+ * The screen shows the free stack at boot, the least since and now,
+ * and sends them over serial on the way back to the menu.  Full runs
+ * send them at the end of the run.  For what .data and .bss hold, see
+ * make footprint in host/Makefile.
+ */
+
+#include <Arduino.h>
+#include "screen.h"
+#include "io_ref.h"
+#include "state.h"
+#include "menu.h"
+#include "buffer.h"
+#include "stack.h"
+
+extern Screen lcd;
+extern unsigned long loop_time;
+extern unsigned char __heap_start[];	// the end of .bss, from the linker
+
+static unsigned int stack_painted;	// free bytes at boot
+static unsigned long next_update_time;
+
+/*
+ * Paint from the end of .bss up to the stack pointer.  Interrupts are
+ * off so that none pushes onto the stack below us meanwhile.
+ */
+void stack_paint() {
+	unsigned char *p, *top;
+
+	noInterrupts();
+	top = (unsigned char *)SP;
+	for (p = __heap_start; p < top; p++)
+		*p = STACK_PAINT;
+	interrupts();
+	stack_painted = top - __heap_start;
+}
+
+/*
+ * The least free stack since boot, in bytes
+ */
+unsigned int stack_free() {
+	unsigned char *p, *end;
+
+	end = __heap_start + stack_painted;
+	for (p = __heap_start; p < end && *p == STACK_PAINT; p++)
+		;
+	return p - __heap_start;
+}
+
+unsigned int stack_now() {
+	return (unsigned char *)SP - __heap_start;
+}
+
+void stack_to_serial() {
+	Serial.print(F("Stack: "));
+	Serial.print(stack_painted);
+	Serial.print(F(" bytes free at boot, "));
+	Serial.print(stack_free());
+	Serial.print(F(" least since, "));
+	Serial.print(stack_now());
+	Serial.print(F(" now\n"));
+}
+
+static void i_line(unsigned char row, const char *label, unsigned char n, unsigned int v) {
+	buffer_zip_short();
+	memcpy(buffer, label, n);
+	buffer_print_n_l(13, 6, v);
+	lcd.setCursor(0, row);
+	lcd.print(buffer);
+}
+
+static void i_draw() {
+	lcd.setCursor(0, 0);
+	lcd.print(F("Memory  free stack"));
+	i_line(1, "At boot:", 8, stack_painted);
+	i_line(2, "Least since:", 12, stack_free());
+	i_line(3, "Now:", 4, stack_now());
+}
+
+/*
+ * Show the free stack, updated every STACK_UPDATE ms.
+ */
+void stack_state(bool first_time) {
+	if (first_time) {
+		lcd.clear();
+		next_update_time = 0;
+	}
+
+	if (input_action_button) {
+		input_action_button = false;
+		stack_to_serial();
+		state_new(menu_state);
+		return;
+	}
+
+	if (loop_time < next_update_time)
+		return;
+	next_update_time = loop_time + STACK_UPDATE;
+	i_draw();
+}
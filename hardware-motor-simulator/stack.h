@@ -0,0 +1,12 @@
+/*
+ * Stack high water mark.  See stack.cpp.
+ */
+
+#define	STACK_PAINT	0xc5		// what free RAM is painted with
+#define	STACK_UPDATE	500		// milliseconds between redraws of the screen
+
+extern void stack_paint();
+extern unsigned int stack_free();
+extern unsigned int stack_now();
+extern void stack_to_serial();
+extern void stack_state(bool first_time);
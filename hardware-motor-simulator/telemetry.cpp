@@ -0,0 +1,89 @@
+/*
+ * Live telemetry
+ *
+ * During a full run the physics hands telem_send() its state every
+ * telem_period milliseconds, and the selected channels go out as a
+ * FRAME_TELEMETRY frame (see frame.h):
+ * 	sequence number, 8 bits
+ * 	simulated time, milliseconds, 32 bits
+ * 	telem_channels
+ * 	each selected channel, 16 bits
+ *
+ * Frames are only sent if they fit in the serial transmit buffer as it
+ * stands, which the UART interrupt empties while the loop goes on.  If
+ * there is no room the frame is dropped and counted; the physics never
+ * waits for the serial port.  The sequence number counts dropped frames
+ * too, so the receiver can see the gaps.
+ *
+ * At 500000 baud a frame with all channels takes under half a
+ * millisecond to send.
+ */
+
+#include <Arduino.h>
+#include "telemetry.h"
+#include "frame.h"
+
+unsigned char telem_channels;
+unsigned char telem_period = TELEM_PERIOD;
+unsigned long telem_sent;
+unsigned long telem_dropped;
+
+static unsigned char telem_seq;
+static unsigned char telem_countdown;	// milliseconds to the next frame
+
+void telem_start() {
+	telem_sent = 0;
+	telem_dropped = 0;
+	telem_seq = 0;
+	telem_countdown = telem_period;
+	if (telem_channels)
+		frame_sync();
+}
+
+/*
+ * Called every simulated millisecond; true when a frame is due.  A
+ * countdown rather than a modulo, which is a library divide on the AVR.
+ */
+bool telem_due() {
+	if (--telem_countdown)
+		return false;
+	telem_countdown = telem_period;
+	return true;
+}
+
+/*
+ * v has a value for every channel, selected or not.
+ */
+void telem_send(unsigned long t, const int *v) {
+	unsigned char f[6 + 2 * TELEM_N];
+	unsigned char i, n;
+
+	f[0] = telem_seq++;
+	f[1] = t;
+	f[2] = t >> 8;
+	f[3] = t >> 16;
+	f[4] = t >> 24;
+	f[5] = telem_channels;
+	n = 6;
+	for (i = 0; i < TELEM_N; i++) {
+		if (!(telem_channels & (1 << i)))
+			continue;
+		f[n++] = v[i];
+		f[n++] = v[i] >> 8;
+	}
+
+	if (!frame_room(n)) {
+		telem_dropped++;
+		return;
+	}
+	frame_send(FRAME_TELEMETRY, f, n);
+	telem_sent++;
+}
+
+void telem_to_serial() {
+	Serial.print(F("Telemetry: "));
+	Serial.print(telem_sent);
+	Serial.print(F(" frames sent, "));
+	Serial.print(telem_dropped);
+	Serial.print(F(" dropped\n"));
+}
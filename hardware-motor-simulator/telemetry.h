@@ -0,0 +1,28 @@
+/*
+ * Live telemetry during full runs.  See telemetry.cpp.
+ */
+
+/*
+ * Channels, as bit numbers in telem_channels.  A frame carries the
+ * selected channels in this order.
+ */
+#define	TELEM_IG_OUTPUT		0	// simulated igniter pressure, DAC counts
+#define	TELEM_CHAMBER_P		1	// simulated chamber pressure, DAC counts
+#define	TELEM_IPA_SERVO		2	// simulated servo positions, degrees
+#define	TELEM_N2O_SERVO		3
+#define	TELEM_IPA_LEVEL		4	// propellant left
+#define	TELEM_N2O_LEVEL		5
+#define	TELEM_N			6
+
+#define	TELEM_ALL		((1 << TELEM_N) - 1)
+#define	TELEM_PERIOD		5	// default milliseconds between frames
+
+extern unsigned char telem_channels;	// 0 for none
+extern unsigned char telem_period;	// milliseconds of simulated time
+extern unsigned long telem_sent;
+extern unsigned long telem_dropped;	// frames there was no room for
+
+extern void telem_start();
+extern bool telem_due();
+extern void telem_send(unsigned long t, const int *v);
+extern void telem_to_serial();
@@ -0,0 +1,85 @@
+/*
+ * Fixed rate physics tick.
+ *
+ * Timer2 interrupts once a millisecond and counts ticks.  The simulation
+ * asks how many ticks have gone by since it last asked, and runs that
+ * many 1 ms steps.  So when a loop takes longer than a millisecond the
+ * simulation catches up instead of skipping steps, and simulated time
+ * stays locked to real time.
+ *
+ * Timer0 belongs to millis().  Timer2 runs in CTC mode:
+ * 	16 MHz / 64 = 250 kHz, / 250 = 1 kHz.
+ *
+ * We keep track of how far behind the simulation gets.  If it is more
+ * than TICK_MAX_CATCHUP ticks behind (say the EEPROM is being written),
+ * the extra ticks are counted and dropped rather than simulated in a burst.
+ * The count is 8 bits, so a stall of more than 255 ms is not noticed.
+ */
+
+#include "Arduino.h"
+#include "tick.h"
+
+#define	TICK_OCR	(250 * TICK_MS - 1)
+
+static volatile unsigned char tick_count;	// bumped by the ISR
+static unsigned char tick_seen;			// tick_count at last tick_take()
+
+unsigned long tick_overruns;
+unsigned char tick_worst_lag;
+unsigned long tick_dropped;
+
+ISR(TIMER2_COMPA_vect) {
+	tick_count++;
+}
+
+void tick_setup() {
+	TCCR2A = _BV(WGM21);		// CTC
+	TCCR2B = _BV(CS22);		// clk / 64
+	OCR2A = TICK_OCR;
+	TCNT2 = 0;
+	TIMSK2 = _BV(OCIE2A);
+	tick_start();
+}
+
+/*
+ * Forget any ticks that have gone by and clear the statistics.
+ * Call when the simulation starts.
+ */
+void tick_start() {
+	tick_seen = tick_count;
+	tick_overruns = 0;
+	tick_worst_lag = 0;
+	tick_dropped = 0;
+}
+
+/*
+ * How many ticks have gone by since the last call.
+ * The count is a single byte, so reading it needs no interrupt games.
+ */
+unsigned char tick_take() {
+	unsigned char c, n;
+
+	c = tick_count;
+	n = c - tick_seen;
+	tick_seen = c;
+
+	if (n > 1)
+		tick_overruns++;
+	if (n > tick_worst_lag)
+		tick_worst_lag = n;
+	if (n > TICK_MAX_CATCHUP) {
+		tick_dropped += n - TICK_MAX_CATCHUP;
+		n = TICK_MAX_CATCHUP;
+	}
+	return n;
+}
+
+void tick_to_serial() {
+	Serial.print(F("Physics ticks: "));
+	Serial.print(tick_overruns);
+	Serial.print(F(" overruns, worst lag "));
+	Serial.print(tick_worst_lag);
+	Serial.print(F(" ticks, "));
+	Serial.print(tick_dropped);
+	Serial.print(F(" dropped\n"));
+}
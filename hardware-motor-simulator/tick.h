@@ -0,0 +1,15 @@
+/*
+ * Fixed rate physics tick.  See tick.cpp.
+ */
+
+#define	TICK_MS		1	// milliseconds per tick
+#define	TICK_MAX_CATCHUP 50	// more ticks than this behind and we give up on them
+
+extern unsigned long tick_overruns;	// times more than one tick was pending
+extern unsigned char tick_worst_lag;	// most ticks pending at once
+extern unsigned long tick_dropped;	// ticks thrown away, over TICK_MAX_CATCHUP
+
+extern void tick_setup();
+extern void tick_start();
+extern unsigned char tick_take();
+extern void tick_to_serial();
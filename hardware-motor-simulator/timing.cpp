@@ -0,0 +1,239 @@
+/*
+ * Sequencer timing checker.
+ *
+ * During a full run the milestones of the ignition sequence are timed
+ * where they are seen: the igniter valve edges by the pin change
+ * interrupt (valve_edge.cpp), the spark by the ADC sample that saw it,
+ * igniter pressure by monitor_ig() and the main servos by the physics
+ * step that sees the new command, so to the millisecond and the servo
+ * frame.  At the end of the run the time between pairs of milestones
+ * is checked against the windows in timing.h, and the whole run passes
+ * if every one is inside its window.  A milestone that never happened
+ * fails the windows it is in.
+ *
+ * When the run ends, whether the propellants ran out or it was stopped
+ * with the action button, the results screen shows PASS or FAIL and
+ * each window's measured time in microseconds; the scroll switch pages
+ * through them and the action button goes on to the log.  The results
+ * go to serial too.
+ */
+
+#include <Arduino.h>
+#include "screen.h"
+#include "io_ref.h"
+#include "state.h"
+#include "buffer.h"
+#include "timing.h"
+
+extern Screen lcd;
+
+bool timing_enabled;
+
+static unsigned long mark_time[TM_N];
+static unsigned char marked;		// bit per milestone
+static int servo_start[TM_N];		// first position seen, for the servos
+static unsigned char servo_seen;	// bit per milestone
+
+struct timing_window_s {
+	char name[6];
+	unsigned char from;
+	unsigned char to;
+	long min;
+	long max;
+};
+
+const struct timing_window_s timing_windows[TIMING_N] PROGMEM = {
+	{ "IgVlv", TM_IG_IPA, TM_IG_N2O, TW_IG_SKEW_MIN, TW_IG_SKEW_MAX },
+	{ "Spark", TM_IG_N2O, TM_SPARK, TW_SPARK_MIN, TW_SPARK_MAX },
+	{ "Light", TM_SPARK, TM_IG_GOOD, TW_LIGHT_MIN, TW_LIGHT_MAX },
+	{ "Main", TM_IG_GOOD, TM_MAIN_N2O, TW_MAIN_MIN, TW_MAIN_MAX },
+	{ "MnSkw", TM_MAIN_N2O, TM_MAIN_IPA, TW_MAIN_SKEW_MIN, TW_MAIN_SKEW_MAX },
+};
+
+// how a window came out
+#define	TR_OK		0
+#define	TR_LOW		1
+#define	TR_HIGH		2
+#define	TR_MISSING	3
+
+// 3 chars
+const char tr_0[] PROGMEM = " ok";
+const char tr_1[] PROGMEM = "LOW";
+const char tr_2[] PROGMEM = "HI ";
+const char tr_3[] PROGMEM = "---";
+
+const char * const tr_names[] PROGMEM = {
+		tr_0,
+		tr_1,
+		tr_2,
+		tr_3,
+};
+
+void timing_reset() {
+	marked = 0;
+	servo_seen = 0;
+}
+
+/*
+ * Milestone m happened at us, if it hasn't already.
+ */
+void timing_mark(unsigned char m, unsigned long us) {
+	if (!timing_enabled || (marked & (1 << m)))
+		return;
+	mark_time[m] = us;
+	marked |= 1 << m;
+}
+
+/*
+ * A servo milestone: the servo is commanded to deg.  Returns true when
+ * this is the first move, TIMING_SERVO_DEG from the first command.
+ */
+bool timing_servo(unsigned char m, int deg) {
+	if (!timing_enabled || deg <= 0 || (marked & (1 << m)))
+		return false;
+	if (!(servo_seen & (1 << m))) {
+		servo_start[m] = deg;
+		servo_seen |= 1 << m;
+		return false;
+	}
+	if (abs(deg - servo_start[m]) < TIMING_SERVO_DEG)
+		return false;
+	timing_mark(m, micros());
+	return true;
+}
+
+static void i_window(unsigned char w, struct timing_window_s *tw) {
+	memcpy_P(tw, &timing_windows[w], sizeof(*tw));
+}
+
+/*
+ * The measured time of window w into *d; returns TR_*
+ */
+static unsigned char i_check(unsigned char w, long *d) {
+	struct timing_window_s tw;
+
+	i_window(w, &tw);
+	*d = 0;
+	if (!(marked & (1 << tw.from)) || !(marked & (1 << tw.to)))
+		return TR_MISSING;
+	*d = (long)(mark_time[tw.to] - mark_time[tw.from]);
+	if (*d < tw.min)
+		return TR_LOW;
+	if (*d > tw.max)
+		return TR_HIGH;
+	return TR_OK;
+}
+
+bool timing_pass() {
+	unsigned char w;
+	long d;
+
+	for (w = 0; w < TIMING_N; w++)
+		if (i_check(w, &d) != TR_OK)
+			return false;
+	return true;
+}
+
+void timing_to_serial() {
+	struct timing_window_s tw;
+	unsigned char w, r;
+	long d;
+
+	Serial.print(F("Timing: "));
+	Serial.print(timing_pass()? F("PASS\n"): F("FAIL\n"));
+	Serial.print(F("window us min max result\n"));
+	for (w = 0; w < TIMING_N; w++) {
+		i_window(w, &tw);
+		r = i_check(w, &d);
+		Serial.print(tw.name);
+		Serial.print(' ');
+		if (r == TR_MISSING)
+			Serial.print('-');
+		else
+			Serial.print(d);
+		Serial.print(' ');
+		Serial.print(tw.min);
+		Serial.print(' ');
+		Serial.print(tw.max);
+		Serial.print(' ');
+		strcpy_P(buffer, (char*)pgm_read_word(&(tr_names[r])));
+		Serial.print(buffer[0] == ' '? buffer + 1: buffer);
+		Serial.print('\n');
+	}
+}
+
+/*
+ * The results screen: a title line and three windows a page.
+ */
+#define	N_LINES		3
+#define	N_PAGES		((TIMING_N + N_LINES - 1) / N_LINES)
+
+static unsigned char page;
+
+static void i_draw() {
+	struct timing_window_s tw;
+	unsigned char i, w, r;
+	long d;
+
+	lcd.clear();
+	lcd.print(timing_pass()? F("Timing PASS"): F("Timing FAIL"));
+	buffer_zip_short();
+	buffer[16] = '1' + page;
+	buffer[17] = '/';
+	buffer[18] = '0' + N_PAGES;
+	lcd.setCursor(16, 0);
+	lcd.print(buffer + 16);
+
+	// name, sign, microseconds, result
+	for (i = 0; i < N_LINES; i++) {
+		w = page * N_LINES + i;
+		if (w >= TIMING_N)
+			break;
+		i_window(w, &tw);
+		r = i_check(w, &d);
+		buffer_zip_short();
+		memcpy(buffer, tw.name, strlen(tw.name));
+		if (r != TR_MISSING) {
+			if (d < 0) {
+				buffer[5] = '-';
+				d = -d;
+			}
+			buffer_print_n_l(6, 7, d);
+			memcpy(buffer + 13, "us", 2);
+		}
+		strcpy_P(buffer + 16, (char*)pgm_read_word(&(tr_names[r])));
+		lcd.setCursor(0, i + 1);
+		lcd.print(buffer);
+	}
+}
+
+void timing_state(bool first_time) {
+	extern void log_review_state(bool);
+
+	if (first_time) {
+		page = 0;
+		i_draw();
+	}
+
+	if (input_action_button) {
+		input_action_button = false;
+		state_new(log_review_state);
+		return;
+	}
+
+	if (input_scroll_up) {
+		input_scroll_up = false;
+		if (page > 0) {
+			page--;
+			i_draw();
+		}
+	}
+
+	if (input_scroll_down) {
+		input_scroll_down = false;
+		if (page < N_PAGES - 1) {
+			page++;
+			i_draw();
+		}
+	}
+}
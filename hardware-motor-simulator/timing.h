@@ -0,0 +1,42 @@
+/*
+ * Sequencer timing checker.  See timing.cpp.
+ */
+
+/*
+ * Milestones of the ignition sequence.  Each is timed, in micros(), the
+ * first time it happens in a run.
+ */
+#define	TM_IG_IPA	0	// igniter IPA valve opens
+#define	TM_IG_N2O	1	// igniter N2O valve opens
+#define	TM_SPARK	2	// spark first seen
+#define	TM_IG_GOOD	3	// igniter pressure first good
+#define	TM_MAIN_N2O	4	// main N2O servo first moves
+#define	TM_MAIN_IPA	5	// main IPA servo first moves
+#define	TM_N		6
+
+/*
+ * The spec: windows, in microseconds, for the time from one milestone
+ * to another.  Negative is the second one first.
+ */
+#define	TW_IG_SKEW_MIN		-20000L		// igniter N2O valve after IPA
+#define	TW_IG_SKEW_MAX		20000L
+#define	TW_SPARK_MIN		-100000L	// spark after the igniter N2O valve
+#define	TW_SPARK_MAX		100000L
+#define	TW_LIGHT_MIN		0L		// igniter pressure good after the spark
+#define	TW_LIGHT_MAX		500000L
+#define	TW_MAIN_MIN		100000L		// main N2O servo moves after igniter good
+#define	TW_MAIN_MAX		2000000L
+#define	TW_MAIN_SKEW_MIN	-50000L		// main IPA servo moves after main N2O
+#define	TW_MAIN_SKEW_MAX	50000L
+
+#define	TIMING_N		5	// windows
+#define	TIMING_SERVO_DEG	5	// a servo has moved once it is this far from where it started
+
+extern bool timing_enabled;	// set for full runs
+
+extern void timing_reset();
+extern void timing_mark(unsigned char m, unsigned long us);
+extern bool timing_servo(unsigned char m, int deg);
+extern bool timing_pass();
+extern void timing_to_serial();
+extern void timing_state(bool first_time);
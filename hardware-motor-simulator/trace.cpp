@@ -0,0 +1,192 @@
+/*
+ * Input trace
+ *
+ * During a Trace Run every change in what inputs() and the servo
+ * capture see goes out on serial, timed in micros(), as FRAME_TRACE
+ * frames (see frame.h):
+ * 	sequence number, 8 bits
+ * 	then up to TRACE_RING events of TRACE_EVENT_BYTES each:
+ * 		input (TRACE_*), 8 bits
+ * 		time, micros(), 32 bits
+ * 		value, 16 bits
+ *
+ * Each event is timed the way the firmware saw it: valve edges by the
+ * pin change interrupt, ADC samples by the end of their conversion, the
+ * servo by the rising edge of the first pulse of a new width.  Only what
+ * can change the run is kept: the spark sense when a sample goes in or
+ * out of the spark band, the igniter pressure when inputs() takes a new
+ * value, and that only with a real igniter.  The trace starts with the
+ * levels as they were, and ends with TRACE_END.
+ *
+ * Events wait in a small ring and go out from the loop when the serial
+ * transmit buffer has room, ahead of the telemetry.  If the ring fills,
+ * events are dropped and counted, and the trace can no longer be
+ * replayed exactly.  host/replay runs a trace back through the firmware
+ * and compares the results with the original.
+ */
+
+#include <Arduino.h>
+#include "io_ref.h"
+#include "servo.h"
+#include "valve_edge.h"
+#include "frame.h"
+#include "trace.h"
+
+bool trace_enabled;
+unsigned long trace_events;
+unsigned long trace_dropped;
+
+struct trace_event_s {
+	unsigned char input;
+	unsigned int value;
+	unsigned long time;
+};
+
+static struct trace_event_s trace_ring[TRACE_RING];
+static unsigned char trace_head;	// oldest event
+static unsigned char trace_n;
+static unsigned char trace_seq;
+static bool trace_ig_press;		// the igniter pressure is real
+static unsigned int trace_width[SERVO_N_CHANNELS];
+
+/*
+ * Send up to n of the waiting events in one frame.
+ */
+static void i_send(unsigned char n) {
+	unsigned char f[1 + TRACE_RING * TRACE_EVENT_BYTES];
+	struct trace_event_s *e;
+	unsigned char i, k;
+
+	f[0] = trace_seq++;
+	k = 1;
+	for (i = 0; i < n; i++) {
+		e = &trace_ring[(trace_head + i) & (TRACE_RING - 1)];
+		f[k++] = e->input;
+		f[k++] = e->time;
+		f[k++] = e->time >> 8;
+		f[k++] = e->time >> 16;
+		f[k++] = e->time >> 24;
+		f[k++] = e->value;
+		f[k++] = e->value >> 8;
+	}
+	frame_send(FRAME_TRACE, f, k);
+	trace_head = (trace_head + n) & (TRACE_RING - 1);
+	trace_n -= n;
+}
+
+/*
+ * real_ig is true if the igniter pressure comes from a real sensor
+ * rather than from the simulation.
+ */
+void trace_start(bool real_ig) {
+	unsigned char ch, v;
+	unsigned long t;
+
+	trace_head = 0;
+	trace_n = 0;
+	trace_seq = 0;
+	trace_events = 0;
+	trace_dropped = 0;
+	trace_ig_press = true;		// for the level it starts at
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++)
+		trace_width[ch] = 0;
+	frame_sync();
+
+	t = micros();
+	v = 0;
+	if (input_ig_valve_ipa_level)
+		v |= VALVE_IPA;
+	if (input_ig_valve_n2o_level)
+		v |= VALVE_N2O;
+	trace_input(TRACE_START, t, TRACE_FORMAT);
+	trace_input(TRACE_IG_VALVES, t, v);
+	trace_input(TRACE_SPARK, t, input_spark_sense_A);
+	trace_input(TRACE_IG_PRESS, t, real_ig? input_ig_press: 0);
+	trace_ig_press = real_ig;
+}
+
+void trace_input(unsigned char input, unsigned long t, unsigned int v) {
+	struct trace_event_s *e;
+
+	if (!trace_enabled)
+		return;
+	if (input == TRACE_IG_PRESS && !trace_ig_press)
+		return;
+	if (trace_n == TRACE_RING) {
+		trace_dropped++;
+		return;
+	}
+	e = &trace_ring[(trace_head + trace_n) & (TRACE_RING - 1)];
+	e->input = input;
+	e->time = t;
+	e->value = v;
+	trace_n++;
+	trace_events++;
+}
+
+/*
+ * The servo capture read a pulse of this width, with its rising edge at
+ * Timer1 count rise.
+ */
+void trace_servo(unsigned char ch, unsigned int width, unsigned int rise) {
+	unsigned long t;
+
+	if (!width)
+		width = 1;	// 0 is for no pulses
+	if (!trace_enabled || width == trace_width[ch])
+		return;
+	trace_width[ch] = width;
+	t = micros() - ((servo_tcnt1() - rise) & 0xffff) / SERVO_TICKS_PER_US;	// 16-bit wrap
+	trace_input(ch == SERVO_IPA? TRACE_IPA_SERVO: TRACE_N2O_SERVO, t, width);
+}
+
+/*
+ * The servo capture has seen no pulses for SERVO_TIMEOUT.
+ */
+void trace_servo_lost(unsigned char ch) {
+	if (!trace_enabled || !trace_width[ch])
+		return;
+	trace_width[ch] = 0;
+	trace_input(ch == SERVO_IPA? TRACE_IPA_SERVO: TRACE_N2O_SERVO, micros(), 0);
+}
+
+/*
+ * Send what is waiting, as much as fits in the transmit buffer.
+ * Called from the loop.
+ */
+void trace_flush() {
+	unsigned char n;
+
+	for (n = trace_n; n; n--)
+		if (frame_room(1 + n * TRACE_EVENT_BYTES))
+			break;
+	if (n)
+		i_send(n);
+}
+
+/*
+ * End the trace, and send the rest of it even if that means waiting.
+ */
+void trace_end() {
+	if (!trace_enabled)
+		return;
+	// room for the end, at the cost of an event
+	if (trace_n == TRACE_RING) {
+		trace_n--;
+		trace_events--;
+		trace_dropped++;
+	}
+	trace_input(TRACE_END, micros(), trace_dropped);
+	frame_sync();		// there may have been text
+	while (trace_n)
+		i_send(trace_n);
+	trace_enabled = false;
+}
+
+void trace_to_serial() {
+	Serial.print(F("Trace: "));
+	Serial.print(trace_events);
+	Serial.print(F(" events, "));
+	Serial.print(trace_dropped);
+	Serial.print(F(" dropped\n"));
+}
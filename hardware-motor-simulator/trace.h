@@ -0,0 +1,31 @@
+/*
+ * Input trace during full runs.  See trace.cpp.
+ */
+
+/*
+ * Inputs, the first byte of each event.  The value that goes with each:
+ */
+#define	TRACE_START		0	// TRACE_FORMAT; the trace starts
+#define	TRACE_IG_VALVES		1	// VALVE_IPA | VALVE_N2O levels, from the edge
+#define	TRACE_SPARK		2	// spark sense ADC sample
+#define	TRACE_IG_PRESS		3	// igniter pressure ADC sample, real igniter only
+#define	TRACE_IPA_SERVO		4	// pulse width in us, timed at its rising edge;
+#define	TRACE_N2O_SERVO		5	// 0 when they stop, timed when that is seen
+#define	TRACE_ACTION		6	// action button level, 1 pressed
+#define	TRACE_END		7	// events dropped; the trace ends
+
+#define	TRACE_FORMAT		1
+#define	TRACE_EVENT_BYTES	7	// input, time lo .. hi, value lo, hi
+#define	TRACE_RING		8	// events waiting to be sent
+
+extern bool trace_enabled;	// set for trace runs
+extern unsigned long trace_events;
+extern unsigned long trace_dropped;	// events there was no room for
+
+extern void trace_start(bool real_ig);
+extern void trace_input(unsigned char input, unsigned long t, unsigned int v);
+extern void trace_servo(unsigned char ch, unsigned int width, unsigned int rise);
+extern void trace_servo_lost(unsigned char ch);
+extern void trace_flush();
+extern void trace_end();
+extern void trace_to_serial();
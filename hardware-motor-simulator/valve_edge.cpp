@@ -0,0 +1,114 @@
+/*
+ * Igniter valve edge capture.
+ *
+ * Polling the solenoid lines once per loop puts each edge off by up to
+ * a loop period, which can be milliseconds.  Instead both lines are on
+ * pin change interrupt group 2 (PCINT20 is D4, PCINT21 is D5), and the
+ * interrupt records the time and the new valve levels in a FIFO.
+ * inputs.cpp takes the edges out in order.
+ *
+ * The interrupt only reads micros() and PIND, so an edge is timed to
+ * within a few microseconds however busy the loop is.  The solenoids
+ * are not debounced; every change the interrupt sees is an edge.
+ *
+ * The FIFO indexes are single bytes, the ISR writes only the head and
+ * the loop writes only the tail, so neither side has to turn off
+ * interrupts.  If the FIFO fills, further edges are dropped and counted;
+ * valve_edge_lost() tells the reader to resynchronize from the pins.
+ */
+
+#include "Arduino.h"
+#include "pins.h"
+#include "valve_edge.h"
+
+#define	PCINT_IPA	PCINT20		// PIN_IG_IPA, PD4
+#define	PCINT_N2O	PCINT21		// PIN_IG_N2O, PD5
+
+static volatile struct valve_edge_s fifo[VALVE_EDGE_FIFO];
+static volatile unsigned char fifo_head;	// written by the ISR
+static volatile unsigned char fifo_tail;	// written by the loop
+static volatile unsigned char fifo_lost;	// bumped for each dropped edge
+static unsigned char lost_seen;
+static unsigned char last_levels;		// ISR only
+
+/*
+ * Valve levels from the port.  Both solenoid lines read high when
+ * the valve is commanded open.
+ */
+static inline unsigned char i_levels(unsigned char pind) {
+	unsigned char v;
+
+	v = 0;
+	if (pind & _BV(PIN_IG_IPA))
+		v |= VALVE_IPA;
+	if (pind & _BV(PIN_IG_N2O))
+		v |= VALVE_N2O;
+	return v;
+}
+
+ISR(PCINT2_vect) {
+	unsigned long t;
+	unsigned char v, h;
+
+	t = micros();
+	v = i_levels(PIND);
+	if (v == last_levels)
+		return;		// some other pin in the group
+	last_levels = v;
+
+	h = fifo_head;
+	if ((unsigned char)(h - fifo_tail) >= VALVE_EDGE_FIFO) {
+		fifo_lost++;
+		return;
+	}
+	fifo[h & (VALVE_EDGE_FIFO - 1)].time = t;
+	fifo[h & (VALVE_EDGE_FIFO - 1)].levels = v;
+	fifo_head = h + 1;
+}
+
+void valve_edge_setup() {
+	noInterrupts();
+	last_levels = i_levels(PIND);
+	fifo_head = 0;
+	fifo_tail = 0;
+	fifo_lost = 0;
+	lost_seen = 0;
+	PCMSK2 |= _BV(PCINT_IPA) | _BV(PCINT_N2O);
+	PCIFR = _BV(PCIF2);		// forget anything from before
+	PCICR |= _BV(PCIE2);
+	interrupts();
+}
+
+/*
+ * Take the oldest edge out of the FIFO.  False if there is none.
+ */
+bool valve_edge_take(struct valve_edge_s *e) {
+	unsigned char t;
+
+	t = fifo_tail;
+	if (t == fifo_head)
+		return false;
+	e->time = fifo[t & (VALVE_EDGE_FIFO - 1)].time;
+	e->levels = fifo[t & (VALVE_EDGE_FIFO - 1)].levels;
+	fifo_tail = t + 1;
+	return true;
+}
+
+/*
+ * Valve levels right now, straight from the pins.
+ */
+unsigned char valve_edge_levels() {
+	return i_levels(PIND);
+}
+
+/*
+ * Number of edges dropped since the last call.
+ */
+unsigned char valve_edge_lost() {
+	unsigned char n, l;
+
+	l = fifo_lost;
+	n = l - lost_seen;
+	lost_seen = l;
+	return n;
+}
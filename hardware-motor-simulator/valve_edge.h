@@ -0,0 +1,18 @@
+/*
+ * Igniter valve edge capture.  See valve_edge.cpp.
+ */
+
+#define	VALVE_IPA	0x01	// bits in valve_edge_s.levels
+#define	VALVE_N2O	0x02
+
+#define	VALVE_EDGE_FIFO	8	// edges held.  Must be a power of 2
+
+struct valve_edge_s {
+	unsigned long time;	// micros() at the edge
+	unsigned char levels;	// VALVE_ bits set for valves open after the edge
+};
+
+extern void valve_edge_setup();
+extern bool valve_edge_take(struct valve_edge_s *e);
+extern unsigned char valve_edge_levels();
+extern unsigned char valve_edge_lost();
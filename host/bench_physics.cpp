@@ -0,0 +1,109 @@
+/*
+ * Time the servo and pressure dynamics in physics.cpp and the combustion
+ * table lookup, and check the pressures' step response.
+ *
+ * 	make bench
+ *
+ * The speed is of the host build, so it only compares one version of the
+ * code with another; a Full Run prints the real cost on the Nano.  The
+ * step response is the time, in 1 ms steps, a pressure takes to get 63%
+ * of the way from no pressure to full, which should be about its tau.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "Arduino.h"
+#include "physics.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define	CYCLES()	__rdtsc()
+#else
+#define	CYCLES()	0ULL
+#endif
+
+#define	STEPS	10000000L
+
+static double now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void i_report(const char *what, double ns, unsigned long long cycles, long sum) {
+	printf("%ld %s: %.1f ns each", STEPS, what, ns / STEPS);
+	if (cycles)
+		printf(", %.1f cycles", (double)cycles / STEPS);
+	printf(" (checksum %ld)\n", sum);
+}
+
+/*
+ * Steps until a pressure gets 63% of the way from NO_PRESSURE to full,
+ * averaged over the noise with a few runs.
+ */
+static double rise(bool chamber) {
+	int full, mark, run, n, total, p;
+
+	full = chamber? physics_chamber_p_of(100): IG_PRESS_GOOD + 100;
+	mark = NO_PRESSURE + (full - NO_PRESSURE) * 63 / 100;
+	total = 0;
+	for (run = 0; run < 16; run++) {
+		physics_reset();
+		for (n = 1; n < 1000; n++) {
+			if (chamber)
+				p = physics_chamber(100, IG_PRESS_GOOD);
+			else
+				p = physics_ig(full);
+			if (p >= mark)
+				break;
+		}
+		total += n;
+	}
+	return total / 16.0;
+}
+
+int main() {
+	unsigned long long c0, c1;
+	double t0, t1;
+	long i;
+	struct physics_servo_s ipa = { 0, 0, 0 }, n2o = { 0, 0, 0 };
+	long sum;
+	int ig, a, b;
+
+	physics_reset();
+	sum = 0;
+	t0 = now_ns();
+	c0 = CYCLES();
+	for (i = 0; i < STEPS; i++) {
+		// the valves wander about, so the servos and pressures keep moving
+		physics_servo(&ipa, (i >> 8) & 1? IPA_SERVO_MAX: IPA_SERVO_MIN);
+		physics_servo(&n2o, (i >> 7) & 1? N2O_SERVO_MAX: N2O_SERVO_MIN);
+		ig = physics_ig((i >> 6) & 1? IG_PRESS_GOOD + 50: NO_PRESSURE);
+		sum += physics_chamber(physics_chamber_pct_of(physics_pc_pct(physics_ipa_pct(ipa.pos), physics_n2o_pct(n2o.pos))), ig);
+	}
+	c1 = CYCLES();
+	t1 = now_ns();
+
+	i_report("steps", t1 - t0, c1 - c0, sum);
+
+	// the combustion table alone, over every pair of valve percentages
+	sum = 0;
+	t0 = now_ns();
+	c0 = CYCLES();
+	a = b = 0;
+	for (i = 0; i < STEPS; i++) {
+		sum += physics_pc_pct(a, b);
+		if (++a > 100) {
+			a = 0;
+			b = b < 100? b + 1: 0;
+		}
+	}
+	c1 = CYCLES();
+	t1 = now_ns();
+	i_report("combustion lookups", t1 - t0, c1 - c0, sum);
+
+	printf("igniter 63%% rise: %.1f ms, tau %d ms\n", rise(false), IG_TAU_FILL);
+	printf("chamber 63%% rise: %.1f ms, tau %d ms\n", rise(true), CHAMBER_TAU_FILL);
+	return 0;
+}
@@ -0,0 +1,219 @@
+/*
+ * RAM and flash footprint of the firmware, from its ELF files.
+ *
+ * Given the object files of an AVR build it prints, for each translation
+ * unit, the bytes in each kind of section:
+ * 	code	.text and the like; flash
+ * 	progmem	PROGMEM tables and F() strings; flash
+ * 	data	initialized variables; RAM, with a copy in flash
+ * 	rodata	constants and string literals not in PROGMEM.  On the AVR
+ * 		these are copied to RAM like .data
+ * 	bss	zeroed variables, including common symbols; RAM
+ * 	RAM	data + rodata + bss
+ * The rows are sorted by RAM.  The per-unit numbers come from the object
+ * files rather than the linked ELF because string literals have no
+ * symbols in it; the linked ELF, if given, gives the totals, what the
+ * linker kept, and the libraries.  What RAM is left is what the stack
+ * has; the Memory screen shows how much of it the stack has used.
+ *
+ * Usage: footprint [-r bytes] [-f bytes] file.o ... [firmware.elf]
+ * 	-r bytes	RAM size (default 2048, the ATmega328P)
+ * 	-f bytes	flash for the sketch (default 30720, with the bootloader)
+ *
+ * make footprint builds the firmware with arduino-cli and runs this on
+ * it.  It reads 32 and 64-bit little endian ELF, so it also runs on the
+ * host objects, though those sizes are not the Nano's.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <elf.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define	RAM_SIZE	2048
+#define	FLASH_SIZE	30720
+
+#define	FP_CODE		0
+#define	FP_PROGMEM	1
+#define	FP_DATA		2
+#define	FP_RODATA	3
+#define	FP_BSS		4
+#define	FP_N		5
+
+struct fp_s {
+	std::string name;
+	bool linked;
+	unsigned long n[FP_N];
+};
+
+static const char *fp_heads[FP_N] = { "code", "progmem", "data", "rodata", "bss" };
+
+static unsigned long i_ram(const struct fp_s *f) {
+	return f->n[FP_DATA] + f->n[FP_RODATA] + f->n[FP_BSS];
+}
+
+static unsigned long i_flash(const struct fp_s *f) {
+	return f->n[FP_CODE] + f->n[FP_PROGMEM] + f->n[FP_DATA] + f->n[FP_RODATA];
+}
+
+static bool i_prefix(const char *s, const char *p) {
+	return !strncmp(s, p, strlen(p));
+}
+
+/*
+ * Which kind a loaded section is, or -1 for one that takes no RAM or
+ * flash (.eeprom, and the fuses and such on the AVR)
+ */
+static int i_kind(const char *name, unsigned long type, unsigned long flags) {
+	if (i_prefix(name, ".eeprom") || i_prefix(name, ".fuse") || i_prefix(name, ".lock") ||
+	    i_prefix(name, ".signature"))
+		return -1;
+	if (i_prefix(name, ".progmem"))
+		return FP_PROGMEM;
+	if (type == SHT_NOBITS)
+		return FP_BSS;
+	if (flags & SHF_EXECINSTR)
+		return FP_CODE;
+	if (flags & SHF_WRITE)
+		return FP_DATA;
+	return FP_RODATA;
+}
+
+template <class Ehdr, class Shdr, class Sym>
+static bool i_scan(const std::string &img, struct fp_s *f) {
+	const Ehdr *eh;
+	const Shdr *sh, *s;
+	const Sym *sym;
+	const char *names;
+	size_t i, j;
+	int k;
+
+	eh = (const Ehdr *)img.data();
+	if (eh->e_shoff + (size_t)eh->e_shnum * sizeof(Shdr) > img.size() || eh->e_shstrndx >= eh->e_shnum)
+		return false;
+	sh = (const Shdr *)(img.data() + eh->e_shoff);
+	names = img.data() + sh[eh->e_shstrndx].sh_offset;
+	f->linked = eh->e_type != ET_REL;
+
+	for (i = 0; i < eh->e_shnum; i++) {
+		s = &sh[i];
+		if (s->sh_type == SHT_SYMTAB && s->sh_offset + s->sh_size <= img.size()) {
+			// common symbols get their space from the linker, in .bss
+			sym = (const Sym *)(img.data() + s->sh_offset);
+			for (j = 0; j < s->sh_size / sizeof(Sym); j++)
+				if (sym[j].st_shndx == SHN_COMMON)
+					f->n[FP_BSS] += sym[j].st_size;
+		}
+		if (!(s->sh_flags & SHF_ALLOC) || (k = i_kind(names + s->sh_name, s->sh_type, s->sh_flags)) < 0)
+			continue;
+		f->n[k] += s->sh_size;
+	}
+	return true;
+}
+
+static bool i_read(const char *path, struct fp_s *f) {
+	std::string img;
+	char buf[4096];
+	const char *p;
+	size_t n;
+	FILE *fp;
+
+	if (!(fp = fopen(path, "rb"))) {
+		perror(path);
+		return false;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+		img.append(buf, n);
+	fclose(fp);
+
+	p = strrchr(path, '/');
+	f->name = p? p + 1: path;
+	memset(f->n, 0, sizeof(f->n));
+	if (img.size() < sizeof(Elf32_Ehdr) || memcmp(img.data(), ELFMAG, SELFMAG) ||
+	    img[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "footprint: %s: not a little endian ELF file\n", path);
+		return false;
+	}
+	if (img[EI_CLASS] == ELFCLASS32 && i_scan<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(img, f))
+		return true;
+	if (img[EI_CLASS] == ELFCLASS64 && img.size() >= sizeof(Elf64_Ehdr) &&
+	    i_scan<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(img, f))
+		return true;
+	fprintf(stderr, "footprint: %s: bad ELF headers\n", path);
+	return false;
+}
+
+static bool i_by_ram(const struct fp_s &a, const struct fp_s &b) {
+	if (i_ram(&a) != i_ram(&b))
+		return i_ram(&a) > i_ram(&b);
+	return a.name < b.name;
+}
+
+static void i_row(const struct fp_s *f) {
+	int k;
+
+	printf("%-28s", f->name.c_str());
+	for (k = 0; k < FP_N; k++)
+		printf(" %7lu", f->n[k]);
+	printf(" %7lu\n", i_ram(f));
+}
+
+int main(int argc, char **argv) {
+	std::vector<struct fp_s> units, linked;
+	struct fp_s f, sum;
+	unsigned long ram_size, flash_size, ram, flash;
+	size_t i;
+	int c, k;
+
+	ram_size = RAM_SIZE;
+	flash_size = FLASH_SIZE;
+	while ((c = getopt(argc, argv, "r:f:")) != -1) {
+		switch (c) {
+		case 'r': ram_size = strtoul(optarg, 0, 0); break;
+		case 'f': flash_size = strtoul(optarg, 0, 0); break;
+		default:
+			fprintf(stderr, "usage: %s [-r bytes] [-f bytes] file.o ... [firmware.elf]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc) {
+		fprintf(stderr, "usage: %s [-r bytes] [-f bytes] file.o ... [firmware.elf]\n", argv[0]);
+		return 2;
+	}
+	for (; optind < argc; optind++) {
+		if (!i_read(argv[optind], &f))
+			return 1;
+		(f.linked? linked: units).push_back(f);
+	}
+
+	printf("%-28s", "unit");
+	for (k = 0; k < FP_N; k++)
+		printf(" %7s", fp_heads[k]);
+	printf(" %7s\n", "RAM");
+
+	std::sort(units.begin(), units.end(), i_by_ram);
+	sum.name = "all units";
+	memset(sum.n, 0, sizeof(sum.n));
+	for (i = 0; i < units.size(); i++) {
+		i_row(&units[i]);
+		for (k = 0; k < FP_N; k++)
+			sum.n[k] += units[i].n[k];
+	}
+	if (!units.empty())
+		i_row(&sum);
+	for (i = 0; i < linked.size(); i++)
+		i_row(&linked[i]);
+
+	// the totals are the linked ELF's, if there is one
+	if (!linked.empty())
+		sum = linked.back();
+	ram = i_ram(&sum);
+	flash = i_flash(&sum);
+	printf("\nRAM:   %5lu of %5lu bytes, %ld left for the stack\n", ram, ram_size, (long)ram_size - (long)ram);
+	printf("flash: %5lu of %5lu bytes, %ld left\n", flash, flash_size, (long)flash_size - (long)flash);
+	return 0;
+}
@@ -0,0 +1,88 @@
+/*
+ * Receive binary frames.
+ *
+ * Bytes up to the first zero are other output and are skipped.  After
+ * that every zero ends a frame, which is COBS decoded and CRC checked;
+ * good ones go to on_frame() with the type byte and CRC taken off.
+ */
+
+#include <stdio.h>
+#include "frame_rx.h"
+#include "frame.h"
+
+void frame_rx_init(struct frame_rx_s *rx, void (*on_frame)(void *, unsigned char, const unsigned char *, int), void *ctx) {
+	rx->on_frame = on_frame;
+	rx->ctx = ctx;
+	rx->buf.clear();
+	rx->synced = false;
+	rx->good = rx->bad = rx->skipped = 0;
+}
+
+/*
+ * Undo COBS.  Returns the decoded length, or -1 if the frame is malformed.
+ */
+static int cobs_decode(const unsigned char *p, int n, unsigned char *out) {
+	int i, j, k, code;
+
+	i = j = 0;
+	while (i < n) {
+		code = p[i++];
+		if (code == 0 || i + code - 1 > n)
+			return -1;
+		for (k = 1; k < code; k++)
+			out[j++] = p[i++];
+		if (i < n)
+			out[j++] = 0;
+	}
+	return j;
+}
+
+static void i_frame(struct frame_rx_s *rx) {
+	unsigned char f[256];
+	unsigned crc;
+	int i, len;
+
+	if (rx->buf.size() > sizeof(f) ||
+	    (len = cobs_decode(&rx->buf[0], rx->buf.size(), f)) < 3) {
+		rx->bad++;
+		return;
+	}
+	crc = 0xffff;
+	for (i = 0; i < len - 2; i++)
+		crc = frame_crc(crc, f[i]);
+	if (crc != (unsigned)(f[len - 2] << 8 | f[len - 1])) {
+		rx->bad++;
+		return;
+	}
+	rx->good++;
+	rx->on_frame(rx->ctx, f[0], f + 1, len - 3);
+}
+
+void frame_rx_byte(struct frame_rx_s *rx, unsigned char c) {
+	if (!rx->synced) {
+		if (c)
+			rx->skipped++;
+		else
+			rx->synced = true;
+		return;
+	}
+	if (c) {
+		rx->buf.push_back(c);
+		return;
+	}
+	if (!rx->buf.empty())
+		i_frame(rx);
+	rx->buf.clear();
+}
+
+/*
+ * End of input.  Returns the number of bytes after the last frame,
+ * which may be a frame cut off or just other output.
+ */
+size_t frame_rx_finish(struct frame_rx_s *rx) {
+	size_t n;
+
+	n = rx->buf.size();
+	rx->buf.clear();
+	return n;
+}
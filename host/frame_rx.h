@@ -0,0 +1,23 @@
+/*
+ * Receive the binary frames the firmware sends; see frame.h.
+ */
+
+#ifndef _FRAME_RX_H
+#define _FRAME_RX_H
+
+#include <stddef.h>
+#include <vector>
+
+struct frame_rx_s {
+	void (*on_frame)(void *ctx, unsigned char type, const unsigned char *p, int n);
+	void *ctx;
+	std::vector<unsigned char> buf;	// the frame so far, still COBS encoded
+	bool synced;			// seen a zero yet
+	unsigned long good, bad, skipped;
+};
+
+void frame_rx_init(struct frame_rx_s *rx, void (*on_frame)(void *, unsigned char, const unsigned char *, int), void *ctx);
+void frame_rx_byte(struct frame_rx_s *rx, unsigned char c);
+size_t frame_rx_finish(struct frame_rx_s *rx);
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Host stand-in for <Arduino.h>
+ *
+ * Just enough of the Arduino core for the simulator firmware to compile
+ * and run as a Linux program.  Pins, time and interrupts are all virtual;
+ * see hal.h for the calls the host harness uses to drive them.
+ *
+ * NOTE: millis() and micros() wrap at 32 bits, just like on the Nano.
+ */
+
+#ifndef _HOST_ARDUINO_H
+#define _HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "avr/pgmspace.h"
+#include "avr/io.h"
+#include "avr/interrupt.h"
+
+#define	F_CPU		16000000UL
+
+typedef bool		boolean;
+typedef uint8_t		byte;
+
+#define	HIGH		1
+#define	LOW		0
+
+#define	INPUT		0
+#define	OUTPUT		1
+#define	INPUT_PULLUP	2
+
+#define	CHANGE		1
+#define	FALLING		2
+#define	RISING		3
+
+#define	DEC		10
+#define	HEX		16
+#define	OCT		8
+#define	BIN		2
+
+// Nano pin numbering
+#define	A0		14
+#define	A1		15
+#define	A2		16
+#define	A3		17
+#define	A4		18
+#define	A5		19
+#define	A6		20
+#define	A7		21
+#define	NUM_DIGITAL_PINS	22
+
+#define	digitalPinToInterrupt(p)	((p) == 2? 0: ((p) == 3? 1: -1))
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void attachInterrupt(uint8_t irq, void (*fn)(void), int mode);
+void detachInterrupt(uint8_t irq);
+void noInterrupts();
+void interrupts();
+
+template <class T, class L> static inline auto min(const T &a, const L &b) -> decltype(a < b? a: b)
+{
+	return (b < a)? b: a;
+}
+
+template <class T, class L> static inline auto max(const T &a, const L &b) -> decltype(a < b? a: b)
+{
+	return (a < b)? b: a;
+}
+
+#define	constrain(v, lo, hi)	((v) < (lo)? (lo): ((v) > (hi)? (hi): (v)))
+
+/*
+ * Flash strings are ordinary strings on the host.
+ */
+class __FlashStringHelper;
+#define	F(s)	(reinterpret_cast<const __FlashStringHelper *>(s))
+
+/*
+ * Print: the base for Serial and LiquidCrystal
+ */
+class Print {
+public:
+	virtual ~Print() {}
+	virtual size_t write(uint8_t c) = 0;
+	virtual size_t write(const uint8_t *buf, size_t n);
+	size_t write(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+
+	size_t print(const char *s) { return write(s); }
+	size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+	size_t print(char c) { return write((uint8_t)c); }
+	size_t print(unsigned char v, int base = DEC) { return print((unsigned long)v, base); }
+	size_t print(int v, int base = DEC) { return print((long)v, base); }
+	size_t print(unsigned int v, int base = DEC) { return print((unsigned long)v, base); }
+	size_t print(long v, int base = DEC);
+	size_t print(unsigned long v, int base = DEC);
+	size_t print(double v, int digits = 2);
+
+	size_t println() { return write("\r\n"); }
+	template <class T> size_t println(T v) { size_t n = print(v); return n + println(); }
+	template <class T> size_t println(T v, int f) { size_t n = print(v, f); return n + println(); }
+};
+
+class HardwareSerial : public Print {
+public:
+	void begin(unsigned long baud);
+	void end() {}
+	int available();
+	int read();
+	int peek();
+	void flush();
+	int availableForWrite();
+	size_t write(uint8_t c);
+	using Print::write;
+	operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+// The sketch
+void setup();
+void loop();
+
+#endif
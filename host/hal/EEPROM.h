@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for <EEPROM.h>
+ *
+ * 1K of EEPROM, like the ATmega328P.  The contents are kept in memory and
+ * optionally backed by a file (see hal_eeprom_open()).
+ */
+
+#ifndef _HOST_EEPROM_H
+#define _HOST_EEPROM_H
+
+#include "Arduino.h"
+
+#define	E2END	0x3ff
+
+class EEPROMClass {
+public:
+	uint8_t read(int addr);
+	void write(int addr, uint8_t val);
+	void update(int addr, uint8_t val);
+	uint16_t length() { return E2END + 1; }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for <LiquidCrystal.h>
+ *
+ * Models the HD44780 display RAM, including the way line 0 runs on
+ * into line 2 on a 20x4 display.  hal_lcd_row() reads the screen back.
+ */
+
+#ifndef _HOST_LIQUIDCRYSTAL_H
+#define _HOST_LIQUIDCRYSTAL_H
+
+#include "Arduino.h"
+
+class LiquidCrystal : public Print {
+public:
+	LiquidCrystal(uint8_t rs, uint8_t en, uint8_t d4, uint8_t d5, uint8_t d6, uint8_t d7);
+	void begin(uint8_t cols, uint8_t rows);
+	void clear();
+	void home();
+	void setCursor(uint8_t col, uint8_t row);
+	void display() {}
+	void noDisplay() {}
+	void cursor() {}
+	void noCursor() {}
+	size_t write(uint8_t c);
+	using Print::write;
+};
+
+#endif
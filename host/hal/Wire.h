@@ -0,0 +1,34 @@
+/*
+ * Host stand-in for <Wire.h>
+ *
+ * Transmissions are handed to the I2C device models in wire.cpp.
+ * The only devices on the simulator's bus are the two MCP4725 DACs.
+ */
+
+#ifndef _HOST_WIRE_H
+#define _HOST_WIRE_H
+
+#include "Arduino.h"
+
+#define	WIRE_BUFFER_LENGTH	32
+
+class TwoWire : public Print {
+public:
+	void begin();
+	void setClock(unsigned long hz);
+	void beginTransmission(uint8_t addr);
+	uint8_t endTransmission(bool stop = true);
+	size_t write(uint8_t c);
+	using Print::write;
+	size_t write(unsigned long n) { return write((uint8_t)n); }
+	size_t write(long n) { return write((uint8_t)n); }
+	size_t write(unsigned int n) { return write((uint8_t)n); }
+	size_t write(int n) { return write((uint8_t)n); }
+	uint8_t requestFrom(uint8_t addr, uint8_t n);
+	int available();
+	int read();
+};
+
+extern TwoWire Wire;
+
+#endif
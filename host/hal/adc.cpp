@@ -0,0 +1,51 @@
+/*
+ * Host HAL: ATmega328P ADC model.
+ *
+ * Single conversions only (no auto trigger).  A conversion takes
+ * 13 ADC clocks at the prescaled clock and samples the pin that
+ * ADMUX selects when it starts.
+ */
+
+#include "Arduino.h"
+#include "hal.h"
+#include "irq.h"
+
+#define	F_CPU_MHZ	16
+
+static void adcsra_write(uint8_t old);
+
+hal_reg8 ADMUX = { 0, 0 };
+hal_reg8 ADCSRA = { 0, adcsra_write };
+hal_reg8 ADCSRB = { 0, 0 };
+hal_reg16 ADC = { 0, 0 };
+
+static uint8_t converting_mux;
+
+static void adc_done() {
+	ADC.v = hal_analog_value(A0 + (converting_mux & 0x0f)) & 0x3ff;
+	ADCSRA.v = (ADCSRA.v & ~_BV(ADSC)) | _BV(ADIF);
+	if (ADCSRA.v & _BV(ADIE))
+		hal_irq_raise(HAL_IRQ_ADC);
+}
+
+static void adcsra_write(uint8_t old) {
+	unsigned prescale;
+
+	// writing a one clears the interrupt flag
+	if (ADCSRA.v & _BV(ADIF) & old)
+		ADCSRA.v &= ~_BV(ADIF);
+	if (!(ADCSRA.v & _BV(ADIE)))
+		hal_irq_clear(HAL_IRQ_ADC);
+	if (!(ADCSRA.v & _BV(ADEN))) {
+		ADCSRA.v &= ~_BV(ADSC);
+		hal_event_cancel(HAL_EV_ADC);
+		return;
+	}
+	if ((ADCSRA.v & _BV(ADSC)) && !(old & _BV(ADSC))) {
+		prescale = 1 << (ADCSRA.v & 7);
+		if (prescale < 2)
+			prescale = 2;
+		converting_mux = ADMUX.v;
+		hal_event_at(HAL_EV_ADC, hal_now_us() + (13 * prescale) / F_CPU_MHZ, adc_done);
+	}
+}
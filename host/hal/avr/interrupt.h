@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for <avr/interrupt.h>
+ *
+ * ISR(vector) defines an ordinary function.  The HAL finds the ones the
+ * firmware defines through weak references and calls them when the
+ * peripheral models raise the interrupt.
+ */
+
+#ifndef _HOST_AVR_INTERRUPT_H
+#define _HOST_AVR_INTERRUPT_H
+
+#include "avr/io.h"
+
+#define	ISR(vector, ...)	extern "C" void vector(void)
+
+extern "C" {
+	void PCINT2_vect(void) __attribute__((weak));
+	void TIMER2_COMPA_vect(void) __attribute__((weak));
+	void ADC_vect(void) __attribute__((weak));
+	void EE_READY_vect(void) __attribute__((weak));
+	void TWI_vect(void) __attribute__((weak));
+}
+
+void sei();
+void cli();
+
+#endif
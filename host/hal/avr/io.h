@@ -0,0 +1,192 @@
+/*
+ * Host stand-in for <avr/io.h>
+ *
+ * Only the ATmega328P registers the firmware touches are here.  Each one
+ * is a small object that calls the owning peripheral model when it is
+ * written, so code like "ADCSRA |= _BV(ADSC)" behaves as it does on the
+ * chip.  The peripheral models live in the hal .cpp files.
+ */
+
+#ifndef _HOST_AVR_IO_H
+#define _HOST_AVR_IO_H
+
+#include <stdint.h>
+
+#ifndef _BV
+#define	_BV(bit)	(1 << (bit))
+#endif
+
+struct hal_reg8 {
+	volatile uint8_t v;
+	void (*on_write)(uint8_t old);
+
+	operator uint8_t() const { return v; }
+	hal_reg8 &operator=(unsigned x) {
+		uint8_t old = v;
+		v = (uint8_t)x;
+		if (on_write)
+			on_write(old);
+		return *this;
+	}
+	hal_reg8 &operator=(const hal_reg8 &r) { return *this = (unsigned)r.v; }
+	hal_reg8 &operator|=(unsigned x) { return *this = v | x; }
+	hal_reg8 &operator&=(unsigned x) { return *this = v & x; }
+	hal_reg8 &operator^=(unsigned x) { return *this = v ^ x; }
+};
+
+struct hal_reg16 {
+	volatile uint16_t v;
+	void (*on_write)(uint16_t old);
+	uint16_t (*on_read)();		// for registers that count by themselves
+
+	operator uint16_t() const { return on_read? on_read(): v; }
+	hal_reg16 &operator=(unsigned x) {
+		uint16_t old = v;
+		v = (uint16_t)x;
+		if (on_write)
+			on_write(old);
+		return *this;
+	}
+	hal_reg16 &operator=(const hal_reg16 &r) { return *this = (unsigned)r.v; }
+	hal_reg16 &operator|=(unsigned x) { return *this = v | x; }
+	hal_reg16 &operator&=(unsigned x) { return *this = v & x; }
+};
+
+/*
+ * Status register.  Only the I bit means anything here.
+ */
+extern hal_reg8 SREG;
+#define	SREG_I		7
+
+/*
+ * Stack pointer.  The host's own stack is elsewhere and not the Nano's
+ * size, so the RAM between the end of .bss and the stack is an array,
+ * __heap_start in hal.cpp, with SP staying at the top of it.
+ */
+#define	HAL_FREE_RAM	1024
+uintptr_t hal_sp();
+#define	SP		hal_sp()
+
+/*
+ * ADC
+ */
+extern hal_reg8 ADMUX;
+extern hal_reg8 ADCSRA;
+extern hal_reg8 ADCSRB;
+extern hal_reg16 ADC;
+#define	ADCL		((uint8_t)(ADC & 0xff))
+#define	ADCH		((uint8_t)(ADC >> 8))
+#define	ADCW		ADC
+
+#define	REFS1		7
+#define	REFS0		6
+#define	ADLAR		5
+#define	MUX3		3
+#define	MUX2		2
+#define	MUX1		1
+#define	MUX0		0
+
+#define	ADEN		7
+#define	ADSC		6
+#define	ADATE		5
+#define	ADIF		4
+#define	ADIE		3
+#define	ADPS2		2
+#define	ADPS1		1
+#define	ADPS0		0
+
+/*
+ * TWI (I2C)
+ */
+extern hal_reg8 TWBR;
+extern hal_reg8 TWSR;
+extern hal_reg8 TWAR;
+extern hal_reg8 TWDR;
+extern hal_reg8 TWCR;
+
+#define	TWINT		7
+#define	TWEA		6
+#define	TWSTA		5
+#define	TWSTO		4
+#define	TWWC		3
+#define	TWEN		2
+#define	TWIE		0
+
+#define	TWPS1		1
+#define	TWPS0		0
+
+/*
+ * Port D input and pin change interrupts.  PIND follows the pin levels;
+ * writes to it are ignored.  Only group 2 (port D) is modeled.
+ */
+extern hal_reg8 PIND;
+extern hal_reg8 PCICR;
+extern hal_reg8 PCIFR;
+extern hal_reg8 PCMSK2;
+
+#define	PCIE2		2
+#define	PCIE1		1
+#define	PCIE0		0
+#define	PCIF2		2
+#define	PCIF1		1
+#define	PCIF0		0
+#define	PCINT23		7
+#define	PCINT22		6
+#define	PCINT21		5
+#define	PCINT20		4
+#define	PCINT19		3
+#define	PCINT18		2
+#define	PCINT17		1
+#define	PCINT16		0
+
+/*
+ * EEPROM
+ */
+extern hal_reg16 EEAR;
+extern hal_reg8 EEDR;
+extern hal_reg8 EECR;
+
+#define	EEPM1		5
+#define	EEPM0		4
+#define	EERIE		3
+#define	EEMPE		2
+#define	EEPE		1
+#define	EERE		0
+
+/*
+ * Timer1.  Only normal mode (free running) is modeled; TCNT1 reads
+ * follow the clock.
+ */
+extern hal_reg8 TCCR1A;
+extern hal_reg8 TCCR1B;
+extern hal_reg16 TCNT1;
+
+#define	CS12		2
+#define	CS11		1
+#define	CS10		0
+
+/*
+ * Timer2.  Only CTC mode with the compare A interrupt is modeled.
+ */
+extern hal_reg8 TCCR2A;
+extern hal_reg8 TCCR2B;
+extern hal_reg8 OCR2A;
+extern hal_reg8 OCR2B;
+extern hal_reg8 TCNT2;
+extern hal_reg8 TIMSK2;
+extern hal_reg8 TIFR2;
+
+#define	WGM21		1
+#define	WGM20		0
+#define	WGM22		3
+#define	CS22		2
+#define	CS21		1
+#define	CS20		0
+#define	OCIE2B		2
+#define	OCIE2A		1
+#define	TOIE2		0
+#define	OCF2B		2
+#define	OCF2A		1
+#define	TOV2		0
+
+#endif
@@ -0,0 +1,28 @@
+/*
+ * Host stand-in for <avr/pgmspace.h>
+ *
+ * On the host there is only one address space, so PROGMEM is a no-op and
+ * the pgm_read_* accessors are plain dereferences.  pgm_read_word() keeps
+ * the type of the table element so tables of pointers work on 64-bit hosts.
+ */
+
+#ifndef _HOST_PGMSPACE_H
+#define _HOST_PGMSPACE_H
+
+#include <string.h>
+#include <stdint.h>
+
+#define	PROGMEM
+#define	PSTR(s)			(s)
+
+#define	pgm_read_byte(addr)	(*(const uint8_t *)(addr))
+#define	pgm_read_word(addr)	(*(addr))
+#define	pgm_read_dword(addr)	(*(addr))
+#define	pgm_read_ptr(addr)	(*(addr))
+
+#define	strcpy_P(d, s)		strcpy((d), (s))
+#define	strncpy_P(d, s, n)	strncpy((d), (s), (n))
+#define	strlen_P(s)		strlen(s)
+#define	memcpy_P(d, s, n)	memcpy((d), (s), (n))
+
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Host HAL: EEPROM, optionally backed by a file.
+ *
+ * Erased cells read 0xff.  A write takes 3.3 ms in the background, as on
+ * the chip: EEPROM.write() (and update(), when the cell changes) waits
+ * for the previous write to finish, starts its own and returns.  Reads
+ * wait for a write in progress too.
+ *
+ * The EEAR/EEDR/EECR registers and the EE_READY interrupt are modeled
+ * for firmware that drives the EEPROM itself.  EE_READY is level
+ * triggered: it stays pending while EERIE is set and no write is in
+ * progress.
+ */
+
+#include "EEPROM.h"
+#include "hal.h"
+#include "irq.h"
+
+#define	EEPROM_WRITE_US	3300
+
+EEPROMClass EEPROM;
+
+static void eecr_write(uint8_t old);
+
+hal_reg16 EEAR = { 0, 0 };
+hal_reg8 EEDR = { 0, 0 };
+hal_reg8 EECR = { 0, eecr_write };
+
+static uint8_t ee[E2END + 1];
+static bool ee_ready;
+static const char *ee_path;
+static uint64_t write_done;	// when the write in progress finishes
+
+static void erase() {
+	memset(ee, 0xff, sizeof(ee));
+	ee_ready = true;
+}
+
+/*
+ * Load the EEPROM image from a file.  A missing file is an erased part.
+ */
+bool hal_eeprom_open(const char *path) {
+	FILE *f;
+
+	erase();
+	ee_path = path;
+	f = fopen(path, "rb");
+	if (!f)
+		return false;
+	if (fread(ee, 1, sizeof(ee), f) != sizeof(ee))
+		erase();
+	fclose(f);
+	return true;
+}
+
+void hal_eeprom_save() {
+	FILE *f;
+
+	if (!ee_path)
+		return;
+	f = fopen(ee_path, "wb");
+	if (!f)
+		return;
+	fwrite(ee, 1, sizeof(ee), f);
+	fclose(f);
+}
+
+static void ready_irq() {
+	if ((EECR.v & _BV(EERIE)) && !(EECR.v & _BV(EEPE)))
+		hal_irq_raise(HAL_IRQ_EE_READY);
+	else
+		hal_irq_clear(HAL_IRQ_EE_READY);
+}
+
+static void write_complete() {
+	EECR.v &= ~_BV(EEPE);
+	ready_irq();
+}
+
+static void start_write(int addr, uint8_t val) {
+	if (!ee_ready)
+		erase();
+	ee[addr & E2END] = val;
+	EECR.v |= _BV(EEPE);
+	write_done = hal_now_us() + EEPROM_WRITE_US;
+	hal_event_at(HAL_EV_EEPROM, write_done, write_complete);
+}
+
+/*
+ * Wait for a write in progress.  Without the cost model writes finish
+ * at once.
+ */
+static void wait_ready() {
+	if (!(EECR.v & _BV(EEPE)))
+		return;
+	if (hal_cost_model && write_done > hal_now_us())
+		hal_advance(write_done - hal_now_us());
+	if (EECR.v & _BV(EEPE)) {
+		hal_event_cancel(HAL_EV_EEPROM);
+		write_complete();
+	}
+}
+
+static void eecr_write(uint8_t old) {
+	// EEPE can't be cleared by software
+	if (old & _BV(EEPE))
+		EECR.v |= _BV(EEPE);
+
+	// Setting EEPE starts a write only if EEMPE was already set.
+	if ((EECR.v & _BV(EEPE)) && !(old & _BV(EEPE))) {
+		if (old & _BV(EEMPE))
+			start_write(EEAR.v, EEDR.v);
+		else
+			EECR.v &= ~_BV(EEPE);
+	}
+
+	// EEMPE clears itself four cycles after it is set.  Here it
+	// lasts until the next write to EECR.
+	if (old & _BV(EEMPE))
+		EECR.v &= ~_BV(EEMPE);
+
+	if (EECR.v & _BV(EERE)) {
+		if (!ee_ready)
+			erase();
+		EEDR.v = ee[EEAR.v & E2END];
+		EECR.v &= ~_BV(EERE);
+	}
+	ready_irq();
+}
+
+uint8_t EEPROMClass::read(int addr) {
+	if (!ee_ready)
+		erase();
+	wait_ready();
+	return ee[addr & E2END];
+}
+
+void EEPROMClass::write(int addr, uint8_t val) {
+	wait_ready();
+	start_write(addr, val);
+}
+
+void EEPROMClass::update(int addr, uint8_t val) {
+	if (read(addr) != val)
+		write(addr, val);
+}
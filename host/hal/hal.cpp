@@ -0,0 +1,594 @@
+/*
+ * Host HAL: virtual clock, pins, interrupts and the serial port.
+ */
+
+#include "Arduino.h"
+#include "hal.h"
+#include "irq.h"
+
+bool hal_cost_model = true;
+
+static uint64_t now_us;
+
+/*
+ * Rough costs of blocking calls on a 16 MHz Nano, in microseconds.
+ */
+#define	COST_ANALOG_READ	112
+
+/*
+ * Pins
+ */
+static uint8_t pin_mode[NUM_DIGITAL_PINS];
+static uint8_t pin_out[NUM_DIGITAL_PINS];
+static bool pin_driven[NUM_DIGITAL_PINS];
+static uint8_t pin_ext[NUM_DIGITAL_PINS];
+static int analog_ext[NUM_DIGITAL_PINS];
+
+/*
+ * Interrupts
+ * 	SREG's I bit is the global enable.  Pending interrupts are
+ * 	taken, highest priority first, as soon as they are enabled.
+ * 	ISRs don't nest.
+ */
+static void sreg_write(uint8_t old);
+hal_reg8 SREG = { _BV(SREG_I), sreg_write };
+
+static bool irq_pending[HAL_N_IRQ];
+static bool in_isr;
+
+// INT0 and INT1, via attachInterrupt()
+#define	N_EXT_IRQ	2
+static void (*ext_fn[N_EXT_IRQ])(void);
+static int ext_mode[N_EXT_IRQ];
+
+static void call_vector(int irq) {
+	switch (irq) {
+	case HAL_IRQ_INT0:
+	case HAL_IRQ_INT1:
+		if (ext_fn[irq - HAL_IRQ_INT0])
+			ext_fn[irq - HAL_IRQ_INT0]();
+		break;
+	case HAL_IRQ_PCINT2:
+		if (PCINT2_vect)
+			PCINT2_vect();
+		break;
+	case HAL_IRQ_TIMER2_COMPA:
+		if (TIMER2_COMPA_vect)
+			TIMER2_COMPA_vect();
+		break;
+	case HAL_IRQ_ADC:
+		if (ADC_vect)
+			ADC_vect();
+		break;
+	case HAL_IRQ_EE_READY:
+		if (EE_READY_vect)
+			EE_READY_vect();
+		break;
+	case HAL_IRQ_TWI:
+		if (TWI_vect)
+			TWI_vect();
+		break;
+	}
+}
+
+static void dispatch() {
+	int i;
+
+	while (!in_isr && (SREG.v & _BV(SREG_I))) {
+		for (i = 0; i < HAL_N_IRQ; i++)
+			if (irq_pending[i])
+				break;
+		if (i == HAL_N_IRQ)
+			return;
+		irq_pending[i] = false;
+		in_isr = true;
+		SREG.v &= ~_BV(SREG_I);
+		call_vector(i);
+		SREG.v |= _BV(SREG_I);
+		in_isr = false;
+	}
+}
+
+static void sreg_write(uint8_t old) {
+	(void)old;
+	if (in_isr)
+		return;
+	dispatch();
+}
+
+void hal_irq_raise(int irq) {
+	irq_pending[irq] = true;
+	dispatch();
+}
+
+void hal_irq_clear(int irq) {
+	irq_pending[irq] = false;
+}
+
+bool hal_irq_in_isr() {
+	return in_isr;
+}
+
+void sei() {
+	SREG |= _BV(SREG_I);
+}
+
+void cli() {
+	SREG &= ~_BV(SREG_I);
+}
+
+/*
+ * Free RAM, where the linker's __heap_start would be.  The firmware only
+ * ever paints and counts it.
+ */
+unsigned char __heap_start[HAL_FREE_RAM];
+
+uintptr_t hal_sp() {
+	return (uintptr_t)(__heap_start + HAL_FREE_RAM);
+}
+
+/*
+ * Timed peripheral events
+ */
+static uint64_t event_time[HAL_N_EV];
+static void (*event_fn[HAL_N_EV])();
+
+void hal_event_at(int ev, uint64_t t, void (*fn)()) {
+	event_time[ev] = t;
+	event_fn[ev] = fn;
+}
+
+void hal_event_cancel(int ev) {
+	event_fn[ev] = 0;
+}
+
+void hal_at(uint64_t t, void (*fn)()) {
+	hal_event_at(HAL_EV_HARNESS, t, fn);
+}
+
+/*
+ * Servo pulse generators, one per interrupt pin
+ */
+#define	SERVO_FRAME	20000
+static unsigned int servo_width[N_EXT_IRQ];
+static uint64_t servo_rise[N_EXT_IRQ];	// time of the current rising edge
+
+static int level(uint8_t pin) {
+	if (pin_driven[pin])
+		return pin_ext[pin];
+	if (pin_mode[pin] == INPUT_PULLUP)
+		return HIGH;
+	if (pin_mode[pin] == OUTPUT)
+		return pin_out[pin];
+	return LOW;
+}
+
+/*
+ * Port D pin change interrupts (group 2)
+ */
+static void pcint_write(uint8_t old);
+static void pcifr_write(uint8_t old);
+hal_reg8 PIND = { 0, 0 };
+hal_reg8 PCICR = { 0, pcint_write };
+hal_reg8 PCIFR = { 0, pcifr_write };
+hal_reg8 PCMSK2 = { 0, 0 };
+
+static void pcint_write(uint8_t old) {
+	(void)old;
+	if (!(PCICR.v & _BV(PCIE2)))
+		hal_irq_clear(HAL_IRQ_PCINT2);
+	else if (PCIFR.v & _BV(PCIF2)) {
+		PCIFR.v &= ~_BV(PCIF2);
+		hal_irq_raise(HAL_IRQ_PCINT2);
+	}
+}
+
+static void pcifr_write(uint8_t old) {
+	// writing a one clears the flag
+	PCIFR.v = old & ~PCIFR.v;
+	if (!(PCIFR.v & _BV(PCIF2)))
+		hal_irq_clear(HAL_IRQ_PCINT2);
+}
+
+static void pin_change(uint8_t pin, int v) {
+	if (pin > 7)
+		return;
+	if (v)
+		PIND.v |= _BV(pin);
+	else
+		PIND.v &= ~_BV(pin);
+	if (!(PCMSK2.v & _BV(pin)))
+		return;
+	// taking the interrupt clears the flag
+	if (PCICR.v & _BV(PCIE2))
+		hal_irq_raise(HAL_IRQ_PCINT2);
+	else
+		PCIFR.v |= _BV(PCIF2);
+}
+
+/*
+ * Call after anything that may have changed the level of a pin
+ */
+static void edge(uint8_t pin, int old) {
+	int irq, v;
+
+	irq = digitalPinToInterrupt(pin);
+	v = level(pin);
+	if (v != old)
+		pin_change(pin, v);
+	if (irq < 0 || v == old || !ext_fn[irq])
+		return;
+	if (ext_mode[irq] == RISING && !v)
+		return;
+	if (ext_mode[irq] == FALLING && v)
+		return;
+	hal_irq_raise(HAL_IRQ_INT0 + irq);
+}
+
+static void set_ext(uint8_t pin, bool driven, uint8_t v) {
+	int old;
+
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+	old = level(pin);
+	pin_driven[pin] = driven;
+	pin_ext[pin] = v;
+	edge(pin, old);
+}
+
+static void servo0_edge();
+static void servo1_edge();
+
+static void servo_edge(int i) {
+	if (!pin_ext[2 + i]) {
+		set_ext(2 + i, true, HIGH);
+		hal_event_at(HAL_EV_SERVO0 + i, servo_rise[i] + servo_width[i],
+			i? servo1_edge: servo0_edge);
+	} else {
+		set_ext(2 + i, true, LOW);
+		servo_rise[i] += SERVO_FRAME;
+		hal_event_at(HAL_EV_SERVO0 + i, servo_rise[i],
+			i? servo1_edge: servo0_edge);
+	}
+}
+
+static void servo0_edge() {
+	servo_edge(0);
+}
+
+static void servo1_edge() {
+	servo_edge(1);
+}
+
+void hal_init() {
+	int i;
+
+	now_us = 0;
+	for (i = 0; i < NUM_DIGITAL_PINS; i++) {
+		pin_mode[i] = INPUT;
+		pin_out[i] = LOW;
+		pin_driven[i] = false;
+		analog_ext[i] = 0;
+	}
+	analog_ext[A6] = 512;		// scroll switch centered
+	PIND.v = 0;
+	PCICR.v = 0;
+	PCIFR.v = 0;
+	PCMSK2.v = 0;
+	for (i = 0; i < N_EXT_IRQ; i++) {
+		ext_fn[i] = 0;
+		servo_width[i] = 0;
+	}
+	for (i = 0; i < HAL_N_IRQ; i++)
+		irq_pending[i] = false;
+	for (i = 0; i < HAL_N_EV; i++)
+		event_fn[i] = 0;
+	SREG.v = _BV(SREG_I);
+}
+
+uint64_t hal_now_us() {
+	return now_us;
+}
+
+/*
+ * Move the clock forward, running peripheral events as we go.
+ * Costs charged from inside an ISR or an event are ignored.
+ */
+void hal_advance(uint32_t us) {
+	static bool in_advance;
+	uint64_t target;
+	void (*fn)();
+	int i, next;
+
+	if (in_isr || in_advance)
+		return;
+	in_advance = true;
+	target = now_us + us;
+	for (;;) {
+		next = -1;
+		for (i = 0; i < HAL_N_EV; i++)
+			if (event_fn[i] && event_time[i] <= target &&
+			    (next < 0 || event_time[i] < event_time[next]))
+				next = i;
+		if (next < 0)
+			break;
+		if (event_time[next] > now_us)
+			now_us = event_time[next];
+		fn = event_fn[next];
+		event_fn[next] = 0;
+		fn();
+	}
+	now_us = target;
+	in_advance = false;
+}
+
+void hal_pin_set(uint8_t pin, uint8_t v) {
+	set_ext(pin, true, v? HIGH: LOW);
+}
+
+void hal_pin_release(uint8_t pin) {
+	set_ext(pin, false, LOW);
+}
+
+void hal_analog_set(uint8_t pin, int val) {
+	if (pin < A0)
+		pin += A0;
+	if (pin < NUM_DIGITAL_PINS)
+		analog_ext[pin] = val;
+}
+
+/*
+ * Start, change or stop the pulses on a servo input.
+ * Changes take effect at the next frame.
+ */
+void hal_servo_set(uint8_t pin, unsigned int width_us) {
+	int i;
+
+	i = digitalPinToInterrupt(pin);
+	if (i < 0)
+		return;
+	if (width_us && !servo_width[i]) {
+		servo_rise[i] = now_us;
+		hal_event_at(HAL_EV_SERVO0 + i, now_us, i? servo1_edge: servo0_edge);
+	}
+	servo_width[i] = width_us;
+	if (!width_us) {
+		hal_event_cancel(HAL_EV_SERVO0 + i);
+		set_ext(pin, true, LOW);
+	}
+}
+
+int hal_pin_output(uint8_t pin) {
+	return pin < NUM_DIGITAL_PINS? pin_out[pin]: LOW;
+}
+
+/*
+ * Arduino core
+ */
+void pinMode(uint8_t pin, uint8_t mode) {
+	int old;
+
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+	old = level(pin);
+	pin_mode[pin] = mode;
+	edge(pin, old);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+	int old;
+
+	if (pin >= NUM_DIGITAL_PINS)
+		return;
+	old = level(pin);
+	pin_out[pin] = val? HIGH: LOW;
+	edge(pin, old);
+}
+
+int digitalRead(uint8_t pin) {
+	if (pin >= NUM_DIGITAL_PINS)
+		return LOW;
+	return level(pin);
+}
+
+/*
+ * The pressure inputs are wired to the DAC outputs.  When a DAC is
+ * powered down, whatever the harness put on the pin shows through.
+ */
+int hal_analog_value(uint8_t pin) {
+	int d;
+
+	if (pin < A0)
+		pin += A0;
+	if (pin >= NUM_DIGITAL_PINS)
+		return 0;
+	d = HAL_DAC_OFF;
+	if (pin == A0)
+		d = hal_dac_get(1);
+	else if (pin == A1)
+		d = hal_dac_get(0);
+	if (d != HAL_DAC_OFF)
+		return d >> 2;
+	return analog_ext[pin];
+}
+
+int analogRead(uint8_t pin) {
+	if (hal_cost_model)
+		hal_advance(COST_ANALOG_READ);
+	return hal_analog_value(pin);
+}
+
+void analogWrite(uint8_t pin, int val) {
+	digitalWrite(pin, val >= 128);
+}
+
+unsigned long millis() {
+	return (uint32_t)(now_us / 1000);
+}
+
+unsigned long micros() {
+	return (uint32_t)now_us;
+}
+
+void delay(unsigned long ms) {
+	hal_advance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+	hal_advance(us);
+}
+
+void attachInterrupt(uint8_t irq, void (*fn)(void), int mode) {
+	if (irq >= N_EXT_IRQ)
+		return;
+	ext_fn[irq] = fn;
+	ext_mode[irq] = mode;
+	hal_irq_clear(HAL_IRQ_INT0 + irq);
+}
+
+void detachInterrupt(uint8_t irq) {
+	if (irq < N_EXT_IRQ)
+		ext_fn[irq] = 0;
+}
+
+void noInterrupts() {
+	cli();
+}
+
+void interrupts() {
+	sei();
+}
+
+/*
+ * Print
+ */
+size_t Print::write(const uint8_t *buf, size_t n) {
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		write(buf[i]);
+	return n;
+}
+
+size_t Print::print(unsigned long v, int base) {
+	char s[8 * sizeof(long) + 1];
+	char *p;
+
+	if (base < 2)
+		base = 10;
+	p = s + sizeof(s) - 1;
+	*p = '\0';
+	do {
+		*--p = "0123456789ABCDEF"[v % base];
+		v /= base;
+	} while (v);
+	return write(p);
+}
+
+size_t Print::print(long v, int base) {
+	if (base == 10 && v < 0)
+		return print('-') + print((unsigned long)-v, 10);
+	return print((unsigned long)v, base);
+}
+
+size_t Print::print(double v, int digits) {
+	char s[40];
+
+	snprintf(s, sizeof(s), "%.*f", digits, v);
+	return write(s);
+}
+
+/*
+ * Serial
+ * 	Output goes to a file (stdout by default).  With the cost model on,
+ * 	writes block once the 64 byte transmit buffer is full, at the
+ * 	configured baud rate.
+ */
+#define	SERIAL_TX_BUFFER	64
+#define	SERIAL_RX_BUFFER	64
+
+HardwareSerial Serial;
+
+static FILE *serial_out = stdout;
+static unsigned long serial_baud;
+static uint64_t serial_tx_done;		// when the last queued byte is gone
+static uint8_t serial_rx[SERIAL_RX_BUFFER];
+static int serial_rx_head;
+static int serial_rx_n;
+
+void hal_serial_output(FILE *f) {
+	serial_out = f;
+}
+
+unsigned long hal_serial_baud() {
+	return serial_baud;
+}
+
+void hal_serial_rx(const uint8_t *p, int n) {
+	while (n-- > 0 && serial_rx_n < SERIAL_RX_BUFFER) {
+		serial_rx[(serial_rx_head + serial_rx_n) % SERIAL_RX_BUFFER] = *p++;
+		serial_rx_n++;
+	}
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+	serial_baud = baud;
+	serial_tx_done = now_us;
+}
+
+int HardwareSerial::available() {
+	return serial_rx_n;
+}
+
+int HardwareSerial::peek() {
+	return serial_rx_n? serial_rx[serial_rx_head]: -1;
+}
+
+int HardwareSerial::read() {
+	int c;
+
+	if (!serial_rx_n)
+		return -1;
+	c = serial_rx[serial_rx_head];
+	serial_rx_head = (serial_rx_head + 1) % SERIAL_RX_BUFFER;
+	serial_rx_n--;
+	return c;
+}
+
+void HardwareSerial::flush() {
+	if (hal_cost_model && serial_tx_done > now_us)
+		hal_advance(serial_tx_done - now_us);
+	if (serial_out)
+		fflush(serial_out);
+}
+
+/*
+ * Room in the transmit buffer: what write() can take without blocking.
+ * Like the AVR core, one slot is never used.
+ */
+int HardwareSerial::availableForWrite() {
+	uint64_t byte_time, pending;
+
+	if (!serial_baud || !hal_cost_model || serial_tx_done <= now_us)
+		return SERIAL_TX_BUFFER - 1;
+	byte_time = 10000000ULL / serial_baud;
+	pending = (serial_tx_done - now_us + byte_time - 1) / byte_time;
+	return pending >= SERIAL_TX_BUFFER - 1? 0: SERIAL_TX_BUFFER - 1 - pending;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+	uint64_t byte_time, full;
+
+	if (serial_baud && hal_cost_model) {
+		byte_time = 10000000ULL / serial_baud;
+		if (serial_tx_done < now_us)
+			serial_tx_done = now_us;
+		full = byte_time * SERIAL_TX_BUFFER;
+		if (serial_tx_done - now_us > full - byte_time)
+			hal_advance(serial_tx_done - now_us - (full - byte_time));
+		serial_tx_done += byte_time;
+	}
+	if (serial_out)
+		putc(c, serial_out);
+	return 1;
+}
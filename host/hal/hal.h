@@ -0,0 +1,61 @@
+/*
+ * Host hardware abstraction layer.
+ *
+ * These calls are the "outside world" of the virtual Nano: the host harness
+ * uses them to drive input pins, generate servo pulses, look at the DAC and
+ * LCD outputs and move the clock.  The firmware never calls them.
+ *
+ * Time:
+ * 	Virtual time only moves when hal_advance() is called, either by the
+ * 	harness or by the I/O cost model.  With the cost model on, each
+ * 	blocking Arduino call (analogRead, Wire, LCD, EEPROM writes, a full
+ * 	serial buffer) advances the clock by roughly what it takes on a
+ * 	16 MHz Nano, so loop timing on the host resembles the real thing.
+ *
+ * Interrupts:
+ * 	Pin change interrupts attached with attachInterrupt() are called
+ * 	from inside hal_advance() at the moment the edge happens.
+ */
+
+#ifndef _HOST_HAL_H
+#define _HOST_HAL_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+extern bool hal_cost_model;		// true to charge time for blocking I/O
+
+void hal_init();
+uint64_t hal_now_us();
+void hal_advance(uint32_t us);
+
+// Call fn from inside hal_advance() when the clock reaches t.  One at a time.
+void hal_at(uint64_t t, void (*fn)());
+
+// Input pins
+void hal_pin_set(uint8_t pin, uint8_t level);	// drive a digital input
+void hal_pin_release(uint8_t pin);		// stop driving it
+void hal_analog_set(uint8_t pin, int val);	// 10-bit value seen by analogRead
+void hal_servo_set(uint8_t pin, unsigned int width_us);	// 50 Hz pulses, 0 = none
+int hal_pin_output(uint8_t pin);		// level of an OUTPUT pin
+
+// I2C DACs
+#define	HAL_DAC_OFF	-1
+int hal_dac_get(int dac);			// 12-bit output, or HAL_DAC_OFF
+void hal_dac_set_listener(void (*fn)(int dac, int val));
+void hal_wire_bus_time(uint32_t us);		// used by the bus model
+
+// EEPROM
+bool hal_eeprom_open(const char *path);
+void hal_eeprom_save();
+
+// LCD
+void hal_lcd_row(int row, char *out);		// out must hold 21 chars
+void hal_lcd_dump(FILE *f);
+
+// Serial
+void hal_serial_output(FILE *f);		// NULL to discard
+void hal_serial_rx(const uint8_t *p, int n);
+unsigned long hal_serial_baud();
+
+#endif
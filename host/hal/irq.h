@@ -0,0 +1,50 @@
+/*
+ * Host HAL internals: interrupt and peripheral event plumbing
+ * shared by the peripheral models.  Not for use by the firmware.
+ */
+
+#ifndef _HOST_IRQ_H
+#define _HOST_IRQ_H
+
+#include <stdint.h>
+
+/*
+ * Interrupt sources, in ATmega328P priority order.
+ */
+enum hal_irq {
+	HAL_IRQ_INT0,
+	HAL_IRQ_INT1,
+	HAL_IRQ_PCINT2,
+	HAL_IRQ_TIMER2_COMPA,
+	HAL_IRQ_ADC,
+	HAL_IRQ_EE_READY,
+	HAL_IRQ_TWI,
+	HAL_N_IRQ
+};
+
+void hal_irq_raise(int irq);
+void hal_irq_clear(int irq);
+bool hal_irq_in_isr();
+
+/*
+ * Timed peripheral events.  Each peripheral model owns one slot and
+ * has at most one event pending in it.  hal_advance() calls the events
+ * in time order.
+ */
+enum hal_event {
+	HAL_EV_SERVO0,
+	HAL_EV_SERVO1,
+	HAL_EV_TIMER2,
+	HAL_EV_ADC,
+	HAL_EV_TWI,
+	HAL_EV_EEPROM,
+	HAL_EV_HARNESS,		// hal_at()
+	HAL_N_EV
+};
+
+void hal_event_at(int ev, uint64_t t, void (*fn)());
+void hal_event_cancel(int ev);
+
+int hal_analog_value(uint8_t pin);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Host HAL: HD44780 LCD model.
+ *
+ * Display RAM is addressed the way the controller does it, so
+ * text that runs off the end of a line shows up where it would on
+ * the real display.
+ */
+
+#include "LiquidCrystal.h"
+#include "hal.h"
+
+#define	COST_LCD_CLEAR		1520
+#define	COST_LCD_COMMAND	40
+#define	COST_LCD_CHAR		40
+
+#define	LCD_COLS	20
+#define	LCD_ROWS	4
+
+static uint8_t ddram[0x80];
+static uint8_t ac;		// address counter
+static const uint8_t row_base[LCD_ROWS] = { 0x00, 0x40, 0x14, 0x54 };
+
+static void cost(uint32_t us) {
+	if (hal_cost_model)
+		hal_advance(us);
+}
+
+LiquidCrystal::LiquidCrystal(uint8_t, uint8_t, uint8_t, uint8_t, uint8_t, uint8_t) {
+	memset(ddram, ' ', sizeof(ddram));
+	ac = 0;
+}
+
+void LiquidCrystal::begin(uint8_t, uint8_t) {
+	clear();
+}
+
+void LiquidCrystal::clear() {
+	cost(COST_LCD_CLEAR);
+	memset(ddram, ' ', sizeof(ddram));
+	ac = 0;
+}
+
+void LiquidCrystal::home() {
+	cost(COST_LCD_CLEAR);
+	ac = 0;
+}
+
+void LiquidCrystal::setCursor(uint8_t col, uint8_t row) {
+	cost(COST_LCD_COMMAND);
+	if (row >= LCD_ROWS)
+		row = LCD_ROWS - 1;
+	ac = (row_base[row] + col) & 0x7f;
+}
+
+size_t LiquidCrystal::write(uint8_t c) {
+	cost(COST_LCD_CHAR);
+	ddram[ac] = c;
+	ac++;
+	// the two halves of display RAM wrap into each other
+	if (ac == 0x28)
+		ac = 0x40;
+	else if (ac >= 0x68)
+		ac = 0x00;
+	return 1;
+}
+
+void hal_lcd_row(int row, char *out) {
+	int i;
+	uint8_t c;
+
+	for (i = 0; i < LCD_COLS; i++) {
+		c = ddram[row_base[row] + i];
+		out[i] = (c >= ' ' && c < 0x7f)? c: '?';
+	}
+	out[LCD_COLS] = '\0';
+}
+
+void hal_lcd_dump(FILE *f) {
+	char line[LCD_COLS + 1];
+	int i;
+
+	fprintf(f, "+--------------------+\n");
+	for (i = 0; i < LCD_ROWS; i++) {
+		hal_lcd_row(i, line);
+		fprintf(f, "|%s|\n", line);
+	}
+	fprintf(f, "+--------------------+\n");
+}
@@ -0,0 +1,120 @@
+/*
+ * Host HAL: ATmega328P Timer1 and Timer2 models.
+ *
+ * Timer1 runs free (normal mode) only.  TCNT1 is worked out from the
+ * clock whenever it is read.
+ *
+ * Timer2 does CTC mode only: the counter runs from 0 to OCR2A, and each match sets
+ * OCF2A and raises the compare A interrupt if OCIE2A is set.  TCNT2
+ * itself is not kept up to date; only the compare events matter.
+ * Time is kept in CPU clocks so periods that are not a whole number of
+ * microseconds don't drift.
+ */
+
+#include "Arduino.h"
+#include "hal.h"
+#include "irq.h"
+
+#define	F_CPU_MHZ	16
+
+static void tccr1b_write(uint8_t old);
+static void tcnt1_write(uint16_t old);
+static uint16_t tcnt1_read();
+static void timer2_write(uint8_t old);
+static void tifr2_write(uint8_t old);
+static void compare_match();
+
+hal_reg8 TCCR1A = { 0, 0 };
+hal_reg8 TCCR1B = { 0, tccr1b_write };
+hal_reg16 TCNT1 = { 0, tcnt1_write, tcnt1_read };
+
+hal_reg8 TCCR2A = { 0, timer2_write };
+hal_reg8 TCCR2B = { 0, timer2_write };
+hal_reg8 OCR2A = { 0, timer2_write };
+hal_reg8 OCR2B = { 0, 0 };
+hal_reg8 TCNT2 = { 0, timer2_write };
+hal_reg8 TIMSK2 = { 0, timer2_write };
+hal_reg8 TIFR2 = { 0, tifr2_write };
+
+static const unsigned prescalers[8] = { 0, 1, 8, 32, 64, 128, 256, 1024 };
+
+static const unsigned prescalers1[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+
+static uint64_t t1_base;	// CPU clock at which TCNT1 was t1_at_base
+static uint16_t t1_at_base;
+
+static uint16_t tcnt1_read() {
+	unsigned prescale;
+
+	prescale = prescalers1[TCCR1B.v & 7];
+	if (!prescale)
+		return t1_at_base;
+	return t1_at_base + (hal_now_us() * F_CPU_MHZ - t1_base) / prescale;
+}
+
+/*
+ * Restart counting from the current count, so a prescaler change
+ * takes effect from now.
+ */
+static void t1_rebase(uint16_t count) {
+	t1_at_base = count;
+	t1_base = hal_now_us() * F_CPU_MHZ;
+}
+
+static void tccr1b_write(uint8_t old) {
+	uint8_t v;
+
+	// work out the count under the old prescaler
+	v = TCCR1B.v;
+	TCCR1B.v = old;
+	t1_rebase(tcnt1_read());
+	TCCR1B.v = v;
+}
+
+static void tcnt1_write(uint16_t old) {
+	(void)old;
+	t1_rebase(TCNT1.v);
+}
+
+static uint64_t next_match;	// CPU clocks
+static uint64_t period;		// CPU clocks
+
+static void schedule() {
+	hal_event_at(HAL_EV_TIMER2, (next_match + F_CPU_MHZ - 1) / F_CPU_MHZ, compare_match);
+}
+
+static void compare_match() {
+	// taking the interrupt clears the flag, so only polled use sees it
+	if (TIMSK2.v & _BV(OCIE2A))
+		hal_irq_raise(HAL_IRQ_TIMER2_COMPA);
+	else
+		TIFR2.v |= _BV(OCF2A);
+	next_match += period;
+	schedule();
+}
+
+static void timer2_write(uint8_t old) {
+	unsigned prescale;
+
+	if (!(TIMSK2.v & _BV(OCIE2A)))
+		hal_irq_clear(HAL_IRQ_TIMER2_COMPA);
+
+	prescale = prescalers[TCCR2B.v & 7];
+	if (!prescale || !(TCCR2A.v & _BV(WGM21)) || (TCCR2B.v & _BV(WGM22))) {
+		hal_event_cancel(HAL_EV_TIMER2);
+		return;
+	}
+	// any write restarts the count from TCNT2
+	period = (uint64_t)(OCR2A.v + 1) * prescale;
+	next_match = hal_now_us() * F_CPU_MHZ +
+		(uint64_t)((OCR2A.v - TCNT2.v) & 0xff) * prescale + prescale;
+	TCNT2.v = 0;
+	schedule();
+}
+
+static void tifr2_write(uint8_t old) {
+	// writing a one clears the flag
+	TIFR2.v = old & ~TIFR2.v;
+	if (!(TIFR2.v & _BV(OCF2A)))
+		hal_irq_clear(HAL_IRQ_TIMER2_COMPA);
+}
@@ -0,0 +1,266 @@
+/*
+ * Host HAL: I2C bus and the two MCP4725 DACs on it.
+ *
+ * The DAC model understands all three MCP4725 write commands:
+ * 	fast write	(2 bytes per update, may be repeated)
+ * 	write DAC	(3 bytes)
+ * 	write DAC+EE	(3 bytes, also sets the power-up state)
+ *
+ * The bus can be driven two ways:
+ * 	through the Wire library, where with the cost model on
+ * 	endTransmission() and requestFrom() take as long as the bytes
+ * 	take on the wire at the current bus clock;
+ * 	or through the TWI registers and TWI_vect, as on the chip.
+ * 	Only master transmit is modeled there.
+ */
+
+#include "Wire.h"
+#include "hal.h"
+#include "irq.h"
+
+#define	DAC_ADDR	0x60		// MCP4725A0, A0 pin selects 0x60 or 0x61
+#define	N_DAC		2
+
+TwoWire Wire;
+
+struct dac_model_s {
+	int value;		// 12 bits
+	int pd;			// power down bits; 0 is normal operation
+	int ee_value;		// power-up state
+	int ee_pd;
+};
+
+static struct dac_model_s dac_model[N_DAC];
+static void (*dac_listener)(int dac, int val);
+
+static unsigned long bus_hz = 100000;
+static uint8_t tx_addr;
+static uint8_t tx_buf[WIRE_BUFFER_LENGTH];
+static int tx_n;
+static uint8_t rx_buf[WIRE_BUFFER_LENGTH];
+static int rx_n;
+static int rx_next;
+
+int hal_dac_get(int dac) {
+	if (dac < 0 || dac >= N_DAC || dac_model[dac].pd)
+		return HAL_DAC_OFF;
+	return dac_model[dac].value;
+}
+
+void hal_dac_set_listener(void (*fn)(int dac, int val)) {
+	dac_listener = fn;
+}
+
+/*
+ * Charge the time for n bytes plus start and stop conditions.
+ */
+static void bus_time(int n) {
+	if (hal_cost_model)
+		hal_advance((uint32_t)(((9UL * n + 2) * 1000000UL) / bus_hz));
+}
+
+static void dac_update(int dac, int value, int pd) {
+	struct dac_model_s *d;
+	int old;
+
+	d = &dac_model[dac];
+	old = hal_dac_get(dac);
+	d->value = value & 0xfff;
+	d->pd = pd & 3;
+	if (dac_listener && hal_dac_get(dac) != old)
+		dac_listener(dac, hal_dac_get(dac));
+}
+
+static void dac_receive(int dac, const uint8_t *p, int n) {
+	struct dac_model_s *d;
+
+	d = &dac_model[dac];
+	if ((p[0] & 0xc0) == 0) {
+		// fast mode, repeated pairs
+		for (; n >= 2; n -= 2, p += 2)
+			dac_update(dac, ((p[0] & 0x0f) << 8) | p[1], (p[0] >> 4) & 3);
+		return;
+	}
+	if (n < 3)
+		return;
+	switch (p[0] & 0xe0) {
+	case 0x40:
+		dac_update(dac, (p[1] << 4) | (p[2] >> 4), (p[0] >> 1) & 3);
+		break;
+	case 0x60:
+		dac_update(dac, (p[1] << 4) | (p[2] >> 4), (p[0] >> 1) & 3);
+		d->ee_value = d->value;
+		d->ee_pd = d->pd;
+		break;
+	}
+}
+
+void TwoWire::begin() {
+	int i;
+
+	for (i = 0; i < N_DAC; i++) {
+		dac_model[i].value = dac_model[i].ee_value;
+		dac_model[i].pd = dac_model[i].ee_pd;
+	}
+}
+
+void TwoWire::setClock(unsigned long hz) {
+	if (hz)
+		bus_hz = hz;
+}
+
+void TwoWire::beginTransmission(uint8_t addr) {
+	tx_addr = addr;
+	tx_n = 0;
+}
+
+size_t TwoWire::write(uint8_t c) {
+	if (tx_n >= WIRE_BUFFER_LENGTH)
+		return 0;
+	tx_buf[tx_n++] = c;
+	return 1;
+}
+
+/*
+ * Returns 0 on success, 2 if nobody answered the address
+ */
+uint8_t TwoWire::endTransmission(bool stop) {
+	(void)stop;
+	bus_time(tx_n + 1);
+	if ((tx_addr & ~1) != DAC_ADDR)
+		return 2;
+	if (tx_n)
+		dac_receive(tx_addr & 1, tx_buf, tx_n);
+	return 0;
+}
+
+/*
+ * MCP4725 read: status, DAC register (2 bytes), EEPROM (2 bytes)
+ */
+uint8_t TwoWire::requestFrom(uint8_t addr, uint8_t n) {
+	struct dac_model_s *d;
+
+	rx_n = 0;
+	rx_next = 0;
+	bus_time(n + 1);
+	if ((addr & ~1) != DAC_ADDR)
+		return 0;
+	d = &dac_model[addr & 1];
+	rx_buf[0] = 0x80 | (d->pd << 1);
+	rx_buf[1] = d->value >> 4;
+	rx_buf[2] = (d->value & 0x0f) << 4;
+	rx_buf[3] = (d->ee_pd << 5) | (d->ee_value >> 8);
+	rx_buf[4] = d->ee_value & 0xff;
+	rx_n = n < 5? n: 5;
+	return rx_n;
+}
+
+int TwoWire::available() {
+	return rx_n - rx_next;
+}
+
+int TwoWire::read() {
+	return rx_next < rx_n? rx_buf[rx_next++]: -1;
+}
+
+/*
+ * TWI peripheral, master transmitter
+ */
+#define	TW_START		0x08
+#define	TW_REP_START		0x10
+#define	TW_MT_SLA_ACK		0x18
+#define	TW_MT_SLA_NACK		0x20
+#define	TW_MT_DATA_ACK		0x28
+#define	TW_MT_DATA_NACK		0x30
+
+static void twcr_write(uint8_t old);
+
+hal_reg8 TWBR = { 0, 0 };
+hal_reg8 TWSR = { 0, 0 };
+hal_reg8 TWAR = { 0, 0 };
+hal_reg8 TWDR = { 0, 0 };
+hal_reg8 TWCR = { 0, twcr_write };
+
+enum { TWI_IDLE, TWI_STARTED, TWI_ADDRESSED, TWI_NACKED };
+
+static int twi_state;
+static uint8_t twi_addr;
+static uint8_t twi_frame[WIRE_BUFFER_LENGTH];
+static int twi_n;
+static uint8_t twi_status;
+
+/*
+ * SCL period in CPU clocks is 16 + 2 * TWBR * prescaler
+ */
+static uint64_t twi_bits(int n) {
+	static const unsigned pre[4] = { 1, 4, 16, 64 };
+	unsigned clocks;
+
+	clocks = 16 + 2 * TWBR.v * pre[TWSR.v & 3];
+	return (n * clocks + 15) / 16;
+}
+
+static void twi_done() {
+	TWSR.v = (TWSR.v & 3) | twi_status;
+	TWCR.v |= _BV(TWINT);
+	if (TWCR.v & _BV(TWIE))
+		hal_irq_raise(HAL_IRQ_TWI);
+}
+
+static void twi_after(int bits, uint8_t status) {
+	twi_status = status;
+	hal_event_at(HAL_EV_TWI, hal_now_us() + twi_bits(bits), twi_done);
+}
+
+static void twcr_write(uint8_t old) {
+	(void)old;
+	if (!(TWCR.v & _BV(TWEN))) {
+		twi_state = TWI_IDLE;
+		hal_event_cancel(HAL_EV_TWI);
+		return;
+	}
+	if (!(TWCR.v & _BV(TWIE)))
+		hal_irq_clear(HAL_IRQ_TWI);
+
+	// Nothing happens until TWINT is cleared, by writing a one to it.
+	if (!(TWCR.v & _BV(TWINT)))
+		return;
+	TWCR.v &= ~_BV(TWINT);
+
+	if (TWCR.v & _BV(TWSTO)) {
+		if (twi_state == TWI_ADDRESSED && (twi_addr & ~1) == DAC_ADDR && twi_n)
+			dac_receive(twi_addr & 1, twi_frame, twi_n);
+		twi_state = TWI_IDLE;
+		TWCR.v &= ~_BV(TWSTO);
+		if (!(TWCR.v & _BV(TWSTA)))
+			return;
+	}
+
+	if (TWCR.v & _BV(TWSTA)) {
+		twi_after(1, twi_state == TWI_IDLE? TW_START: TW_REP_START);
+		twi_state = TWI_STARTED;
+		twi_n = 0;
+		return;
+	}
+
+	switch (twi_state) {
+	case TWI_STARTED:
+		twi_addr = TWDR.v >> 1;
+		if ((twi_addr & ~1) == DAC_ADDR && !(TWDR.v & 1)) {
+			twi_state = TWI_ADDRESSED;
+			twi_after(9, TW_MT_SLA_ACK);
+		} else {
+			twi_state = TWI_NACKED;
+			twi_after(9, TW_MT_SLA_NACK);
+		}
+		break;
+	case TWI_ADDRESSED:
+		if (twi_n < WIRE_BUFFER_LENGTH)
+			twi_frame[twi_n++] = TWDR.v;
+		twi_after(9, TW_MT_DATA_ACK);
+		break;
+	default:
+		twi_after(9, TW_MT_DATA_NACK);
+		break;
+	}
+}
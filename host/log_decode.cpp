@@ -0,0 +1,62 @@
+/*
+ * Decode the log the way log.cpp does, for the host tools.
+ */
+
+#include "log_decode.h"
+#include "log.h"
+#include "ee.h"
+
+static bool is_edge(unsigned op) {
+	return op == LOG_IG_IPA_OPEN || op == LOG_IG_IPA_CLOSE ||
+	    op == LOG_IG_N2O_OPEN || op == LOG_IG_N2O_CLOSE;
+}
+
+/*
+ * The entries of len log bytes, appended to *recs.  Returns false if
+ * the last entry runs past the end; the entries up to it are kept.
+ */
+bool log_decode(const unsigned char *log, unsigned len, std::vector<struct log_rec_s> *recs) {
+	struct log_rec_s r;
+	unsigned pos, shift, b;
+	unsigned long dt;
+
+	pos = 0;
+	r.t = 0;
+	for (r.entry = 0; pos < len; r.entry++) {
+		r.op = log[pos++];
+		dt = 0;
+		shift = 0;
+		do {
+			b = pos < len? log[pos++]: 0;
+			dt |= (unsigned long)(b & 0x7f) << shift;
+			shift += 7;
+		} while ((b & 0x80) && shift < 35);
+		r.param = 0;
+		if (r.op & LOG_HAS_PARAM)
+			r.param = pos < len? log[pos++]: 0;
+		r.op &= ~LOG_HAS_PARAM;
+		r.t += dt;
+		r.us = r.t * 1000ULL;
+		if (is_edge(r.op))
+			r.us += r.param * LOG_EDGE_US;
+		recs->push_back(r);
+	}
+	return pos == len;
+}
+
+/*
+ * The length of the log saved in an EEPROM image of n bytes, which is
+ * at LOG_BASE, or -1 if there isn't a valid one.
+ */
+int log_ee_find(const unsigned char *ee, unsigned n, unsigned *seq) {
+	unsigned len;
+
+	if (n < LOG_BASE)
+		return -1;
+	len = ee[LOG_CHECK_BYTE_1] | ee[LOG_LENGTH_HI] << 8;
+	if (ee[LOG_FORMAT] != LOG_FORMAT_VARINT || ee[LOG_CHECK_BYTE_2] != LOG_CHECK(len) ||
+	    len > LOG_BYTES || LOG_BASE + len > n)
+		return -1;
+	*seq = ee[LOG_SEQ0] | ee[LOG_SEQ1] << 8;
+	return len;
+}
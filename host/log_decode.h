@@ -0,0 +1,21 @@
+/*
+ * Decode the firmware's log; see log.h and ee.h.
+ */
+
+#ifndef _LOG_DECODE_H
+#define _LOG_DECODE_H
+
+#include <vector>
+
+struct log_rec_s {
+	unsigned entry;
+	unsigned op;			// with the level bits, without LOG_HAS_PARAM
+	unsigned param;
+	unsigned long t;		// milliseconds since the log started
+	unsigned long long us;		// microseconds, for the igniter valve edges
+};
+
+bool log_decode(const unsigned char *log, unsigned len, std::vector<struct log_rec_s> *recs);
+int log_ee_find(const unsigned char *ee, unsigned n, unsigned *seq);
+
+#endif
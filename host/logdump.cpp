@@ -0,0 +1,256 @@
+/*
+ * Decode a binary log dump into CSV or JSON.
+ *
+ * The dump is what Log Dump on the menu sends: COBS framed, CRC checked
+ * frames (see frame.h) with the log header, the in-memory log bytes and
+ * all of EEPROM.  The log comes from the log frames; if those are
+ * missing or damaged, from the log saved in the EEPROM frames.
+ *
+ * Usage: logdump [-j] [-r] [-w eeprom.bin] [file]
+ * 	file		the captured serial bytes (default stdin)
+ * 	-j		JSON instead of CSV
+ * 	-r		the input is a raw EEPROM image, as motor_sim -e saves
+ * 	-w file		save the EEPROM image from the dump
+ *
+ * CSV has one line per entry:
+ * 	entry,time_ms,time_us,level,op,name,param
+ * time_us adds the sub-millisecond part of the igniter valve edges.
+ *
+ * Exits 1 if any frame was bad or missing, or there is no log.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "log.h"
+#include "log_op_names.h"
+#include "ee.h"
+#include "frame.h"
+#include "frame_rx.h"
+#include "log_decode.h"
+#include "EEPROM.h"
+
+#define	N_OPS	(sizeof(op_codes_long) / sizeof(op_codes_long[0]))
+
+struct dump_s {
+	bool have_head;
+	unsigned seq, length, format, n_entries;
+	std::vector<unsigned char> log, ee;
+	std::vector<bool> log_got, ee_got;
+	unsigned frames, bad;
+	bool ended;
+};
+
+static void i_data(std::vector<unsigned char> &v, std::vector<bool> &got, const unsigned char *f, int n) {
+	unsigned off;
+	int i;
+
+	off = f[0] | f[1] << 8;
+	for (i = 2; i < n && off < v.size(); i++, off++) {
+		v[off] = f[i];
+		got[off] = true;
+	}
+}
+
+static void i_frame(void *ctx, unsigned char type, const unsigned char *f, int len) {
+	struct dump_s *d = (struct dump_s *)ctx;
+
+	switch (type) {
+	case FRAME_LOG_HEAD:
+		if (len < 6)
+			break;
+		d->have_head = true;
+		d->seq = f[0] | f[1] << 8;
+		d->length = f[2] | f[3] << 8;
+		d->format = f[4];
+		d->n_entries = f[5];
+		break;
+	case FRAME_LOG_DATA:
+		if (len >= 2)
+			i_data(d->log, d->log_got, f, len);
+		break;
+	case FRAME_EEPROM:
+		if (len >= 2)
+			i_data(d->ee, d->ee_got, f, len);
+		break;
+	case FRAME_END:
+		// the count is of the frames sent, so compare before this one counts
+		if (len >= 2 && (unsigned)(f[0] | f[1] << 8) != d->frames) {
+			fprintf(stderr, "logdump: %u frames of %u\n", d->frames, f[0] | f[1] << 8);
+			d->bad++;
+		}
+		d->ended = true;
+		break;
+	}
+	d->frames++;
+}
+
+static bool i_all(const std::vector<bool> &got, unsigned from, unsigned n) {
+	unsigned i;
+
+	for (i = from; i < from + n; i++)
+		if (i >= got.size() || !got[i])
+			return false;
+	return true;
+}
+
+/*
+ * Pick the log out of the dump.  Leaves it in d->log[0 .. d->length).
+ */
+static bool i_find_log(struct dump_s *d) {
+	int len;
+
+	if (d->have_head && d->format == LOG_FORMAT_VARINT &&
+	    d->length <= LOG_BYTES && i_all(d->log_got, 0, d->length))
+		return true;
+
+	if (!i_all(d->ee_got, 0, LOG_BASE))
+		return false;
+	len = log_ee_find(&d->ee[0], d->ee.size(), &d->seq);
+	if (len < 0 || !i_all(d->ee_got, LOG_BASE, len)) {
+		fprintf(stderr, "logdump: no valid log in EEPROM\n");
+		return false;
+	}
+	if (d->have_head)
+		fprintf(stderr, "logdump: log frames incomplete, using the EEPROM copy\n");
+	d->length = len;
+	d->format = LOG_FORMAT_VARINT;
+	d->n_entries = 0;
+	memcpy(&d->log[0], &d->ee[LOG_BASE], len);
+	return true;
+}
+
+static const char *level_name(unsigned op) {
+	switch (LOG_LEVEL(op)) {
+	case LOG_CRITICAL: return "critical";
+	case LOG_NORMAL: return "normal";
+	case LOG_DETAIL: return "detail";
+	}
+	return "?";
+}
+
+/*
+ * Decode and print the entries, the way log.cpp decodes them.
+ */
+static bool i_print(const struct dump_s *d, bool json) {
+	std::vector<struct log_rec_s> recs;
+	const char *name;
+	unsigned code;
+	size_t i;
+	bool whole;
+
+	whole = log_decode(&d->log[0], d->length, &recs);
+	if (json)
+		printf("{\"seq\": %u, \"length\": %u, \"entries\": [", d->seq, d->length);
+	else
+		printf("entry,time_ms,time_us,level,op,name,param\n");
+
+	for (i = 0; i < recs.size(); i++) {
+		const struct log_rec_s &r = recs[i];
+
+		code = r.op & ~LOG_LEVEL_MASK;
+		name = code < N_OPS? op_codes_long[code]: "?";
+		if (json)
+			printf("%s\n  {\"entry\": %u, \"time_ms\": %lu, \"time_us\": %llu, \"level\": \"%s\", \"op\": %u, \"name\": \"%s\", \"param\": %u}",
+			    i? ",": "", r.entry, r.t, r.us, level_name(r.op), code, name, r.param);
+		else
+			printf("%u,%lu,%llu,%s,%u,%s,%u\n", r.entry, r.t, r.us, level_name(r.op), code, name, r.param);
+	}
+	if (json)
+		printf("\n]}\n");
+
+	if (!whole) {
+		fprintf(stderr, "logdump: last entry runs past the end of the log\n");
+		return false;
+	}
+	if (d->n_entries && recs.size() != d->n_entries) {
+		fprintf(stderr, "logdump: %u entries, header says %u\n", (unsigned)recs.size(), d->n_entries);
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::vector<unsigned char> in;
+	struct dump_s d;
+	struct frame_rx_s rx;
+	const char *ee_path = 0;
+	bool json = false, raw = false;
+	unsigned char buf[4096];
+	size_t n;
+	FILE *f;
+	int c;
+
+	while ((c = getopt(argc, argv, "jrw:")) != -1) {
+		switch (c) {
+		case 'j': json = true; break;
+		case 'r': raw = true; break;
+		case 'w': ee_path = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-j] [-r] [-w eeprom.bin] [file]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	f = optind < argc? fopen(argv[optind], "rb"): stdin;
+	if (!f) {
+		perror(argv[optind]);
+		return 2;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		in.insert(in.end(), buf, buf + n);
+	if (f != stdin)
+		fclose(f);
+
+	d.have_head = false;
+	d.seq = d.length = d.format = d.n_entries = 0;
+	d.log.assign(LOG_BYTES, 0);
+	d.log_got.assign(LOG_BYTES, false);
+	d.ee.assign(E2END + 1, 0xff);
+	d.ee_got.assign(E2END + 1, false);
+	d.frames = d.bad = 0;
+	d.ended = false;
+
+	if (raw) {
+		n = in.size() < d.ee.size()? in.size(): d.ee.size();
+		memcpy(d.ee.data(), in.data(), n);
+		d.ee_got.assign(n, true);
+		d.ee_got.resize(E2END + 1, false);
+		d.ended = true;
+	} else {
+		frame_rx_init(&rx, i_frame, &d);
+		for (n = 0; n < in.size(); n++)
+			frame_rx_byte(&rx, in[n]);
+		if (rx.skipped)
+			fprintf(stderr, "logdump: skipped %lu bytes before the first frame\n", rx.skipped);
+		if ((n = frame_rx_finish(&rx)) > 0)
+			fprintf(stderr, "logdump: %u bytes after the last frame\n", (unsigned)n);
+		d.bad += rx.bad;
+	}
+
+	if (!d.ended) {
+		fprintf(stderr, "logdump: no end frame\n");
+		d.bad++;
+	}
+	if (d.bad)
+		fprintf(stderr, "logdump: %u bad frames\n", d.bad);
+
+	if (ee_path) {
+		f = fopen(ee_path, "wb");
+		if (!f || fwrite(&d.ee[0], 1, d.ee.size(), f) != d.ee.size()) {
+			perror(ee_path);
+			return 1;
+		}
+		fclose(f);
+	}
+
+	if (!i_find_log(&d)) {
+		fprintf(stderr, "logdump: no log found\n");
+		return 1;
+	}
+	if (!i_print(&d, json))
+		return 1;
+	return d.bad? 1: 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Host harness for the motor simulator firmware.
+ *
+ * Runs the unmodified setup()/loop() under a virtual clock.  Inputs come
+ * from an optional stimulus script; the serial port goes to stdout.
+ *
+ * Usage: motor_sim [-t ms] [-e eeprom.bin] [-f script] [-l us] [-n] [-q] [-s] [-w wave.csv]
+ * 	-t ms		virtual time to run (default 10000)
+ * 	-e file		EEPROM image, loaded at start and saved at exit
+ * 	-f file		stimulus script, see script.cpp
+ * 	-l us		time charged to each loop() pass for computation (default 50)
+ * 	-n		no I/O cost model; only -l advances the clock
+ * 	-q		discard serial output
+ * 	-s		print the LCD screen at exit
+ * 	-w file		write the DAC outputs, see i_wave()
+ *
+ * At exit it prints the wall clock time spent in loop() per simulated
+ * second, which is what host/regress watches for the speed of the code.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <vector>
+#include "Arduino.h"
+#include "hal.h"
+#include "script.h"
+
+/*
+ * Every change of the DAC outputs, for -w
+ */
+struct dac_change_s {
+	uint64_t t;
+	int dac, val;
+};
+
+static std::vector<struct dac_change_s> dac_changes;
+
+static void i_dac(int dac, int val) {
+	struct dac_change_s c;
+
+	c.t = hal_now_us();
+	c.dac = dac;
+	c.val = val;
+	dac_changes.push_back(c);
+}
+
+/*
+ * The DAC outputs as CSV:
+ * 	a comment line with the number of changes and a hash of them all,
+ * 	to the microsecond
+ * 	time_ms,dac_ig,dac_main
+ * 	the outputs every WAVE_MS, for the times either one is different
+ * 	from the line before; HAL_DAC_OFF when it's powered down
+ */
+#define	WAVE_MS		5
+
+static bool i_wave(const char *path, uint64_t end) {
+	uint64_t hash, t;
+	int v[2], last[2];
+	size_t i, k;
+	FILE *f;
+
+	if (!(f = fopen(path, "w"))) {
+		perror(path);
+		return false;
+	}
+	hash = 0xcbf29ce484222325ULL;		// FNV-1a
+	for (i = 0; i < dac_changes.size(); i++) {
+		const struct dac_change_s &c = dac_changes[i];
+		uint64_t w[3] = { c.t, (uint64_t)c.dac, (uint64_t)(int64_t)c.val };
+
+		for (k = 0; k < sizeof(w); k++)
+			hash = (hash ^ ((const unsigned char *)w)[k]) * 0x100000001b3ULL;
+	}
+	fprintf(f, "# %u changes, hash %016llx\n", (unsigned)dac_changes.size(), (unsigned long long)hash);
+	fprintf(f, "time_ms,dac_ig,dac_main\n");
+
+	v[0] = v[1] = last[0] = last[1] = HAL_DAC_OFF;
+	i = 0;
+	for (t = 0; t <= end; t += WAVE_MS * 1000) {
+		for (; i < dac_changes.size() && dac_changes[i].t <= t; i++)
+			if (dac_changes[i].dac < 2)
+				v[dac_changes[i].dac] = dac_changes[i].val;
+		if (t && v[0] == last[0] && v[1] == last[1])
+			continue;
+		fprintf(f, "%llu,%d,%d\n", (unsigned long long)(t / 1000), v[0], v[1]);
+		last[0] = v[0];
+		last[1] = v[1];
+	}
+	fclose(f);
+	return true;
+}
+
+static double wall_seconds() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+	unsigned long run_ms = 10000;
+	unsigned long loop_us = 50;
+	const char *eeprom_path = 0;
+	const char *script_path = 0;
+	const char *wave_path = 0;
+	bool show_lcd = false;
+	unsigned long loops;
+	uint64_t t, end;
+	double wall, in_loop, w;
+	int c;
+
+	hal_init();
+	while ((c = getopt(argc, argv, "t:e:f:l:nqsw:")) != -1) {
+		switch (c) {
+		case 't': run_ms = strtoul(optarg, 0, 0); break;
+		case 'e': eeprom_path = optarg; break;
+		case 'f': script_path = optarg; break;
+		case 'l': loop_us = strtoul(optarg, 0, 0); break;
+		case 'n': hal_cost_model = false; break;
+		case 'q': hal_serial_output(0); break;
+		case 's': show_lcd = true; break;
+		case 'w': wave_path = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-t ms] [-e eeprom.bin] [-f script] [-l us] [-n] [-q] [-s] [-w wave.csv]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	if (eeprom_path)
+		hal_eeprom_open(eeprom_path);
+	if (script_path && !script_load(script_path))
+		return 1;
+	if (wave_path)
+		hal_dac_set_listener(i_dac);
+
+	wall = wall_seconds();
+	end = (uint64_t)run_ms * 1000;
+	loops = 0;
+	in_loop = 0;
+	script_run(hal_now_us());
+	setup();
+	while (hal_now_us() < end && !script_done()) {
+		script_run(hal_now_us());
+		t = hal_now_us();
+		w = wall_seconds();
+		loop();
+		in_loop += wall_seconds() - w;
+		loops++;
+		if (hal_now_us() - t < loop_us)
+			hal_advance(loop_us - (hal_now_us() - t));
+	}
+	wall = wall_seconds() - wall;
+
+	if (eeprom_path)
+		hal_eeprom_save();
+	if (show_lcd)
+		hal_lcd_dump(stderr);
+	if (wave_path && !i_wave(wave_path, hal_now_us()))
+		return 1;
+	fprintf(stderr, "%lu loops, %.3f s simulated, %.3f s wall, %.0fx real time, %.0f us of loop() per simulated second\n",
+		loops, hal_now_us() * 1e-6, wall,
+		wall > 0? hal_now_us() * 1e-6 / wall: 0.0,
+		hal_now_us()? in_loop * 1e12 / hal_now_us(): 0.0);
+	return 0;
+}
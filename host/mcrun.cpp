@@ -0,0 +1,568 @@
+/*
+ * Monte Carlo runs of the full run, in parallel.
+ *
+ * Each run is a randomized scenario played to the firmware the way the
+ * motor sequencer would: igniter valves, spark and main valve servos,
+ * with jitter on every edge, a step or a ramp for the servos, and
+ * sometimes a fault.  The scenario is a stimulus script for motor_sim,
+ * which runs a Telemetry Run from the menu; the results come from the
+ * telemetry frames it sends and the log it saves in EEPROM.
+ *
+ * The firmware keeps its state in globals, as it does on the Nano, so
+ * every run is its own motor_sim process.  A pool of threads, one per
+ * core by default, starts them; each thread has a queue of runs and
+ * takes from the others' when its own is empty.
+ *
+ * Usage: mcrun [-n runs] [-j threads] [-s seed] [-J ms] [-f pct]
+ * 		[-i ms] [-m ms] [-b motor_sim] [-o runs.csv]
+ * 	-n runs		how many (default 1000)
+ * 	-j threads	how many at once (default, the number of cores)
+ * 	-s seed		for the scenarios; run k is the same for a seed
+ * 	-J ms		timing jitter on the sequencer's edges (default 20)
+ * 	-f pct		percentage of runs with a fault (default 25)
+ * 	-i ms		igniter window: pressure good this long after the last
+ * 			of the igniter valves and spark (default 100)
+ * 	-m ms		chamber window: 90% pressure this long after the main
+ * 			valves are sent open (default 400)
+ * 	-b file		the motor_sim to run (default, next to mcrun)
+ * 	-o file		one CSV line per run
+ *
+ * A run passes if the igniter and chamber come up within their windows,
+ * the chamber does not go out with the valves open, and the burn runs
+ * to the end of the propellants.  The summary is of each kind of
+ * scenario: how many passed, why the others failed, and the spread of
+ * the igniter delay, chamber rise and burn times.
+ *
+ * IG_DELAY, PROPELLANT_LOAD and CHAMBER_EFF are compiled in; to try
+ * other values build another motor_sim and point -b at it:
+ * 	make -C host BUILD=build/p3000 DEFS=-DPROPELLANT_LOAD=3000 build/p3000/motor_sim
+ * 	host/build/mcrun -b host/build/p3000/motor_sim
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame.h"
+#include "frame_rx.h"
+#include "log_decode.h"
+#include "log.h"
+#include "pressure.h"
+#include "telemetry.h"
+#include "ee.h"
+
+extern char **environ;
+
+/*
+ * Kinds of scenario
+ */
+enum { F_NONE, F_NO_SPARK, F_IG_N2O, F_SERVO_LOSS, F_FLAMEOUT, F_MISMATCH, F_N };
+
+static const char *fault_names[F_N] = {
+	"nominal",
+	"no_spark",		// the spark never fires
+	"ig_n2o_stuck",		// the igniter N2O valve never opens
+	"servo_loss",		// the N2O servo signal stops before the valves open
+	"flameout",		// the main valves shut briefly mid burn
+	"mismatch",		// the IPA valve only opens part way
+};
+
+/*
+ * Why a run failed
+ */
+enum { R_PASS, R_NO_IG, R_SLOW_IG, R_NO_CHAMBER, R_SLOW_CHAMBER, R_FLAMEOUT, R_NO_BURNOUT, R_SIM, R_N };
+
+static const char *reason_names[R_N] = {
+	"pass",
+	"no_ignition",
+	"slow_ignition",
+	"no_chamber",
+	"slow_chamber",
+	"flameout",
+	"no_burnout",
+	"sim_error",
+};
+
+#define	SERVO_SHUT	1000		// us; see scripts/full_run.txt
+#define	SERVO_OPEN	1900
+#define	T_START		5000		// ms, the sequencer's first edge, about
+#define	T_MAIN		500		// then the main valves
+#define	T_IG_SHUT	800		// then the igniter valves shut
+#define	T_BURN		5500		// and this is long enough to burn out
+
+// chamber pressure, DAC counts, at these percentages of full
+#define	P_PCT(pct)	(SENSOR_ZERO + (MAX_MAIN_PRESSURE - SENSOR_ZERO) * (pct) / 100)
+
+struct opts_s {
+	int runs, threads;
+	uint64_t seed;
+	int jitter, fault_pct;
+	int ig_window, main_window;
+	std::string sim, csv;
+};
+
+struct run_s {
+	int fault;
+	bool ramp;
+	int reason;
+	long ign, rise, burn;		// ms, -1 if they didn't happen
+};
+
+static struct opts_s opts;
+static std::vector<struct run_s> runs;
+
+/*
+ * splitmix64; every run gets its own, from the seed and its number, so
+ * the scenarios don't depend on which thread runs them
+ */
+static uint64_t i_rand(uint64_t *s) {
+	uint64_t z;
+
+	z = (*s += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// lo to hi, inclusive
+static int i_uniform(uint64_t *s, int lo, int hi) {
+	return lo + (int)(i_rand(s) % (uint64_t)(hi - lo + 1));
+}
+
+/*
+ * The script for run k, and the times the results are measured from
+ */
+struct scene_s {
+	std::string script;
+	long t_first;		// ms, the first edge: the log and telemetry start here
+	long t_lit;		// the last of the igniter valves and spark, -1 if never
+	long t_main;		// the main valves are sent open
+	long t_end;
+};
+
+static void i_event(std::string *s, long t, const char *what) {
+	char line[64];
+
+	snprintf(line, sizeof(line), "%ld\t%s\n", t, what);
+	*s += line;
+}
+
+static void i_servo(std::string *s, long t, const char *pin, int us) {
+	char what[32];
+
+	snprintf(what, sizeof(what), "servo\t%s\t%d", pin, us);
+	i_event(s, t, what);
+}
+
+static void i_scene(int k, struct run_s *r, struct scene_s *sc) {
+	uint64_t rs;
+	long t_ipa, t_n2o, t_spark, t, t_ramp;
+	int j, i, ipa_open, n2o_open, steps;
+
+	rs = opts.seed * 1000003 + k;
+	j = opts.jitter;
+	r->fault = F_NONE;
+	if (i_uniform(&rs, 0, 99) < opts.fault_pct)
+		r->fault = i_uniform(&rs, F_NONE + 1, F_N - 1);
+	r->ramp = i_uniform(&rs, 0, 1);
+
+	sc->script.clear();
+	i_servo(&sc->script, 0, "MAIN_IPA", SERVO_SHUT);
+	i_servo(&sc->script, 0, "MAIN_N2O", SERVO_SHUT);
+	// Telemetry Run is the 11th menu item
+	for (i = 0; i < 10; i++)
+		i_event(&sc->script, 2100 + 200 * i, "down");
+	i_event(&sc->script, 4100, "press");
+
+	t_ipa = T_START + i_uniform(&rs, 0, j);
+	t_n2o = r->fault == F_IG_N2O? -1: T_START + i_uniform(&rs, 0, j);
+	t_spark = r->fault == F_NO_SPARK? -1: T_START + i_uniform(&rs, -j, j);
+	i_event(&sc->script, t_ipa, "pin\tIG_IPA\t1");
+	if (t_n2o >= 0)
+		i_event(&sc->script, t_n2o, "pin\tIG_N2O\t1");
+	if (t_spark >= 0) {
+		i_event(&sc->script, t_spark, "analog\tSPARK\t500");
+		i_event(&sc->script, t_spark + i_uniform(&rs, 200, 400), "analog\tSPARK\t0");
+	}
+	sc->t_first = t_ipa;
+	if (t_n2o >= 0)
+		sc->t_first = std::min(sc->t_first, t_n2o);
+	if (t_spark >= 0)
+		sc->t_first = std::min(sc->t_first, t_spark);
+	sc->t_lit = t_n2o < 0 || t_spark < 0? -1: std::max(t_ipa, std::max(t_n2o, t_spark));
+
+	sc->t_main = T_START + T_MAIN + i_uniform(&rs, -2 * j, 2 * j);
+	ipa_open = r->fault == F_MISMATCH? SERVO_OPEN - i_uniform(&rs, 150, 400): SERVO_OPEN;
+	n2o_open = SERVO_OPEN;
+	if (r->fault == F_SERVO_LOSS)
+		i_servo(&sc->script, sc->t_main - i_uniform(&rs, 0, 100), "MAIN_N2O", 0);
+	steps = r->ramp? 8: 1;
+	t_ramp = r->ramp? i_uniform(&rs, 50, 400): 0;
+	for (i = 1; i <= steps; i++) {
+		t = sc->t_main + t_ramp * (i - 1) / steps;
+		i_servo(&sc->script, t, "MAIN_IPA", SERVO_SHUT + (ipa_open - SERVO_SHUT) * i / steps);
+		if (r->fault != F_SERVO_LOSS)
+			i_servo(&sc->script, t, "MAIN_N2O", SERVO_SHUT + (n2o_open - SERVO_SHUT) * i / steps);
+	}
+	if (r->fault == F_FLAMEOUT) {
+		t = sc->t_main + i_uniform(&rs, 600, 1500);
+		i_servo(&sc->script, t, "MAIN_IPA", SERVO_SHUT);
+		i_servo(&sc->script, t, "MAIN_N2O", SERVO_SHUT);
+		t += i_uniform(&rs, 50, 200);
+		i_servo(&sc->script, t, "MAIN_IPA", ipa_open);
+		i_servo(&sc->script, t, "MAIN_N2O", n2o_open);
+	}
+
+	t = sc->t_main + T_IG_SHUT + i_uniform(&rs, -j, j);
+	i_event(&sc->script, t, "pin\tIG_IPA\t0");
+	if (t_n2o >= 0)
+		i_event(&sc->script, t, "pin\tIG_N2O\t0");
+	sc->t_end = sc->t_main + T_BURN;
+	i_event(&sc->script, sc->t_end, "end");
+}
+
+/*
+ * The telemetry, as the run goes
+ */
+struct telem_s {
+	long t_main;		// ms since the first edge
+	long rise;		// first 90%, since t_main
+	bool up, out;
+	int open_deg;		// servo positions that count as open
+	unsigned long frames;
+};
+
+static void i_frame(void *ctx, unsigned char type, const unsigned char *f, int n) {
+	struct telem_s *tm = (struct telem_s *)ctx;
+	int v[TELEM_N];
+	unsigned mask;
+	long t;
+	int i, k;
+
+	if (type != FRAME_TELEMETRY || n < 6)
+		return;
+	t = f[1] | f[2] << 8 | (long)f[3] << 16 | (long)f[4] << 24;
+	mask = f[5];
+	for (i = 0, k = 6; i < TELEM_N; i++) {
+		v[i] = -1;
+		if ((mask & (1 << i)) && k + 2 <= n) {
+			v[i] = (int16_t)(f[k] | f[k + 1] << 8);
+			k += 2;
+		}
+	}
+	tm->frames++;
+
+	if (!tm->up && v[TELEM_CHAMBER_P] >= P_PCT(90)) {
+		tm->up = true;
+		tm->rise = t - tm->t_main;
+	}
+	// gone out: the valves open and the pressure well down
+	if (tm->up && v[TELEM_CHAMBER_P] < P_PCT(50) &&
+	    v[TELEM_IPA_SERVO] >= tm->open_deg && v[TELEM_N2O_SERVO] >= tm->open_deg &&
+	    v[TELEM_IPA_LEVEL] > 100 && v[TELEM_N2O_LEVEL] > 100)
+		tm->out = true;
+}
+
+static bool i_slurp(const char *path, std::vector<unsigned char> *v) {
+	unsigned char buf[4096];
+	size_t n;
+	FILE *f;
+
+	v->clear();
+	if (!(f = fopen(path, "rb")))
+		return false;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		v->insert(v->end(), buf, buf + n);
+	fclose(f);
+	return true;
+}
+
+static bool i_spawn(const struct scene_s *sc, const char *script, const char *ee, const char *out) {
+	posix_spawn_file_actions_t fa;
+	char t_arg[32];
+	const char *argv[] = { opts.sim.c_str(), "-t", t_arg, "-f", script, "-e", ee, 0 };
+	pid_t pid;
+	int status, err;
+
+	snprintf(t_arg, sizeof(t_arg), "%ld", sc->t_end + 100);
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 1, out, O_WRONLY | O_TRUNC, 0);
+	posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+	err = posix_spawn(&pid, argv[0], &fa, 0, (char *const *)argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if (err) {
+		fprintf(stderr, "mcrun: %s: %s\n", argv[0], strerror(err));
+		return false;
+	}
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int i_temp(char *path, const char *what) {
+	const char *dir;
+	int fd;
+
+	dir = getenv("TMPDIR");
+	snprintf(path, 256, "%s/mcrun-%s-XXXXXX", dir? dir: "/tmp", what);
+	if ((fd = mkstemp(path)) < 0)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+/*
+ * Play run k and judge it
+ */
+static void i_run(int k) {
+	struct run_s *r = &runs[k];
+	struct scene_s sc;
+	struct telem_s tm;
+	struct frame_rx_s rx;
+	std::vector<unsigned char> out, ee;
+	std::vector<struct log_rec_s> recs;
+	char script[256], ee_path[256], out_path[256];
+	unsigned seq;
+	bool ok;
+	long ig_good, done;
+	size_t i;
+	int len;
+	FILE *f;
+
+	i_scene(k, r, &sc);
+	r->ign = r->rise = r->burn = -1;
+	r->reason = R_SIM;
+	if (i_temp(script, "script") || i_temp(ee_path, "ee") || i_temp(out_path, "out"))
+		return;
+	ok = (f = fopen(script, "w")) && fputs(sc.script.c_str(), f) >= 0;
+	if (f)
+		fclose(f);
+	ok = ok && i_spawn(&sc, script, ee_path, out_path) &&
+	    i_slurp(out_path, &out) && i_slurp(ee_path, &ee);
+	unlink(script);
+	unlink(ee_path);
+	unlink(out_path);
+	if (!ok)
+		return;
+
+	tm.t_main = sc.t_main - sc.t_first;
+	tm.rise = -1;
+	tm.up = tm.out = false;
+	tm.open_deg = 125;		// SERVO_OPEN is 131 degrees
+	tm.frames = 0;
+	frame_rx_init(&rx, i_frame, &tm);
+	for (i = 0; i < out.size(); i++)
+		frame_rx_byte(&rx, out[i]);
+	frame_rx_finish(&rx);
+	if (!tm.frames)
+		return;
+
+	// the log is only saved when the run ends
+	ig_good = done = -1;
+	len = log_ee_find(&ee[0], ee.size(), &seq);
+	if (len >= 0 && log_decode(&ee[LOG_BASE], len, &recs)) {
+		for (i = 0; i < recs.size(); i++) {
+			if (recs[i].op == LOG_IG_PRESSURE_GOOD_1 && ig_good < 0)
+				ig_good = recs[i].t;
+			if (recs[i].op == LOG_MAIN_DONE)
+				done = recs[i].t;
+		}
+	}
+
+	if (ig_good >= 0 && sc.t_lit >= 0)
+		r->ign = ig_good - (sc.t_lit - sc.t_first);
+	r->rise = tm.rise;
+	if (done >= 0)
+		r->burn = done - tm.t_main;
+
+	if (ig_good < 0)
+		r->reason = R_NO_IG;
+	else if (r->ign > opts.ig_window)
+		r->reason = R_SLOW_IG;
+	else if (!tm.up)
+		r->reason = R_NO_CHAMBER;
+	else if (tm.rise > opts.main_window)
+		r->reason = R_SLOW_CHAMBER;
+	else if (tm.out)
+		r->reason = R_FLAMEOUT;
+	else if (done < 0)
+		r->reason = R_NO_BURNOUT;
+	else
+		r->reason = R_PASS;
+}
+
+/*
+ * The thread pool
+ */
+static std::vector<std::deque<int> > queues;
+static std::vector<std::mutex> locks;
+
+static bool i_take(int self, int *k) {
+	int n, i, v;
+
+	n = queues.size();
+	for (i = 0; i < n; i++) {
+		v = (self + i) % n;
+		std::lock_guard<std::mutex> g(locks[v]);
+		if (queues[v].empty())
+			continue;
+		// our own from the back, others' from the front
+		if (v == self) {
+			*k = queues[v].back();
+			queues[v].pop_back();
+		} else {
+			*k = queues[v].front();
+			queues[v].pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+static void i_worker(int self) {
+	int k;
+
+	while (i_take(self, &k))
+		i_run(k);
+}
+
+/*
+ * Summary
+ */
+static void i_spread(const char *what, std::vector<long> v) {
+	size_t n;
+
+	if (v.empty())
+		return;
+	std::sort(v.begin(), v.end());
+	n = v.size();
+	printf("    %-14s min %5ld  p50 %5ld  p90 %5ld  p99 %5ld  max %5ld ms\n", what,
+	    v[0], v[n / 2], v[n * 9 / 10], v[n * 99 / 100], v[n - 1]);
+}
+
+static void i_summary() {
+	std::vector<long> ign, rise, burn;
+	int f, i, n, why[R_N];
+	size_t k;
+
+	for (f = 0; f < F_N; f++) {
+		n = 0;
+		memset(why, 0, sizeof(why));
+		ign.clear();
+		rise.clear();
+		burn.clear();
+		for (k = 0; k < runs.size(); k++) {
+			if (runs[k].fault != f)
+				continue;
+			n++;
+			why[runs[k].reason]++;
+			if (runs[k].ign >= 0)
+				ign.push_back(runs[k].ign);
+			if (runs[k].rise >= 0)
+				rise.push_back(runs[k].rise);
+			if (runs[k].burn >= 0)
+				burn.push_back(runs[k].burn);
+		}
+		if (!n)
+			continue;
+		printf("%-13s %5d runs, %5d pass (%.1f%%)", fault_names[f], n, why[R_PASS], 100.0 * why[R_PASS] / n);
+		for (i = R_PASS + 1; i < R_N; i++)
+			if (why[i])
+				printf(", %d %s", why[i], reason_names[i]);
+		printf("\n");
+		i_spread("igniter delay", ign);
+		i_spread("chamber rise", rise);
+		i_spread("burn", burn);
+	}
+}
+
+static bool i_csv() {
+	FILE *f;
+	size_t k;
+
+	if (!(f = fopen(opts.csv.c_str(), "w"))) {
+		perror(opts.csv.c_str());
+		return false;
+	}
+	fprintf(f, "run,scenario,profile,result,igniter_ms,rise_ms,burn_ms\n");
+	for (k = 0; k < runs.size(); k++)
+		fprintf(f, "%u,%s,%s,%s,%ld,%ld,%ld\n", (unsigned)k, fault_names[runs[k].fault],
+		    runs[k].ramp? "ramp": "step", reason_names[runs[k].reason],
+		    runs[k].ign, runs[k].rise, runs[k].burn);
+	fclose(f);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::thread> threads;
+	struct timespec t0, t1;
+	double wall;
+	const char *slash;
+	int c, i;
+
+	opts.runs = 1000;
+	opts.threads = std::max(1u, std::thread::hardware_concurrency());
+	opts.seed = 1;
+	opts.jitter = 20;
+	opts.fault_pct = 25;
+	opts.ig_window = 100;
+	opts.main_window = 400;
+	slash = strrchr(argv[0], '/');
+	opts.sim = slash? std::string(argv[0], slash + 1 - argv[0]) + "motor_sim": "motor_sim";
+
+	while ((c = getopt(argc, argv, "n:j:s:J:f:i:m:b:o:")) != -1) {
+		switch (c) {
+		case 'n': opts.runs = atoi(optarg); break;
+		case 'j': opts.threads = atoi(optarg); break;
+		case 's': opts.seed = strtoull(optarg, 0, 0); break;
+		case 'J': opts.jitter = atoi(optarg); break;
+		case 'f': opts.fault_pct = atoi(optarg); break;
+		case 'i': opts.ig_window = atoi(optarg); break;
+		case 'm': opts.main_window = atoi(optarg); break;
+		case 'b': opts.sim = optarg; break;
+		case 'o': opts.csv = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-n runs] [-j threads] [-s seed] [-J ms] [-f pct]\n"
+			    "\t[-i ms] [-m ms] [-b motor_sim] [-o runs.csv]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (opts.runs < 1 || opts.threads < 1 || opts.jitter < 0) {
+		fprintf(stderr, "mcrun: runs, threads and jitter can't be negative\n");
+		return 2;
+	}
+	if (access(opts.sim.c_str(), X_OK)) {
+		perror(opts.sim.c_str());
+		return 2;
+	}
+
+	runs.resize(opts.runs);
+	queues.resize(opts.threads);
+	locks = std::vector<std::mutex>(opts.threads);
+	for (i = 0; i < opts.runs; i++)
+		queues[i % opts.threads].push_back(i);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < opts.threads; i++)
+		threads.push_back(std::thread(i_worker, i));
+	for (i = 0; i < opts.threads; i++)
+		threads[i].join();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	wall = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	i_summary();
+	printf("%d runs on %d threads in %.1f s, %.0f simulated seconds a second\n", opts.runs, opts.threads,
+	    wall, wall > 0? opts.runs * (T_START + T_MAIN + T_BURN) * 1e-3 / wall: 0.0);
+	if (!opts.csv.empty() && !i_csv())
+		return 1;
+	return 0;
+}
@@ -0,0 +1,150 @@
+/*
+ * Make the combustion table, pc_table.h, from a CSV of chamber pressures.
+ *
+ * Usage: pcgen [-o pc_table.h] [file.csv]
+ * 	file.csv	the pressures (default stdin)
+ * 	-o file		write the table here (default stdout)
+ *
+ * The CSV has a header line and then lines of
+ * 	flow_pct,ox_pct,pc_pct
+ * flow_pct is the total flow, percent of both valves' full flow, ox_pct
+ * N2O's percent share of it, and pc_pct the chamber pressure, percent.
+ * Lines starting with # are comments.  The points can be at any spacing
+ * but must make a full grid.  They are resampled, bilinearly, to the
+ * points the firmware uses (see physics.h); outside the grid the edge
+ * values hold.
+ *
+ * 	make -C host pc_table
+ * remakes the firmware's copy from host/data/pc.csv, and make test checks
+ * the two still match.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <algorithm>
+#include <map>
+#include <vector>
+#include "physics.h"
+
+struct grid_s {
+	std::vector<double> flow, ox;
+	std::map<std::pair<double, double>, double> pc;
+};
+
+static bool i_read(FILE *f, struct grid_s *g) {
+	char line[256];
+	double flow, ox, pc;
+	int n;
+
+	for (n = 1; fgets(line, sizeof(line), f); n++) {
+		if (line[0] == '#' || line[strspn(line, " \t\r\n")] == 0)
+			continue;
+		if (sscanf(line, "%lf,%lf,%lf", &flow, &ox, &pc) != 3) {
+			if (g->pc.empty())
+				continue;	// the header
+			fprintf(stderr, "pcgen: line %d: not flow_pct,ox_pct,pc_pct\n", n);
+			return false;
+		}
+		g->pc[std::make_pair(flow, ox)] = pc;
+		g->flow.push_back(flow);
+		g->ox.push_back(ox);
+	}
+
+	std::sort(g->flow.begin(), g->flow.end());
+	g->flow.erase(std::unique(g->flow.begin(), g->flow.end()), g->flow.end());
+	std::sort(g->ox.begin(), g->ox.end());
+	g->ox.erase(std::unique(g->ox.begin(), g->ox.end()), g->ox.end());
+	if (g->flow.size() < 2 || g->ox.size() < 2 || g->pc.size() != g->flow.size() * g->ox.size()) {
+		fprintf(stderr, "pcgen: the points are not a full grid of at least 2 by 2\n");
+		return false;
+	}
+	return true;
+}
+
+// the cell x is in along axis a, and how far along it, 0 to 1
+static size_t i_cell(const std::vector<double> &a, double x, double *f) {
+	size_t i;
+
+	x = std::min(std::max(x, a.front()), a.back());
+	for (i = 0; i + 2 < a.size() && x > a[i + 1]; i++)
+		;
+	*f = (x - a[i]) / (a[i + 1] - a[i]);
+	return i;
+}
+
+static double i_pc(const struct grid_s *g, double flow, double ox) {
+	double fi, fj, a, b;
+	size_t i, j;
+
+	i = i_cell(g->flow, flow, &fi);
+	j = i_cell(g->ox, ox, &fj);
+	a = g->pc.at(std::make_pair(g->flow[i], g->ox[j])) * (1 - fi) +
+	    g->pc.at(std::make_pair(g->flow[i + 1], g->ox[j])) * fi;
+	b = g->pc.at(std::make_pair(g->flow[i], g->ox[j + 1])) * (1 - fi) +
+	    g->pc.at(std::make_pair(g->flow[i + 1], g->ox[j + 1])) * fi;
+	return a * (1 - fj) + b * fj;
+}
+
+int main(int argc, char **argv) {
+	struct grid_s g;
+	const char *out_path = 0;
+	FILE *f, *out;
+	double flow, ox;
+	int c, i, j;
+	long pc;
+
+	while ((c = getopt(argc, argv, "o:")) != -1) {
+		switch (c) {
+		case 'o': out_path = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-o pc_table.h] [file.csv]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	f = optind < argc? fopen(argv[optind], "r"): stdin;
+	if (!f) {
+		perror(argv[optind]);
+		return 2;
+	}
+	if (!i_read(f, &g))
+		return 1;
+	if (f != stdin)
+		fclose(f);
+
+	out = out_path? fopen(out_path, "w"): stdout;
+	if (!out) {
+		perror(out_path);
+		return 2;
+	}
+	fprintf(out, "/*\n");
+	fprintf(out, " * Chamber pressure percent over flow and mixture; see physics.h.\n");
+	fprintf(out, " * Made by host/pcgen from host/data/pc.csv.  Do not edit.\n");
+	fprintf(out, " */\n\n");
+	fprintf(out, "#include \"avr/pgmspace.h\"\n\n");
+	fprintf(out, "const unsigned char pc_table[PC_FLOW_POINTS][PC_MIX_POINTS] PROGMEM = {\n");
+	fprintf(out, "//\tmixture 0 to 256 by %d\n", 1 << PC_SHIFT);
+	for (i = 0; i < PC_FLOW_POINTS; i++) {
+		// undo the firmware's sum * PC_FLOW_MUL >> PC_SHIFT; the sum is twice the flow
+		flow = std::min(100.0, (i << PC_SHIFT) * (double)(1 << PC_SHIFT) / PC_FLOW_MUL / 2);
+		fprintf(out, "\t{");
+		for (j = 0; j < PC_MIX_POINTS; j++) {
+			ox = (j << PC_SHIFT) * 100.0 / 256;
+			pc = lround(i_pc(&g, flow, ox));
+			if (pc < 0 || pc > 100) {
+				fprintf(stderr, "pcgen: %ld%% at flow %.1f%%, ox %.1f%% is not 0 to 100\n", pc, flow, ox);
+				return 1;
+			}
+			fprintf(out, "%s%3ld", j? ", ": " ", pc);
+		}
+		fprintf(out, " },\t// flow %.1f%%\n", flow);
+	}
+	fprintf(out, "};\n");
+
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,299 @@
+/*
+ * Golden output tests and the speed of the code, on the host.
+ *
+ * Each scenario is a stimulus script golden/<name>.txt.  regress runs it
+ * through motor_sim and checks what came out against golden/<name>.out:
+ * 	# lcd	the screen at the end
+ * 	# log	the log saved in EEPROM, one entry a line
+ * 	# dac	the igniter and main chamber DAC outputs, from motor_sim -w:
+ * 		a hash of every change to the microsecond, and the
+ * 		waveform every 5 ms
+ * The first line that differs is printed; diff the .out in the work
+ * directory against the golden one for the rest.
+ *
+ * It also prints the wall clock time motor_sim spent in loop() per
+ * simulated second.  With -p the numbers are kept in a file, and each
+ * run is compared with the last one; more than SLOWER percent slower is
+ * flagged, though only -P fails for it, since the time depends on what
+ * else the machine is doing.
+ *
+ * Usage: regress [-u] [-b motor_sim] [-g dir] [-d dir] [-p perf.txt] [-P pct] [name ...]
+ * 	name		the scenarios to run (default all of them)
+ * 	-u		write the .out files as they come out now
+ * 	-b file		the motor_sim to run (default, next to regress)
+ * 	-g dir		the scenarios (default golden)
+ * 	-d dir		work directory (default build/golden)
+ * 	-p file		keep the loop() times here
+ * 	-P pct		fail if any scenario is this much slower than last time
+ *
+ * After a change that is meant to change the outputs, run it with -u
+ * (make golden) and look over the difference in the .out files before
+ * committing them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "log.h"
+#include "log_op_names.h"
+#include "ee.h"
+#include "log_decode.h"
+
+extern char **environ;
+
+#define	N_OPS		(sizeof(op_codes_long) / sizeof(op_codes_long[0]))
+#define	RUN_MS		60000		// scenarios stop themselves, with "end"
+#define	SLOWER		25		// percent, to flag
+
+struct opts_s {
+	bool update;
+	std::string sim, golden, work, perf;
+	int fail_pct;
+};
+
+static struct opts_s opts;
+
+static bool i_slurp(const std::string &path, std::string *s) {
+	char buf[4096];
+	size_t n;
+	FILE *f;
+
+	s->clear();
+	if (!(f = fopen(path.c_str(), "rb")))
+		return false;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		s->append(buf, n);
+	fclose(f);
+	return true;
+}
+
+static bool i_spawn(const std::string &script, const std::string &ee, const std::string &wave, const std::string &err) {
+	posix_spawn_file_actions_t fa;
+	char t_arg[32];
+	const char *argv[] = { opts.sim.c_str(), "-q", "-s", "-t", t_arg, "-f", script.c_str(),
+	    "-e", ee.c_str(), "-w", wave.c_str(), 0 };
+	pid_t pid;
+	int status, err_no;
+
+	snprintf(t_arg, sizeof(t_arg), "%d", RUN_MS);
+	unlink(ee.c_str());
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+	posix_spawn_file_actions_addopen(&fa, 2, err.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	err_no = posix_spawn(&pid, argv[0], &fa, 0, (char *const *)argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if (err_no) {
+		fprintf(stderr, "regress: %s: %s\n", argv[0], strerror(err_no));
+		return false;
+	}
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ * The last screen motor_sim -s printed, and the loop() time
+ */
+static bool i_stderr(const std::string &err, std::string *lcd, double *us) {
+	static const std::string edge = "+--------------------+\n";
+	size_t a, b;
+	const char *p;
+
+	b = err.rfind(edge);
+	if (b == std::string::npos || b == 0 || (a = err.rfind(edge, b - 1)) == std::string::npos)
+		return false;
+	*lcd = err.substr(a, b + edge.size() - a);
+	p = strstr(err.c_str() + b, "real time, ");
+	return p && sscanf(p, "real time, %lf", us) == 1;
+}
+
+static void i_log(const std::string &ee, std::string *out) {
+	std::vector<struct log_rec_s> recs;
+	char line[96];
+	unsigned seq, code;
+	size_t i;
+	int len;
+
+	len = log_ee_find((const unsigned char *)ee.data(), ee.size(), &seq);
+	if (len < 0) {
+		*out += "no log\n";
+		return;
+	}
+	*out += "time_ms,time_us,name,param\n";
+	log_decode((const unsigned char *)ee.data() + LOG_BASE, len, &recs);
+	for (i = 0; i < recs.size(); i++) {
+		code = recs[i].op & ~LOG_LEVEL_MASK;
+		snprintf(line, sizeof(line), "%lu,%llu,%s,%u\n", recs[i].t, recs[i].us,
+		    code < N_OPS? op_codes_long[code]: "?", recs[i].param);
+		*out += line;
+	}
+}
+
+// line number and text of the first line that differs
+static bool i_same(const std::string &a, const std::string &b, int *line, std::string *la, std::string *lb) {
+	size_t i, start;
+
+	if (a == b)
+		return true;
+	*line = 1;
+	start = 0;
+	for (i = 0; i < a.size() && i < b.size() && a[i] == b[i]; i++)
+		if (a[i] == '\n') {
+			(*line)++;
+			start = i + 1;
+		}
+	*la = a.substr(start, a.find('\n', start) - start);
+	*lb = b.substr(start, b.find('\n', start) - start);
+	return false;
+}
+
+static bool i_write(const std::string &path, const std::string &s) {
+	FILE *f;
+	bool ok;
+
+	if (!(f = fopen(path.c_str(), "w"))) {
+		perror(path.c_str());
+		return false;
+	}
+	ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+	return fclose(f) == 0 && ok;
+}
+
+/*
+ * Run one scenario.  *us is its loop() time.
+ */
+static bool i_scenario(const std::string &name, double *us) {
+	std::string base, out, err, ee, wave, lcd, gold, la, lb;
+	int line;
+
+	base = opts.work + "/" + name;
+	*us = 0;
+	if (!i_spawn(opts.golden + "/" + name + ".txt", base + ".ee", base + ".wave", base + ".err") ||
+	    !i_slurp(base + ".err", &err) || !i_slurp(base + ".wave", &wave) ||
+	    !i_stderr(err, &lcd, us)) {
+		printf("%-16s motor_sim failed; see %s.err\n", name.c_str(), base.c_str());
+		return false;
+	}
+	i_slurp(base + ".ee", &ee);
+
+	out = "# lcd\n" + lcd + "# log\n";
+	i_log(ee, &out);
+	out += "# dac\n" + wave;
+	if (!i_write(base + ".out", out))
+		return false;
+
+	if (opts.update) {
+		if (!i_write(opts.golden + "/" + name + ".out", out))
+			return false;
+		printf("%-16s updated\n", name.c_str());
+		return true;
+	}
+	if (!i_slurp(opts.golden + "/" + name + ".out", &gold)) {
+		printf("%-16s no %s/%s.out; make golden\n", name.c_str(), opts.golden.c_str(), name.c_str());
+		return false;
+	}
+	if (!i_same(gold, out, &line, &la, &lb)) {
+		printf("%-16s FAIL at line %d\n\t%s\n\t%s (now)\n", name.c_str(), line, la.c_str(), lb.c_str());
+		return false;
+	}
+	return true;
+}
+
+static void i_perf_read(std::map<std::string, double> *m) {
+	char name[64];
+	double us;
+	FILE *f;
+
+	if (opts.perf.empty() || !(f = fopen(opts.perf.c_str(), "r")))
+		return;
+	while (fscanf(f, "%63s %lf", name, &us) == 2)
+		(*m)[name] = us;
+	fclose(f);
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::string> names;
+	std::map<std::string, double> last, now;
+	std::map<std::string, double>::iterator it;
+	glob_t g;
+	const char *slash;
+	double us, pct;
+	size_t i, n;
+	int c, failed, slow;
+	FILE *f;
+
+	slash = strrchr(argv[0], '/');
+	opts.sim = slash? std::string(argv[0], slash + 1 - argv[0]) + "motor_sim": "motor_sim";
+	opts.golden = "golden";
+	opts.work = "build/golden";
+	opts.update = false;
+	opts.fail_pct = 0;
+	while ((c = getopt(argc, argv, "ub:g:d:p:P:")) != -1) {
+		switch (c) {
+		case 'u': opts.update = true; break;
+		case 'b': opts.sim = optarg; break;
+		case 'g': opts.golden = optarg; break;
+		case 'd': opts.work = optarg; break;
+		case 'p': opts.perf = optarg; break;
+		case 'P': opts.fail_pct = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-u] [-b motor_sim] [-g dir] [-d dir] [-p perf.txt] [-P pct] [name ...]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	for (; optind < argc; optind++)
+		names.push_back(argv[optind]);
+	if (names.empty()) {
+		if (glob((opts.golden + "/*.txt").c_str(), 0, 0, &g) == 0) {
+			for (i = 0; i < g.gl_pathc; i++) {
+				slash = strrchr(g.gl_pathv[i], '/');
+				n = strlen(slash + 1) - 4;
+				names.push_back(std::string(slash + 1, n));
+			}
+			globfree(&g);
+		}
+	}
+	if (names.empty()) {
+		fprintf(stderr, "regress: no scenarios in %s\n", opts.golden.c_str());
+		return 2;
+	}
+	mkdir(opts.work.c_str(), 0755);
+	i_perf_read(&last);
+
+	failed = slow = 0;
+	for (i = 0; i < names.size(); i++) {
+		if (!i_scenario(names[i], &us)) {
+			failed++;
+			continue;
+		}
+		now[names[i]] = us;
+		if ((it = last.find(names[i])) == last.end() || it->second <= 0) {
+			printf("%-16s ok, %6.0f us of loop() per simulated second\n", names[i].c_str(), us);
+			continue;
+		}
+		pct = (us - it->second) * 100 / it->second;
+		printf("%-16s ok, %6.0f us of loop() per simulated second, %+.0f%%%s\n", names[i].c_str(),
+		    us, pct, pct > SLOWER? " SLOWER": "");
+		if (opts.fail_pct && pct > opts.fail_pct)
+			slow++;
+	}
+
+	if (!opts.perf.empty() && (f = fopen(opts.perf.c_str(), "w"))) {
+		for (it = now.begin(); it != now.end(); it++)
+			last[it->first] = it->second;
+		for (it = last.begin(); it != last.end(); it++)
+			fprintf(f, "%s %.1f\n", it->first.c_str(), it->second);
+		fclose(f);
+	}
+	printf("regress: %u scenarios, %d failed%s\n", (unsigned)names.size(), failed,
+	    slow? ", slower than last time": "");
+	return failed || slow? 1: 0;
+}
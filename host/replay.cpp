@@ -0,0 +1,507 @@
+/*
+ * Replay an input trace through the firmware and compare the results.
+ *
+ * A Trace Run (see trace.cpp) sends every input the firmware saw, the
+ * telemetry and, if the log is dumped afterwards from the menu, the
+ * log.  replay reads such a capture, makes a stimulus script that puts
+ * the same inputs on the pins at the same times, runs it as a Trace Run
+ * in motor_sim and compares what comes out with the capture:
+ * 	the trace		the replay saw the inputs the original did
+ * 	the telemetry		the DAC outputs, servos and propellant
+ * 	the log			from the capture, or the original's EEPROM
+ *
+ * Usage: replay [-b motor_sim] [-e eeprom.bin] [-w script] capture
+ * 	capture		the serial output of a Trace Run
+ * 	-b file		the motor_sim to run (default, next to replay)
+ * 	-e file		the original's EEPROM image, for the log
+ * 	-w file		keep the script
+ *
+ * The exit status is 0 if everything that could be compared matched.
+ *
+ * Times are kept as the firmware had them, so the replay is exact for
+ * a run recorded by motor_sim with the same menu keys (see
+ * scripts/trace_run.txt).  If the trace starts too soon for the keys,
+ * everything moves later by whole servo frames; the ADC doesn't run in
+ * step with those, so the samples in the trace can move a little.  A
+ * run recorded on the Nano replays the same way every time, but its loop
+ * won't line up with the host's, so the results can be off by a loop
+ * here and there.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "frame.h"
+#include "frame_rx.h"
+#include "log_decode.h"
+#include "log.h"
+#include "ee.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "valve_edge.h"
+#include "servo.h"
+
+extern char **environ;
+
+#define	MENU_TRACE_RUN	11		// menu items down from the top
+#define	T_KEYS		2100		// ms, the first menu key; the splash screen is up till then
+#define	T_READY		6000		// the trace can start once the keys are done
+#define	T_COMMIT	3000		// after the trace ends, for the log to be saved
+#define	SERVO_FRAME	20000		// us, as the harness makes them
+#define	SERVO_AHEAD	1000		// a new width is set this long before its pulse
+#define	ADC_AHEAD	150		// an ADC value this long before its conversion ends
+#define	N_START		4		// events trace_start() sends, for the levels at the start
+
+static const char *telem_names[TELEM_N] = {
+	"ig_output",
+	"chamber_p",
+	"ipa_servo",
+	"n2o_servo",
+	"ipa_level",
+	"n2o_level",
+};
+
+struct event_s {
+	unsigned input;
+	uint32_t t;		// micros() on the unit
+	unsigned value;
+};
+
+struct capture_s {
+	std::vector<struct event_s> trace;
+	bool started, ended;
+	unsigned seq;
+	unsigned long gaps;	// trace frames missing
+	std::map<unsigned long, std::vector<int> > telem;	// ms: each channel, -1 if not sent
+	std::vector<unsigned char> log;
+	bool have_log;
+};
+
+static void i_frame(void *ctx, unsigned char type, const unsigned char *f, int n) {
+	struct capture_s *c = (struct capture_s *)ctx;
+	std::vector<int> *v;
+	struct event_s e;
+	unsigned long t;
+	unsigned off, mask;
+	int i, k;
+
+	switch (type) {
+	case FRAME_TRACE:
+		if (c->ended || n < 1)
+			return;
+		if (c->started && f[0] != ((c->seq + 1) & 0xff))
+			c->gaps += (f[0] - c->seq - 1) & 0xff;
+		c->seq = f[0];
+		for (k = 1; k + TRACE_EVENT_BYTES <= n; k += TRACE_EVENT_BYTES) {
+			e.input = f[k];
+			e.t = f[k + 1] | f[k + 2] << 8 | (uint32_t)f[k + 3] << 16 | (uint32_t)f[k + 4] << 24;
+			e.value = f[k + 5] | f[k + 6] << 8;
+			if (e.input == TRACE_START) {
+				c->trace.clear();
+				c->telem.clear();
+				c->started = true;
+			}
+			if (!c->started || c->ended)
+				continue;
+			c->trace.push_back(e);
+			if (e.input == TRACE_END)
+				c->ended = true;
+		}
+		break;
+
+	case FRAME_TELEMETRY:
+		if (!c->started || c->ended || n < 6)
+			return;
+		t = f[1] | f[2] << 8 | (unsigned long)f[3] << 16 | (unsigned long)f[4] << 24;
+		mask = f[5];
+		v = &c->telem[t];
+		v->assign(TELEM_N, -1);
+		k = 6;
+		for (i = 0; i < TELEM_N && k + 2 <= n; i++) {
+			if (!(mask & (1 << i)))
+				continue;
+			(*v)[i] = (int16_t)(f[k] | f[k + 1] << 8);
+			k += 2;
+		}
+		break;
+
+	// a log dump after the run
+	case FRAME_LOG_HEAD:
+		if (n < 6)
+			return;
+		c->log.assign(f[2] | f[3] << 8, 0);
+		c->have_log = true;
+		break;
+
+	case FRAME_LOG_DATA:
+		if (n < 2 || !c->have_log)
+			return;
+		off = f[0] | f[1] << 8;
+		for (i = 2; i < n && off + i - 2 < c->log.size(); i++)
+			c->log[off + i - 2] = f[i];
+		break;
+	}
+}
+
+static bool i_slurp(const char *path, std::vector<unsigned char> *v) {
+	unsigned char buf[4096];
+	size_t n;
+	FILE *f;
+
+	v->clear();
+	if (!(f = fopen(path, "rb")))
+		return false;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		v->insert(v->end(), buf, buf + n);
+	fclose(f);
+	return true;
+}
+
+static void i_capture(const std::vector<unsigned char> &bytes, struct capture_s *c) {
+	struct frame_rx_s rx;
+	size_t i;
+
+	c->started = c->ended = c->have_log = false;
+	c->seq = 0;
+	c->gaps = 0;
+	frame_rx_init(&rx, i_frame, c);
+	for (i = 0; i < bytes.size(); i++)
+		frame_rx_byte(&rx, bytes[i]);
+	frame_rx_finish(&rx);
+}
+
+/*
+ * How many events at the start of a trace are a matter of the keys: the
+ * levels trace_start() sends and, if the trace started while the press
+ * that chose Trace Run was still down, the release that ends it.  The
+ * replay's own press makes that release, so it isn't scripted or timed.
+ */
+static size_t i_keys(const struct capture_s *c) {
+	if (c->trace.size() > N_START && c->trace[N_START].input == TRACE_ACTION && !c->trace[N_START].value)
+		return N_START + 1;
+	return N_START;
+}
+
+/*
+ * A script line; v < 0 for a pin command with no value (release)
+ */
+static void i_line(std::string *s, uint64_t us, const char *what, const char *pin, int v) {
+	char line[96];
+
+	if (pin && v < 0)
+		snprintf(line, sizeof(line), "%llu.%03llu\t%s\t%s\n",
+		    (unsigned long long)(us / 1000), (unsigned long long)(us % 1000), what, pin);
+	else if (pin)
+		snprintf(line, sizeof(line), "%llu.%03llu\t%s\t%s\t%d\n",
+		    (unsigned long long)(us / 1000), (unsigned long long)(us % 1000), what, pin, v);
+	else
+		snprintf(line, sizeof(line), "%llu.%03llu\t%s\n",
+		    (unsigned long long)(us / 1000), (unsigned long long)(us % 1000), what);
+	*s += line;
+}
+
+/*
+ * The script for a trace; *shift is added to the unit's micros().
+ */
+static void i_script(const struct capture_s *c, std::string *s, uint64_t *shift, uint64_t *end) {
+	static const char *servo_pins[SERVO_N_CHANNELS] = { "MAIN_IPA", "MAIN_N2O" };
+	unsigned width[SERVO_N_CHANNELS];
+	uint64_t phase[SERVO_N_CHANNELS];
+	bool seen[SERVO_N_CHANNELS];
+	uint64_t base, t, t0, last;
+	unsigned valves, ch;
+	size_t i, keys;
+	int k;
+
+	*s = "# made by replay from a Trace Run\n";
+	for (k = 0; k < MENU_TRACE_RUN; k++)
+		i_line(s, (T_KEYS + 200 * k) * 1000ULL, "down", 0, 0);
+	i_line(s, (T_KEYS + 200 * MENU_TRACE_RUN) * 1000ULL, "press", 0, 0);
+
+	// the first input after the levels it started with
+	base = c->trace[0].t;
+	keys = i_keys(c);
+	t = base + (c->trace.size() > keys? (uint32_t)(c->trace[keys].t - base): 0);
+	*shift = 0;
+	if (t < T_READY * 1000ULL)
+		*shift = (T_READY * 1000ULL - t + SERVO_FRAME - 1) / SERVO_FRAME * SERVO_FRAME;
+
+	valves = 0;
+	for (ch = 0; ch < SERVO_N_CHANNELS; ch++) {
+		width[ch] = 0;
+		phase[ch] = 0;
+		seen[ch] = false;
+	}
+	for (i = 0; i < c->trace.size(); i++) {
+		const struct event_s &e = c->trace[i];
+
+		if (i >= N_START && i < keys)
+			continue;
+
+		t = base + (uint32_t)(e.t - c->trace[0].t) + *shift;	// micros() wraps
+		// the levels it started with were there all along
+		t0 = i < N_START? 0: t;
+		switch (e.input) {
+		case TRACE_IG_VALVES:
+			if ((e.value ^ valves) & VALVE_IPA)
+				i_line(s, t0, "pin", "IG_IPA", !!(e.value & VALVE_IPA));
+			if ((e.value ^ valves) & VALVE_N2O)
+				i_line(s, t0, "pin", "IG_N2O", !!(e.value & VALVE_N2O));
+			valves = e.value;
+			break;
+		case TRACE_SPARK:
+			if (t0 || e.value)
+				i_line(s, t0? t0 - ADC_AHEAD: 0, "analog", "SPARK", e.value);
+			break;
+		case TRACE_IG_PRESS:
+			if (t0 || e.value)
+				i_line(s, t0? t0 - ADC_AHEAD: 0, "analog", "IG_PRESS", e.value);
+			break;
+		case TRACE_IPA_SERVO:
+		case TRACE_N2O_SERVO:
+			ch = e.input == TRACE_IPA_SERVO? SERVO_IPA: SERVO_N2O;
+			if (e.value && !seen[ch]) {
+				// the pulses were going before the trace, in step with this one
+				phase[ch] = t % SERVO_FRAME;
+				i_line(s, phase[ch], "servo", servo_pins[ch], e.value);
+				seen[ch] = true;
+			} else if (e.value && !width[ch]) {
+				phase[ch] = t % SERVO_FRAME;
+				i_line(s, t, "servo", servo_pins[ch], e.value);
+			} else if (e.value)
+				i_line(s, t - SERVO_AHEAD, "servo", servo_pins[ch], e.value);
+			else {
+				// seen as gone SERVO_TIMEOUT after the last pulse
+				last = t - SERVO_TIMEOUT * 1000ULL;
+				last -= (last - phase[ch]) % SERVO_FRAME;
+				i_line(s, last + SERVO_AHEAD * 3, "servo", servo_pins[ch], 0);
+			}
+			width[ch] = e.value;
+			break;
+		case TRACE_ACTION:
+			if (e.value)
+				i_line(s, t - 1, "pin", "ACTION", 0);
+			else
+				i_line(s, t - 1, "release", "ACTION", -1);
+			break;
+		}
+	}
+	*end = base + (uint32_t)(c->trace.back().t - c->trace[0].t) + *shift + T_COMMIT * 1000ULL;
+	i_line(s, *end, "end", 0, 0);
+}
+
+static bool i_spawn(const char *sim, const char *script, const char *ee, const char *out, uint64_t end) {
+	posix_spawn_file_actions_t fa;
+	char t_arg[32];
+	const char *argv[] = { sim, "-t", t_arg, "-f", script, "-e", ee, 0 };
+	pid_t pid;
+	int status, err;
+
+	snprintf(t_arg, sizeof(t_arg), "%llu", (unsigned long long)(end / 1000 + 100));
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 1, out, O_WRONLY | O_TRUNC, 0);
+	posix_spawn_file_actions_addopen(&fa, 2, "/dev/null", O_WRONLY, 0);
+	err = posix_spawn(&pid, argv[0], &fa, 0, (char *const *)argv, environ);
+	posix_spawn_file_actions_destroy(&fa);
+	if (err) {
+		fprintf(stderr, "replay: %s: %s\n", argv[0], strerror(err));
+		return false;
+	}
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static int i_temp(char *path, const char *what) {
+	const char *dir;
+	int fd;
+
+	dir = getenv("TMPDIR");
+	snprintf(path, 256, "%s/replay-%s-XXXXXX", dir? dir: "/tmp", what);
+	if ((fd = mkstemp(path)) < 0)
+		return -1;
+	close(fd);
+	return 0;
+}
+
+/*
+ * The comparisons; each returns the number of differences
+ */
+/*
+ * The trace starts when the menu gets to the Trace Run, which is a
+ * matter of the keys; after that the times should all be shift later.
+ */
+static int i_cmp_trace(const struct capture_s *a, const struct capture_s *b, uint64_t shift) {
+	size_t i, n, keys;
+	uint32_t ta, tb;
+
+	n = std::min(a->trace.size(), b->trace.size());
+	keys = i_keys(a);
+	for (i = 0; i < n; i++) {
+		ta = a->trace[i].t + (uint32_t)shift;
+		tb = i < keys? ta: b->trace[i].t;
+		if (a->trace[i].input != b->trace[i].input || a->trace[i].value != b->trace[i].value || ta != tb) {
+			printf("trace: event %u differs: input %u value %u at %lu us, replay input %u value %u at %lu us\n",
+			    (unsigned)i, a->trace[i].input, a->trace[i].value, (unsigned long)ta,
+			    b->trace[i].input, b->trace[i].value, (unsigned long)b->trace[i].t);
+			return 1;
+		}
+	}
+	if (a->trace.size() != b->trace.size()) {
+		printf("trace: %u events, replay %u\n", (unsigned)a->trace.size(), (unsigned)b->trace.size());
+		return 1;
+	}
+	printf("trace: %u events, the same\n", (unsigned)n);
+	return 0;
+}
+
+static int i_cmp_telem(const struct capture_s *a, const struct capture_s *b) {
+	std::map<unsigned long, std::vector<int> >::const_iterator i, j;
+	unsigned long n, bad;
+	int k;
+
+	n = bad = 0;
+	for (i = a->telem.begin(); i != a->telem.end(); i++) {
+		if ((j = b->telem.find(i->first)) == b->telem.end())
+			continue;	// dropped by one or the other
+		n++;
+		for (k = 0; k < TELEM_N; k++) {
+			if (i->second[k] < 0 || j->second[k] < 0 || i->second[k] == j->second[k])
+				continue;
+			if (!bad)
+				printf("telemetry: first difference at %lu ms: %s %d, replay %d\n",
+				    i->first, telem_names[k], i->second[k], j->second[k]);
+			bad++;
+			break;
+		}
+	}
+	printf("telemetry: %lu frames compared, %lu differ\n", n, bad);
+	return n && !bad? 0: 1;
+}
+
+static int i_cmp_log(const std::vector<unsigned char> &a, const std::vector<unsigned char> &b) {
+	std::vector<struct log_rec_s> ra, rb;
+	size_t i;
+
+	log_decode(&a[0], a.size(), &ra);
+	log_decode(&b[0], b.size(), &rb);
+	for (i = 0; i < ra.size() && i < rb.size(); i++) {
+		if (ra[i].op != rb[i].op || ra[i].param != rb[i].param || ra[i].t != rb[i].t) {
+			printf("log: entry %u differs: op %u param %u at %lu ms, replay op %u param %u at %lu ms\n",
+			    (unsigned)i, ra[i].op, ra[i].param, ra[i].t, rb[i].op, rb[i].param, rb[i].t);
+			return 1;
+		}
+	}
+	if (ra.size() != rb.size()) {
+		printf("log: %u entries, replay %u\n", (unsigned)ra.size(), (unsigned)rb.size());
+		return 1;
+	}
+	printf("log: %u entries, the same\n", (unsigned)ra.size());
+	return 0;
+}
+
+static bool i_ee_log(const std::vector<unsigned char> &ee, std::vector<unsigned char> *log) {
+	unsigned seq;
+	int len;
+
+	if ((len = log_ee_find(ee.empty()? 0: &ee[0], ee.size(), &seq)) < 0)
+		return false;
+	log->assign(ee.begin() + LOG_BASE, ee.begin() + LOG_BASE + len);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	struct capture_s orig, rep;
+	std::vector<unsigned char> bytes, ee;
+	std::vector<unsigned char> rep_log;
+	std::string sim, script_text;
+	const char *ee_path = 0, *keep = 0, *slash;
+	char script[256], rep_ee[256], out[256];
+	uint64_t shift, end;
+	FILE *f;
+	bool ok;
+	int c, bad;
+
+	slash = strrchr(argv[0], '/');
+	sim = slash? std::string(argv[0], slash + 1 - argv[0]) + "motor_sim": "motor_sim";
+	while ((c = getopt(argc, argv, "b:e:w:")) != -1) {
+		switch (c) {
+		case 'b': sim = optarg; break;
+		case 'e': ee_path = optarg; break;
+		case 'w': keep = optarg; break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind != argc - 1)
+		goto usage;
+
+	if (!i_slurp(argv[optind], &bytes)) {
+		perror(argv[optind]);
+		return 2;
+	}
+	i_capture(bytes, &orig);
+	if (orig.trace.empty()) {
+		fprintf(stderr, "replay: %s: no trace\n", argv[optind]);
+		return 2;
+	}
+	if (!orig.ended)
+		fprintf(stderr, "replay: the trace has no end; replaying what there is\n");
+	else if (orig.trace.back().value || orig.gaps)
+		fprintf(stderr, "replay: the trace lost %u events and %lu frames; it won't match\n",
+		    orig.trace.back().value, orig.gaps);
+	if (ee_path) {
+		if (!i_slurp(ee_path, &ee) || !i_ee_log(ee, &orig.log)) {
+			fprintf(stderr, "replay: %s: no log\n", ee_path);
+			return 2;
+		}
+		orig.have_log = true;
+	}
+
+	i_script(&orig, &script_text, &shift, &end);
+	if (keep)
+		strncpy(script, keep, sizeof(script) - 1);
+	else if (i_temp(script, "script"))
+		return 2;
+	script[sizeof(script) - 1] = '\0';
+	if (i_temp(rep_ee, "ee") || i_temp(out, "out"))
+		return 2;
+	ok = (f = fopen(script, "w")) && fputs(script_text.c_str(), f) >= 0;
+	if (f)
+		fclose(f);
+	ok = ok && i_spawn(sim.c_str(), script, rep_ee, out, end) &&
+	    i_slurp(out, &bytes) && i_slurp(rep_ee, &ee);
+	if (!keep)
+		unlink(script);
+	unlink(rep_ee);
+	unlink(out);
+	if (!ok) {
+		fprintf(stderr, "replay: %s didn't run\n", sim.c_str());
+		return 2;
+	}
+
+	i_capture(bytes, &rep);
+	if (shift)
+		printf("replay: %llu ms later than the original\n", (unsigned long long)(shift / 1000));
+	bad = i_cmp_trace(&orig, &rep, shift);
+	bad += i_cmp_telem(&orig, &rep);
+	if (orig.have_log && i_ee_log(ee, &rep_log))
+		bad += i_cmp_log(orig.log, rep_log);
+	else if (orig.have_log) {
+		printf("log: the replay saved none\n");
+		bad++;
+	} else
+		printf("log: none in the capture\n");
+	printf("replay: %s\n", bad? "DIFFERENT": "same");
+	return bad? 1: 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-b motor_sim] [-e eeprom.bin] [-w script] capture\n", argv[0]);
+	return 2;
+}
@@ -0,0 +1,191 @@
+/*
+ * Stimulus scripts for the host harness.
+ *
+ * One event per line, in any order:
+ * 	<ms> <command> [args]
+ * The time can have a fraction, down to the microsecond.
+ *
+ * Commands:
+ * 	pin <pin> <0|1>		drive a digital input
+ * 	release <pin>		stop driving it
+ * 	analog <pin> <value>	set an analog input (10 bits)
+ * 	servo <pin> <us>	50 Hz servo pulses of this width, 0 for none
+ * 	press			action button, held for 50 ms
+ * 	up, down		scroll switch, held for 50 ms
+ * 	lcd			print the LCD screen to stderr
+ * 	end			stop the run
+ *
+ * Pins are numbers, A0-A7, or the names in pins.h without the PIN_ prefix.
+ * '#' starts a comment.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "hal.h"
+#include "pins.h"
+#include "script.h"
+
+enum script_op { S_PIN, S_RELEASE, S_ANALOG, S_SERVO, S_LCD, S_END };
+
+struct script_event_s {
+	uint64_t t;		// microseconds
+	int op;
+	int pin;
+	int val;
+};
+
+static std::vector<struct script_event_s> events;
+static size_t next_event;
+static bool ended;
+
+static const struct {
+	const char *name;
+	int pin;
+} pin_names[] = {
+	{ "MAIN_N2O", PIN_MAIN_N2O },
+	{ "MAIN_IPA", PIN_MAIN_IPA },
+	{ "IG_IPA", PIN_IG_IPA },
+	{ "IG_N2O", PIN_IG_N2O },
+	{ "LED", PIN_LED },
+	{ "MAIN_PRESS", PIN_MAIN_PRESS },
+	{ "IG_PRESS", PIN_IG_PRESS },
+	{ "SPARK", PIN_SPARK },
+	{ "ACTION", PIN_ACTION },
+	{ "SCROLL", PIN_SCROLL },
+};
+
+static int pin_number(const char *s) {
+	unsigned i;
+
+	if (s[0] == 'A' && s[1] >= '0' && s[1] <= '7' && !s[2])
+		return A0 + s[1] - '0';
+	if (s[0] >= '0' && s[0] <= '9')
+		return atoi(s);
+	for (i = 0; i < sizeof(pin_names) / sizeof(pin_names[0]); i++)
+		if (!strcmp(s, pin_names[i].name))
+			return pin_names[i].pin;
+	return -1;
+}
+
+static void add(uint64_t t, int op, int pin, int val) {
+	struct script_event_s e;
+
+	e.t = t;
+	e.op = op;
+	e.pin = pin;
+	e.val = val;
+	events.push_back(e);
+}
+
+bool script_parse_line(const char *line, int lineno) {
+	char cmd[32], a1[32], a2[32];
+	double ms;
+	uint64_t t;
+	int n, pin;
+
+	n = sscanf(line, "%lf %31s %31s %31s", &ms, cmd, a1, a2);
+	if (n <= 0 || line[strspn(line, " \t")] == '#')
+		return true;
+	if (n < 2)
+		goto bad;
+	t = (uint64_t)(ms * 1000 + 0.5);	// to the microsecond
+	pin = n >= 3? pin_number(a1): -1;
+
+	if (!strcmp(cmd, "pin") && n == 4 && pin >= 0)
+		add(t, S_PIN, pin, atoi(a2));
+	else if (!strcmp(cmd, "release") && n == 3 && pin >= 0)
+		add(t, S_RELEASE, pin, 0);
+	else if (!strcmp(cmd, "analog") && n == 4 && pin >= 0)
+		add(t, S_ANALOG, pin, atoi(a2));
+	else if (!strcmp(cmd, "servo") && n == 4 && pin >= 0)
+		add(t, S_SERVO, pin, atoi(a2));
+	else if (!strcmp(cmd, "press")) {
+		add(t, S_PIN, PIN_ACTION, LOW);
+		add(t + 50000, S_RELEASE, PIN_ACTION, 0);
+	} else if (!strcmp(cmd, "up") || !strcmp(cmd, "down")) {
+		add(t, S_ANALOG, PIN_SCROLL, cmd[0] == 'u'? 0: 1023);
+		add(t + 50000, S_ANALOG, PIN_SCROLL, 512);
+	} else if (!strcmp(cmd, "lcd"))
+		add(t, S_LCD, 0, 0);
+	else if (!strcmp(cmd, "end"))
+		add(t, S_END, 0, 0);
+	else
+		goto bad;
+	return true;
+
+bad:
+	fprintf(stderr, "script line %d: can't parse: %s", lineno, line);
+	return false;
+}
+
+static bool before(const struct script_event_s &a, const struct script_event_s &b) {
+	return a.t < b.t;
+}
+
+bool script_load(const char *path) {
+	char line[256];
+	FILE *f;
+	int lineno;
+	bool ok;
+
+	f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+	ok = true;
+	for (lineno = 1; fgets(line, sizeof(line), f); lineno++)
+		ok = script_parse_line(line, lineno) && ok;
+	fclose(f);
+	std::stable_sort(events.begin(), events.end(), before);
+	next_event = 0;
+	return ok;
+}
+
+static void script_due() {
+	script_run(hal_now_us());
+}
+
+/*
+ * Apply every event that is due, and arrange to be called again when
+ * the next one is.  Events land at their exact time, even in the
+ * middle of a loop() pass.
+ */
+void script_run(uint64_t now_us) {
+	struct script_event_s *e;
+
+	while (next_event < events.size() && events[next_event].t <= now_us) {
+		e = &events[next_event++];
+		switch (e->op) {
+		case S_PIN:
+			hal_pin_set(e->pin, e->val);
+			break;
+		case S_RELEASE:
+			hal_pin_release(e->pin);
+			break;
+		case S_ANALOG:
+			hal_analog_set(e->pin, e->val);
+			break;
+		case S_SERVO:
+			hal_servo_set(e->pin, e->val);
+			break;
+		case S_LCD:
+			fprintf(stderr, "t = %.3f\n", now_us * 1e-6);
+			hal_lcd_dump(stderr);
+			break;
+		case S_END:
+			ended = true;
+			break;
+		}
+	}
+	if (next_event < events.size())
+		hal_at(events[next_event].t, script_due);
+}
+
+bool script_done() {
+	return ended;
+}
@@ -0,0 +1,15 @@
+/*
+ * Stimulus scripts for the host harness.
+ */
+
+#ifndef _HOST_SCRIPT_H
+#define _HOST_SCRIPT_H
+
+#include <stdint.h>
+
+bool script_load(const char *path);
+bool script_parse_line(const char *line, int lineno);
+void script_run(uint64_t now_us);
+bool script_done();
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * Record the live telemetry from a Telemetry Run to CSV.
+ *
+ * Reads the serial stream (see telemetry.cpp), keeps the telemetry
+ * frames and writes one line per frame:
+ * 	seq,time_ms,<one column per channel sent>
+ * Gaps in the sequence numbers are frames the firmware dropped.
+ *
+ * Usage: telemrec [-b baud] [-o out.csv] [device|file]
+ * 	device|file	a serial port or a capture (default stdin)
+ * 	-b baud		set a serial port to this speed (default 500000)
+ * 	-o file		write the CSV here (default stdout)
+ *
+ * Reading stops at end of file, or when the stream goes back to text:
+ * the statistics the firmware prints at the end of the run.
+ *
+ * With the host build:
+ * 	build/motor_sim -f script | build/telemrec -o trace.csv
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include "frame.h"
+#include "frame_rx.h"
+#include "telemetry.h"
+
+static const char *channel_names[TELEM_N] = {
+	"ig_output",
+	"chamber_p",
+	"ipa_servo",
+	"n2o_servo",
+	"ipa_level",
+	"n2o_level",
+};
+
+struct rec_s {
+	FILE *out;
+	int mask;		// channels in the header line, -1 before the first frame
+	unsigned seq;
+	unsigned long frames, dropped;
+};
+
+static void i_header(struct rec_s *r, unsigned mask) {
+	int i;
+
+	if (r->mask >= 0)
+		fprintf(stderr, "telemrec: channels changed from 0x%x to 0x%x\n", r->mask, mask);
+	fprintf(r->out, "seq,time_ms");
+	for (i = 0; i < TELEM_N; i++)
+		if (mask & (1 << i))
+			fprintf(r->out, ",%s", channel_names[i]);
+	fprintf(r->out, "\n");
+	r->mask = mask;
+}
+
+static void i_frame(void *ctx, unsigned char type, const unsigned char *f, int n) {
+	struct rec_s *r = (struct rec_s *)ctx;
+	unsigned long t;
+	unsigned mask;
+	int i, k;
+
+	if (type != FRAME_TELEMETRY || n < 6)
+		return;
+	mask = f[5];
+	if ((int)mask != r->mask)
+		i_header(r, mask);
+	else
+		r->dropped += (f[0] - r->seq - 1) & 0xff;
+	r->seq = f[0];
+	r->frames++;
+
+	t = f[1] | f[2] << 8 | (unsigned long)f[3] << 16 | (unsigned long)f[4] << 24;
+	fprintf(r->out, "%u,%lu", f[0], t);
+	k = 6;
+	for (i = 0; i < TELEM_N; i++) {
+		if (!(mask & (1 << i)))
+			continue;
+		if (k + 2 > n)
+			break;
+		fprintf(r->out, ",%d", (int16_t)(f[k] | f[k + 1] << 8));
+		k += 2;
+	}
+	fprintf(r->out, "\n");
+}
+
+static speed_t i_speed(unsigned long baud) {
+	switch (baud) {
+	case 9600: return B9600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	case 500000: return B500000;
+	case 1000000: return B1000000;
+	}
+	fprintf(stderr, "telemrec: unsupported baud rate %lu\n", baud);
+	exit(2);
+}
+
+/*
+ * Raw mode at the given speed, if fd is a serial port.
+ */
+static void i_tty(int fd, unsigned long baud) {
+	struct termios tio;
+
+	if (!isatty(fd) || tcgetattr(fd, &tio))
+		return;
+	cfmakeraw(&tio);
+	cfsetispeed(&tio, i_speed(baud));
+	cfsetospeed(&tio, i_speed(baud));
+	tio.c_cc[VMIN] = 1;
+	tio.c_cc[VTIME] = 0;
+	tcsetattr(fd, TCSANOW, &tio);
+}
+
+int main(int argc, char **argv) {
+	unsigned long baud = 500000;
+	const char *out_path = 0;
+	struct frame_rx_s rx;
+	struct rec_s r;
+	unsigned char buf[4096];
+	ssize_t n, i;
+	int c, fd;
+
+	while ((c = getopt(argc, argv, "b:o:")) != -1) {
+		switch (c) {
+		case 'b': baud = strtoul(optarg, 0, 0); break;
+		case 'o': out_path = optarg; break;
+		default:
+			fprintf(stderr, "usage: %s [-b baud] [-o out.csv] [device|file]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	fd = 0;
+	if (optind < argc && (fd = open(argv[optind], O_RDONLY | O_NOCTTY)) < 0) {
+		perror(argv[optind]);
+		return 2;
+	}
+	i_tty(fd, baud);
+
+	r.out = out_path? fopen(out_path, "w"): stdout;
+	if (!r.out) {
+		perror(out_path);
+		return 2;
+	}
+	r.mask = -1;
+	r.seq = 0;
+	r.frames = r.dropped = 0;
+
+	frame_rx_init(&rx, i_frame, &r);
+	while ((n = read(fd, buf, sizeof(buf))) > 0) {
+		for (i = 0; i < n; i++)
+			frame_rx_byte(&rx, buf[i]);
+		// no frame is that long: the run is over and this is text
+		if (r.frames && rx.buf.size() > 256)
+			break;
+	}
+	frame_rx_finish(&rx);
+
+	fclose(r.out);
+	fprintf(stderr, "telemrec: %lu frames, %lu dropped, %lu bad\n", r.frames, r.dropped, rx.bad);
+	return 0;
+}
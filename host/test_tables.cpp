@@ -0,0 +1,160 @@
+/*
+ * Check the lookup tables and the divide-free conversions against the
+ * arithmetic they replaced, for every input they can get, and the valve
+ * flow curves, servo model and combustion table against their limits.
+ *
+ * 	make test
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include "Arduino.h"
+#include "physics.h"
+#include "servo.h"
+
+static int failures;
+
+static void check(const char *what, long in, long got, long want) {
+	if (got == want)
+		return;
+	if (failures++ < 20)
+		printf("%s(%ld): %ld, want %ld\n", what, in, got, want);
+}
+
+/*
+ * What an int expression comes to on the AVR, where int is 16 bits.
+ * Expected values go through this wherever the firmware's arithmetic is
+ * int, so a table that overflows there fails here too.
+ */
+static long i16(long v) {
+	return (int16_t)v;
+}
+
+/*
+ * A flow curve starts shut, ends open, never goes down, and the
+ * interpolation goes through its points and stays between them.
+ */
+static void check_curve(const char *what, const unsigned char *curve, int lo, int hi) {
+	int pos, i, p, a, b;
+
+	check(what, 0, curve[0], 0);
+	check(what, hi, curve[(hi - lo) / VALVE_STEP], 100);
+	for (pos = (lo - 2) << SERVO_POS_SHIFT; pos <= (hi + 2) << SERVO_POS_SHIFT; pos++) {
+		p = physics_valve_pct(curve, lo, hi, pos);
+		if (pos <= lo << SERVO_POS_SHIFT) {
+			check(what, pos, p, 0);
+			continue;
+		}
+		if (pos >= hi << SERVO_POS_SHIFT) {
+			check(what, pos, p, 100);
+			continue;
+		}
+		i = (pos - (lo << SERVO_POS_SHIFT)) / (VALVE_STEP << SERVO_POS_SHIFT);
+		a = curve[i];
+		b = curve[i + 1];
+		check(what, pos, b >= a, 1);
+		if (pos == (lo + i * VALVE_STEP) << SERVO_POS_SHIFT)
+			check(what, pos, p, a);
+		check(what, pos, p >= a && p <= b, 1);
+	}
+}
+
+/*
+ * A servo gets to where it is sent, in the time its limits allow,
+ * without going past.
+ */
+static void check_servo(int from, int to) {
+	struct physics_servo_s s;
+	int t, vel, dist, want;
+
+	s.pos = s.target = from << SERVO_POS_SHIFT;
+	s.vel = 0;
+	dist = abs(to - from) << SERVO_POS_SHIFT;
+	for (t = 0; t < 1000 && (s.pos != to << SERVO_POS_SHIFT || s.vel); t++) {
+		vel = s.vel;
+		physics_servo(&s, to);
+		check("servo speed", t, abs(s.vel) <= SERVO_RATE, 1);
+		check("servo accel", t, abs(s.vel - vel) <= SERVO_ACCEL, 1);
+		check("servo overshoot", t, abs(s.pos - (from << SERVO_POS_SHIFT)) <= dist, 1);
+	}
+	// accelerate, cruise, brake; a few steps of slack for the rounding
+	want = dist / SERVO_RATE + SERVO_RATE / SERVO_ACCEL;
+	check("servo time", to, t <= want + 3, 1);
+}
+
+/*
+ * The combustion table's interpolation is within 1.5 counts of doing it
+ * in floating point, for every pair of valve percentages.
+ */
+static void check_pc() {
+	int ipa, n2o, i, j, p;
+	double x, y, fi, fj, a, b, want;
+
+	for (ipa = 0; ipa <= 100; ipa++) {
+		for (n2o = 0; n2o <= 100; n2o++) {
+			p = physics_pc_pct(ipa, n2o);
+			check("physics_pc_pct range", ipa * 1000 + n2o, p >= 0 && p <= 100, 1);
+			if (ipa + n2o == 0)
+				continue;
+			x = (ipa + n2o) * (double)PC_FLOW_MUL / (1 << PC_SHIFT) / (1 << PC_SHIFT);
+			y = n2o * 256.0 / (ipa + n2o) / (1 << PC_SHIFT);
+			i = std::min((int)x, PC_FLOW_POINTS - 2);
+			j = std::min((int)y, PC_MIX_POINTS - 2);
+			fi = x - i;
+			fj = y - j;
+			a = pc_table[i][j] * (1 - fi) + pc_table[i + 1][j] * fi;
+			b = pc_table[i][j + 1] * (1 - fi) + pc_table[i + 1][j + 1] * fi;
+			want = a * (1 - fj) + b * fj;
+			check("physics_pc_pct", ipa * 1000 + n2o, fabs(p - want) <= 1.5, 1);
+		}
+	}
+	check("physics_pc_pct", 0, physics_pc_pct(0, 0), 0);
+	check("physics_pc_pct", 100100, physics_pc_pct(100, 100), 100);
+	check("physics_pc_pct", 100, physics_pc_pct(0, 100), 0);
+	check("physics_pc_pct", 100000, physics_pc_pct(100, 0), 0);
+}
+
+int main() {
+	unsigned long w;
+	int pct, frac, level, old_frac, old_level, p;
+
+	check_curve("ipa", ipa_valve_curve, IPA_SERVO_MIN, IPA_SERVO_MAX);
+	check_curve("n2o", n2o_valve_curve, N2O_SERVO_MIN, N2O_SERVO_MAX);
+	check_servo(0, IPA_SERVO_MAX);
+	check_servo(IPA_SERVO_MAX, IPA_SERVO_MIN);
+	check_servo(IPA_SERVO_MIN, IPA_SERVO_MIN + 1);
+	check_servo(90, 90);
+	check_pc();
+
+	for (pct = 0; pct <= 100; pct++)
+		check("physics_chamber_pct_of", pct, physics_chamber_pct_of(pct), i16(i16(CHAMBER_EFF * pct) / 100));
+
+	for (pct = 0; pct <= CHAMBER_PCT_TOP; pct++)
+		check("physics_chamber_p_of", pct, physics_chamber_p_of(pct),
+		    i16((long)pct * (MAX_MAIN_PRESSURE - SENSOR_ZERO) / 100 + SENSOR_ZERO));
+	check("physics_chamber_p_of", 100, physics_chamber_p_of(100), MAX_MAIN_PRESSURE);
+
+	for (frac = 0; frac < 100; frac++) {
+		for (pct = 0; pct <= 100; pct++) {
+			level = old_level = 4000;
+			old_frac = frac + pct;
+			old_level -= old_frac / 100;
+			old_frac %= 100;
+			p = frac;
+			physics_consume(&level, &p, pct);
+			check("physics_consume level", frac * 1000 + pct, level, old_level);
+			check("physics_consume frac", frac * 1000 + pct, p, old_frac);
+		}
+	}
+
+	// servo.cpp servo_read()
+	for (w = SERVO_MIN; w <= SERVO_MAX; w++)
+		check("servo degrees", w,
+		    ((unsigned long)(unsigned int)(w - SERVO_MIN) * SERVO_DEG_MUL) >> SERVO_DEG_SHIFT,
+		    ((w - SERVO_MIN) * 180UL) / (SERVO_MAX - SERVO_MIN));
+
+	printf("test_tables: %s, %d failures\n", failures? "FAIL": "ok", failures);
+	return failures != 0;
+}